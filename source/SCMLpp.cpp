@@ -8,6 +8,8 @@
 #include <cmath>
 #include <algorithm>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
 
 #if !defined(_MSC_VER) || defined(MARMALADE)
     #include "libgen.h"
@@ -20,16 +22,41 @@
     #define PATH_MAX MAX_PATH
 #endif
 
+#if defined(_WIN32) || defined(_MSC_VER)
+    #include <windows.h>  // for the timer and interlocked operations
+#else
+    #include <time.h>
+#endif
+#ifdef MARMALADE
+    #include "s3eTimer.h"
+#endif
+
+#ifdef SCML_PROFILE
+    // Events per thread.  Keep it a power of two.
+    #ifndef SCML_PROFILE_RING_SIZE
+        #define SCML_PROFILE_RING_SIZE 65536
+    #endif
+#endif
+
+#ifdef _MSC_VER
+    #define SCML_THREAD_LOCAL __declspec(thread)
+#else
+    #define SCML_THREAD_LOCAL __thread
+#endif
+
 namespace SCML
 {
 
 // Visual Studio doesn't have dirname?
 #if defined(_MSC_VER) && !defined(MARMALADE)
-    // FIXME: This breaks the STL abstraction
-    SCML_STRING dirname(SCML_STRING source)
+    char* dirname(char* path)
     {
-        source.erase(std::find(source.rbegin(), source.rend(), '/').base(), source.end());
-        return source;
+        char* slash = strrchr(path, '/');
+        if(slash == NULL)
+            path[0] = '\0';
+        else
+            slash[1] = '\0';
+        return path;
     }
 #endif
 
@@ -72,24 +99,505 @@ static void logi(int indent, const char* formatted_text, ...)
 
 
 
+// Every block from allocate() starts with this header, so deallocate() can find the owner.
+// It is padded to 16 bytes to keep the returned memory aligned.
+class Allocation_Header
+{
+public:
+    Allocator* owner;
+    size_t size;
+};
+
+#define SCML_ALLOCATION_HEADER_SIZE 16
+
+class Malloc_Allocator : public Allocator
+{
+public:
+    virtual void* allocate(size_t size)
+    {
+        return malloc(size);
+    }
+    virtual void deallocate(void* ptr, size_t size)
+    {
+        free(ptr);
+    }
+};
+
+static Malloc_Allocator default_allocator;
+static SCML_THREAD_LOCAL Allocator* current_allocator = &default_allocator;
+static Allocation_Stats allocation_stats;
+
+Allocation_Stats::Allocation_Stats()
+    : allocations(0), deallocations(0), bytes_allocated(0), bytes_deallocated(0)
+{}
+
+Allocation_Stats Allocation_Stats::operator-(const Allocation_Stats& other) const
+{
+    Allocation_Stats result;
+    result.allocations = allocations - other.allocations;
+    result.deallocations = deallocations - other.deallocations;
+    result.bytes_allocated = bytes_allocated - other.bytes_allocated;
+    result.bytes_deallocated = bytes_deallocated - other.bytes_deallocated;
+    return result;
+}
+
+Allocator* setAllocator(Allocator* allocator)
+{
+    Allocator* old = current_allocator;
+    current_allocator = (allocator == NULL? &default_allocator : allocator);
+    return old;
+}
+
+Allocator* getAllocator()
+{
+    return current_allocator;
+}
+
+Allocation_Stats getAllocationStats()
+{
+    return allocation_stats;
+}
+
+void* allocate(size_t size)
+{
+    Allocator* owner = current_allocator;
+    char* block = static_cast<char*>(owner->allocate(SCML_ALLOCATION_HEADER_SIZE + size));
+    if(block == NULL)
+        return NULL;
+
+    Allocation_Header* header = reinterpret_cast<Allocation_Header*>(block);
+    header->owner = owner;
+    header->size = size;
+
+    allocation_stats.allocations++;
+    allocation_stats.bytes_allocated += size;
+    return block + SCML_ALLOCATION_HEADER_SIZE;
+}
+
+void deallocate(void* ptr)
+{
+    if(ptr == NULL)
+        return;
+
+    char* block = static_cast<char*>(ptr) - SCML_ALLOCATION_HEADER_SIZE;
+    Allocation_Header* header = reinterpret_cast<Allocation_Header*>(block);
+
+    allocation_stats.deallocations++;
+    allocation_stats.bytes_deallocated += header->size;
+    header->owner->deallocate(block, SCML_ALLOCATION_HEADER_SIZE + header->size);
+}
+
+// Blocks are allocated with this in front, padded to keep the memory after it aligned.
+class Arena_Allocator::Block
+{
+public:
+    Block* next;
+    Allocator* owner;
+    size_t size;
+};
+
+#define SCML_ARENA_BLOCK_HEADER_SIZE 32
+#define SCML_ARENA_ALIGN(size) (((size) + 15) & ~size_t(15))
+
+Arena_Allocator::Arena_Allocator(size_t block_size, Allocator* parent)
+    : blocks(NULL), cursor(NULL), end(NULL), block_size(block_size), bytes_used(0), num_blocks(0), parent(parent)
+{}
+
+Arena_Allocator::~Arena_Allocator()
+{
+    release();
+}
+
+Arena_Allocator::Block* Arena_Allocator::allocateBlock(size_t size)
+{
+    Allocator* owner = (parent == NULL? &default_allocator : parent);
+    Block* block = static_cast<Block*>(owner->allocate(SCML_ARENA_BLOCK_HEADER_SIZE + size));
+    if(block == NULL)
+        return NULL;
+
+    block->owner = owner;
+    block->size = SCML_ARENA_BLOCK_HEADER_SIZE + size;
+    num_blocks++;
+    return block;
+}
+
+void* Arena_Allocator::allocate(size_t size)
+{
+    size = SCML_ARENA_ALIGN(size);
+
+    if(size > size_t(end - cursor))
+    {
+        // Big allocations get their own block behind the current one, so the rest of the current block isn't wasted.
+        if(size > block_size/2 && blocks != NULL)
+        {
+            Block* block = allocateBlock(size);
+            if(block == NULL)
+                return NULL;
+            block->next = blocks->next;
+            blocks->next = block;
+            bytes_used += size;
+            return reinterpret_cast<char*>(block) + SCML_ARENA_BLOCK_HEADER_SIZE;
+        }
+
+        Block* block = allocateBlock(size > block_size? size : block_size);
+        if(block == NULL)
+            return NULL;
+        block->next = blocks;
+        blocks = block;
+        cursor = reinterpret_cast<char*>(block) + SCML_ARENA_BLOCK_HEADER_SIZE;
+        end = reinterpret_cast<char*>(block) + block->size;
+    }
+
+    void* result = cursor;
+    cursor += size;
+    bytes_used += size;
+    return result;
+}
+
+void Arena_Allocator::deallocate(void* ptr, size_t size)
+{}
+
+void Arena_Allocator::release()
+{
+    while(blocks != NULL)
+    {
+        Block* next = blocks->next;
+        blocks->owner->deallocate(blocks, blocks->size);
+        blocks = next;
+    }
+    cursor = NULL;
+    end = NULL;
+    bytes_used = 0;
+    num_blocks = 0;
+}
+
+void Arena_Allocator::setParent(Allocator* parent)
+{
+    if(parent != this)
+        this->parent = parent;
+}
+
+size_t Arena_Allocator::getBytesUsed() const
+{
+    return bytes_used;
+}
+
+int Arena_Allocator::getNumBlocks() const
+{
+    return num_blocks;
+}
+
+void* Allocated::operator new(size_t size)
+{
+    void* ptr = SCML::allocate(size);
+    if(ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void Allocated::operator delete(void* ptr)
+{
+    SCML::deallocate(ptr);
+}
+
+
+
+// A monotonic clock for the profiler and Update_Scheduler
+static unsigned long long now_ns()
+{
+#if defined(MARMALADE)
+    return s3eTimerGetUSTNanoseconds();
+#elif defined(_WIN32)
+    static LARGE_INTEGER freq;
+    if(freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER count;
+    QueryPerformanceCounter(&count);
+    return (unsigned long long)(count.QuadPart * (1.0e9 / freq.QuadPart));
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+
+#ifdef SCML_PROFILE
+
+class Profile_Event
+{
+public:
+    const char* name;
+    const void* tag;
+    unsigned long long start_ns;
+    unsigned long long duration_ns;
+};
+
+// Written only by its own thread.  count is the total number of events recorded, so the ring holds the last SCML_PROFILE_RING_SIZE of them.
+class Profile_Ring
+{
+public:
+    Profile_Event events[SCML_PROFILE_RING_SIZE];
+    volatile unsigned long count;
+    int thread_id;
+    Profile_Ring* next;
+};
+
+// All threads' rings, pushed lock-free and never removed
+static Profile_Ring* volatile profile_rings = NULL;
+static volatile long profile_thread_count = 0;
+static SCML_THREAD_LOCAL Profile_Ring* profile_ring = NULL;
+
+static Profile_Ring* create_profile_ring()
+{
+    // Plain malloc, so the profiler doesn't show up in SCML::getAllocationStats()
+    Profile_Ring* ring = static_cast<Profile_Ring*>(malloc(sizeof(Profile_Ring)));
+    if(ring == NULL)
+        return NULL;
+    ring->count = 0;
+
+#if defined(_MSC_VER)
+    ring->thread_id = InterlockedIncrement(&profile_thread_count);
+    do
+    {
+        ring->next = profile_rings;
+    }
+    while(InterlockedCompareExchangePointer((void* volatile*)&profile_rings, ring, ring->next) != ring->next);
+#else
+    ring->thread_id = __sync_add_and_fetch(&profile_thread_count, 1);
+    do
+    {
+        ring->next = profile_rings;
+    }
+    while(!__sync_bool_compare_and_swap(&profile_rings, ring->next, ring));
+#endif
+    return ring;
+}
+
+Profile_Zone::Profile_Zone(const char* name, const void* tag)
+    : name(name), tag(tag), start_ns(now_ns())
+{}
+
+Profile_Zone::~Profile_Zone()
+{
+    unsigned long long end_ns = now_ns();
+
+    Profile_Ring* ring = profile_ring;
+    if(ring == NULL)
+    {
+        ring = profile_ring = create_profile_ring();
+        if(ring == NULL)
+            return;
+    }
+
+    Profile_Event& event = ring->events[ring->count % SCML_PROFILE_RING_SIZE];
+    event.name = name;
+    event.tag = tag;
+    event.start_ns = start_ns;
+    event.duration_ns = end_ns - start_ns;
+    ring->count++;
+}
+
+bool writeProfileTrace(const char* filename)
+{
+    FILE* out = fopen(filename, "w");
+    if(out == NULL)
+    {
+        SCML::log("SCML::writeProfileTrace() couldn't open %s.\n", filename);
+        return false;
+    }
+
+    fprintf(out, "{\"traceEvents\": [\n");
+    bool first = true;
+    for(Profile_Ring* ring = profile_rings; ring != NULL; ring = ring->next)
+    {
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"SCML thread %d\"}}", (first? "" : ",\n"), ring->thread_id, ring->thread_id);
+        first = false;
+
+        unsigned long count = ring->count;
+        unsigned long i = (count > SCML_PROFILE_RING_SIZE? count - SCML_PROFILE_RING_SIZE : 0);
+        for(; i < count; i++)
+        {
+            const Profile_Event& event = ring->events[i % SCML_PROFILE_RING_SIZE];
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"SCML\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f", event.name, ring->thread_id, event.start_ns/1000.0, event.duration_ns/1000.0);
+            if(event.tag != NULL)
+                fprintf(out, ", \"args\": {\"tag\": \"%p\"}", event.tag);
+            fprintf(out, "}");
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    fclose(out);
+    return true;
+}
+
+void clearProfile()
+{
+    for(Profile_Ring* ring = profile_rings; ring != NULL; ring = ring->next)
+        ring->count = 0;
+}
+
+#else
+
+bool writeProfileTrace(const char* filename)
+{
+    SCML::log("SCML::writeProfileTrace() has nothing to write.  Compile SCMLpp with SCML_PROFILE defined to record zones.\n");
+    return false;
+}
+
+void clearProfile()
+{}
+
+#endif
+
+
+
+#ifdef SCML_NO_STL
+
+String::String()
+    : length(0), capacity(0)
+{
+    local[0] = '\0';
+}
+
+String::String(const char* str)
+    : length(0), capacity(0)
+{
+    local[0] = '\0';
+    assign(str, strlen(str));
+}
+
+String::String(const String& str)
+    : length(0), capacity(0)
+{
+    local[0] = '\0';
+    assign(str.c_str(), str.length);
+}
+
+String::~String()
+{
+    if(capacity > 0)
+        SCML::deallocate(heap);
+}
+
+String& String::operator=(const char* str)
+{
+    assign(str, strlen(str));
+    return *this;
+}
+
+String& String::operator=(const String& str)
+{
+    if(this != &str)
+        assign(str.c_str(), str.length);
+    return *this;
+}
+
+String& String::operator+=(const char* str)
+{
+    append(str, strlen(str));
+    return *this;
+}
+
+String& String::operator+=(const String& str)
+{
+    // str might be this string
+    String copy(str);
+    append(copy.c_str(), copy.length);
+    return *this;
+}
+
+String& String::operator+=(char c)
+{
+    append(&c, 1);
+    return *this;
+}
+
+void String::clear()
+{
+    length = 0;
+    data()[0] = '\0';
+}
+
+void String::assign(const char* str, unsigned int size)
+{
+    reserve(size);
+    memmove(data(), str, size);
+    length = size;
+    data()[length] = '\0';
+}
+
+void String::append(const char* str, unsigned int size)
+{
+    reserve(length + size);
+    memcpy(data() + length, str, size);
+    length += size;
+    data()[length] = '\0';
+}
+
+void String::reserve(unsigned int size)
+{
+    if(size < LOCAL_SIZE && capacity == 0)
+        return;
+    if(size < capacity)
+        return;
+
+    unsigned int new_capacity = (capacity > 0? capacity*2 : 2*LOCAL_SIZE);
+    if(new_capacity <= size)
+        new_capacity = size + 1;
+    char* new_heap = static_cast<char*>(SCML::allocate(new_capacity));
+    if(new_heap == NULL)
+        throw std::bad_alloc();
+    memcpy(new_heap, c_str(), length + 1);
+    if(capacity > 0)
+        SCML::deallocate(heap);
+    heap = new_heap;
+    capacity = new_capacity;
+}
+
+String operator+(const String& a, const String& b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+
+String operator+(const String& a, const char* b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+
+String operator+(const char* a, const String& b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+
+#endif
+
+
+
 Data::Data()
-    : pixel_art_mode(false), meta_data(NULL)
+    : pixel_art_mode(false), quantize_keys(false), defer_animations(false), pose_cache(NULL), meta_data(NULL)
 {}
 
 Data::Data(const SCML_STRING& file)
-    : pixel_art_mode(false), meta_data(NULL)
+    : pixel_art_mode(false), quantize_keys(false), defer_animations(false), pose_cache(NULL), meta_data(NULL)
 {
     load(file);
 }
 
 Data::Data(TiXmlElement* elem)
-    : pixel_art_mode(false), meta_data(NULL)
+    : pixel_art_mode(false), quantize_keys(false), defer_animations(false), pose_cache(NULL), meta_data(NULL)
 {
     load(elem);
 }
 
 Data::Data(const Data& copy)
-    : scml_version(copy.scml_version), generator(copy.generator), generator_version(copy.generator_version), pixel_art_mode(copy.pixel_art_mode), meta_data(NULL)
+    : scml_version(copy.scml_version), generator(copy.generator), generator_version(copy.generator_version), pixel_art_mode(copy.pixel_art_mode), quantize_keys(copy.quantize_keys), defer_animations(copy.defer_animations), pose_cache(NULL), meta_data(NULL)
 {
     clone(copy, true);
 }
@@ -108,6 +616,8 @@ Data& Data::clone(const Data& copy, bool skip_base)
         generator = copy.generator;
         generator_version = copy.generator_version;
         pixel_art_mode = copy.pixel_art_mode;
+        quantize_keys = copy.quantize_keys;
+        defer_animations = copy.defer_animations;
     }
 
     // TODO: Clone the subobjects
@@ -120,13 +630,123 @@ Data::~Data()
     clear();
 }
 
+// Reads length bytes of a file from offset (all of it if length < 0) and ends them with a '\0'
+static bool read_text_file(const char* file, long offset, long length, SCML_VECTOR(char)& text)
+{
+    FILE* f = fopen(file, "rb");
+    if(f == NULL)
+        return false;
+
+    if(length < 0)
+    {
+        fseek(f, 0, SEEK_END);
+        length = ftell(f);
+    }
+
+    bool result = (length >= 0 && fseek(f, offset, SEEK_SET) == 0);
+    if(result)
+    {
+        SCML_VECTOR_RESIZE(text, length + 1);
+        result = (fread(&text[0], 1, length, f) == (size_t)length);
+        text[length] = '\0';
+    }
+    fclose(f);
+    return result;
+}
+
+// Cuts the body out of each <animation> element of an SCML document, so that parsing it only loads the headers.  The
+// body is blanked out and the start tag closed with a scmlpp_deferred attribute, which indexes the spans (offset and
+// length) of the whole elements in the original text.  If copy is not NULL, the elements are also copied into it and
+// the spans refer to the copy.
+static void defer_animation_bodies(char* text, SCML_VECTOR(int)& spans, SCML_VECTOR(char)* copy)
+{
+    SCML_VECTOR_CLEAR(spans);
+    for(char* p = strstr(text, "<animation"); p != NULL; p = strstr(p, "<animation"))
+    {
+        char* start = p;
+        p += 10;
+        if(*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+            continue;
+
+        // Find the end of the start tag, skipping quoted attribute values
+        char quote = '\0';
+        for(; *p != '\0' && (quote != '\0' || *p != '>'); p++)
+        {
+            if(quote != '\0')
+            {
+                if(*p == quote)
+                    quote = '\0';
+            }
+            else if(*p == '"' || *p == '\'')
+                quote = *p;
+        }
+        if(*p == '\0')
+            return;
+        if(p[-1] == '/')
+            continue;
+
+        char* end = strstr(p, "</animation>");
+        if(end == NULL)
+            return;
+        end += 12;
+
+        int index = SCML_VECTOR_SIZE(spans)/2;
+        char attribute[32];
+        int attribute_length = sprintf(attribute, " scmlpp_deferred=\"%d\"/>", index);
+        if(attribute_length > end - p)
+        {
+            p = end;
+            continue;
+        }
+
+        int offset = start - text;
+        int length = end - start;
+        if(copy != NULL)
+        {
+            int n = SCML_VECTOR_SIZE(*copy);
+            SCML_VECTOR_RESIZE(*copy, n + length + 1);
+            memcpy(&(*copy)[n], start, length);
+            (*copy)[n + length] = '\0';
+            offset = n;
+        }
+        int n = SCML_VECTOR_SIZE(spans);
+        SCML_VECTOR_RESIZE(spans, n + 2);
+        spans[n] = offset;
+        spans[n + 1] = length;
+
+        memcpy(p, attribute, attribute_length);
+        memset(p + attribute_length, ' ', end - p - attribute_length);
+        p = end;
+    }
+}
+
 bool Data::load(const SCML_STRING& file)
 {
+    SCML_PROFILE_ZONE("Data::load", this);
+
     name = file;
 
     TiXmlDocument doc;
 
-    if(!doc.LoadFile(SCML_TO_CSTRING(file)))
+    if(defer_animations)
+    {
+        SCML_VECTOR(char) text;
+        if(!read_text_file(SCML_TO_CSTRING(file), 0, -1, text))
+        {
+            SCML::log("SCML::Data failed to load: Couldn't open %s.\n", SCML_TO_CSTRING(file));
+            return false;
+        }
+        SCML_VECTOR_CLEAR(deferred_text);
+        defer_animation_bodies(&text[0], deferred_spans, NULL);
+        doc.Parse(&text[0]);
+        if(doc.Error())
+        {
+            SCML::log("SCML::Data failed to load: Couldn't parse %s.\n", SCML_TO_CSTRING(file));
+            SCML::log("%s\n", doc.ErrorDesc());
+            return false;
+        }
+    }
+    else if(!doc.LoadFile(SCML_TO_CSTRING(file)))
     {
         SCML::log("SCML::Data failed to load: Couldn't open %s.\n", SCML_TO_CSTRING(file));
         SCML::log("%s\n", doc.ErrorDesc());
@@ -149,7 +769,19 @@ bool Data::load(const SCML_STRING& file)
 bool Data::fromTextData(const char* data) {
     TiXmlDocument doc;
 
-	doc.Parse(data);
+    if(defer_animations)
+    {
+        // The caller's text is left alone
+        SCML_VECTOR(char) text;
+        size_t length = strlen(data);
+        SCML_VECTOR_RESIZE(text, length + 1);
+        memcpy(&text[0], data, length + 1);
+        SCML_VECTOR_CLEAR(deferred_text);
+        defer_animation_bodies(&text[0], deferred_spans, &deferred_text);
+        doc.Parse(&text[0]);
+    }
+    else
+        doc.Parse(data);
     TiXmlElement* root = doc.FirstChildElement("spriter_data");
     if(root == NULL)
     {
@@ -162,16 +794,113 @@ bool Data::fromTextData(const char* data) {
     return true;
 }
 
-bool Data::load(TiXmlElement* elem)
+// The handle of a tag name, giving a new name the next handle
+static int get_tag_handle(Name_Table& tag_names, const SCML_STRING& name)
 {
-    if(elem == NULL)
-        return false;
+    int handle = tag_names.find(SCML_TO_CSTRING(name));
+    if(handle < 0)
+    {
+        handle = tag_names.size();
+        tag_names.insert(SCML_TO_CSTRING(name), handle);
+        if(handle == Tag_Set::MAX_TAGS)
+            SCML::log("SCML::Data has more than %d tags.  Tag sets leave out '%s' and the ones after it.\n", (int)Tag_Set::MAX_TAGS, SCML_TO_CSTRING(name));
+    }
+    return handle;
+}
 
-    scml_version = xmlGetStringAttr(elem, "scml_version", "");
-    generator = xmlGetStringAttr(elem, "generator", "(Spriter)");
+static void add_tags(Name_Table& tag_names, const Data::Meta_Data* meta_data, Tag_Set& tags)
+{
+    if(meta_data == NULL)
+        return;
+    SCML_BEGIN_MAP_FOREACH_CONST(meta_data->tags, SCML_STRING, Data::Meta_Data::Tag*, tag)
+    {
+        tags.add(get_tag_handle(tag_names, tag->name));
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+static void add_tags(Name_Table& tag_names, const Data::Meta_Data_Tweenable* meta_data, Tag_Set& tags)
+{
+    if(meta_data == NULL)
+        return;
+    SCML_BEGIN_MAP_FOREACH_CONST(meta_data->tags, SCML_STRING, Data::Meta_Data_Tweenable::Tag*, tag)
+    {
+        tags.add(get_tag_handle(tag_names, tag->name));
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+// Gives the tags in an animation's keys handles and stores each key's tags as a set.  A mainline key also gets the
+// tags of the timeline keys that it refers to, so the tags at any time are those of one mainline key.
+static void add_tag_names(Name_Table& tag_names, Data::Entity::Animation* animation)
+{
+    typedef Data::Entity::Animation::Timeline Timeline;
+    typedef Data::Entity::Animation::Mainline::Key Mainline_Key;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, Timeline*, timeline)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(timeline->keys, int, Timeline::Key*, key)
+        {
+            key->tags.clear();
+            add_tags(tag_names, key->meta_data, key->tags);
+            add_tags(tag_names, key->bone.meta_data, key->tags);
+            add_tags(tag_names, key->object.meta_data, key->tags);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(animation->mainline.keys, int, Mainline_Key*, key)
+    {
+        key->tags.clear();
+        add_tags(tag_names, key->meta_data, key->tags);
+
+        SCML_BEGIN_MAP_FOREACH_CONST(key->bones, int, Mainline_Key::Bone_Container, item)
+        {
+            if(!item.hasBone_Ref())
+                continue;
+            Timeline* timeline = SCML_MAP_FIND(animation->timelines, item.bone_ref->timeline);
+            Timeline::Key* timeline_key = (timeline != NULL? SCML_MAP_FIND(timeline->keys, item.bone_ref->key) : NULL);
+            if(timeline_key != NULL)
+                key->tags |= timeline_key->tags;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+
+        SCML_BEGIN_MAP_FOREACH_CONST(key->objects, int, Mainline_Key::Object_Container, item)
+        {
+            if(!item.hasObject_Ref())
+                continue;
+            Timeline* timeline = SCML_MAP_FIND(animation->timelines, item.object_ref->timeline);
+            Timeline::Key* timeline_key = (timeline != NULL? SCML_MAP_FIND(timeline->keys, item.object_ref->key) : NULL);
+            if(timeline_key != NULL)
+                key->tags |= timeline_key->tags;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+bool Data::load(TiXmlElement* elem)
+{
+    SCML_PROFILE_ZONE("Data::load(TiXmlElement)", this);
+
+    if(elem == NULL)
+        return false;
+
+    // The Data's own members outlive arena.release(), so they are loaded before the arena is installed.
+    scml_version = xmlGetStringAttr(elem, "scml_version", "");
+    generator = xmlGetStringAttr(elem, "generator", "(Spriter)");
     generator_version = xmlGetStringAttr(elem, "generator_version", "(1.0)");
     pixel_art_mode = xmlGetBoolAttr(elem, "pixel_art_mode", false);
 
+    TiXmlElement* document_info_elem = elem->FirstChildElement("document_info");
+    if(document_info_elem != NULL)
+        document_info.load(document_info_elem);
+
+    // Everything created below goes into the arena.  Its blocks come from the caller's allocator.
+    Allocator_Scope arena_scope(&arena);
+    arena.setParent(arena_scope.previous);
+
     TiXmlElement* meta_data_child = elem->FirstChildElement("meta_data");
     if(meta_data_child != NULL)
     {
@@ -226,6 +955,15 @@ bool Data::load(TiXmlElement* elem)
                 SCML::log("SCML::Data loaded an entity with a duplicate id (%d).\n", entity->id);
                 delete entity;
             }
+            else
+            {
+                entity_names.insert(SCML_TO_CSTRING(entity->name), entity->id);
+                SCML_BEGIN_MAP_FOREACH_CONST(entity->animations, int, Entity::Animation*, animation)
+                {
+                    add_tag_names(tag_names, animation);
+                }
+                SCML_END_MAP_FOREACH_CONST;
+            }
         }
         else
         {
@@ -244,6 +982,8 @@ bool Data::load(TiXmlElement* elem)
                 SCML::log("SCML::Data loaded a character_map with a duplicate id (%d).\n", character_map->id);
                 delete character_map;
             }
+            else
+                character_map_names.insert(SCML_TO_CSTRING(character_map->name), character_map->id);
         }
         else
         {
@@ -252,10 +992,6 @@ bool Data::load(TiXmlElement* elem)
         }
     }
 
-    TiXmlElement* document_info_elem = elem->FirstChildElement("document_info");
-    if(document_info_elem != NULL)
-        document_info.load(document_info_elem);
-
     return true;
 }
 
@@ -312,11 +1048,27 @@ void Data::log(int recursive_depth) const
 
 void Data::clear()
 {
+    delete pose_cache;
+    pose_cache = NULL;
+
     scml_version = "";
     generator = "(Spriter)";
     generator_version = "(1.0)";
     pixel_art_mode = false;
 
+    entity_names.clear();
+    character_map_names.clear();
+    tag_names.clear();
+
+#ifdef SCML_NO_STL
+    // Without the STL, nothing below the Data holds memory outside of the arena that load() filled, so the arena is
+    // freed in one go without walking the destructors.  Objects added to these maps by hand must come from the arena too.
+    meta_data = NULL;
+    folders.abandon();
+    atlases.abandon();
+    entities.abandon();
+    character_maps.abandon();
+#else
     delete meta_data;
     meta_data = NULL;
 
@@ -347,8 +1099,14 @@ void Data::clear()
     }
     SCML_END_MAP_FOREACH;
     character_maps.clear();
+#endif
 
     document_info.clear();
+    SCML_VECTOR_CLEAR(deferred_spans);
+    SCML_VECTOR_CLEAR(deferred_text);
+
+    // The deletes above only ran destructors.  This frees the memory.
+    arena.release();
 }
 
 
@@ -361,6 +1119,97 @@ int Data::getNumAnimations(int entity) const
     return SCML_MAP_SIZE(e->animations);
 }
 
+int Data::getEntityID(const char* entityName) const
+{
+    return entity_names.find(entityName);
+}
+
+Data::Character_Map* Data::getCharacterMap(const char* characterMapName) const
+{
+    int id = character_map_names.find(characterMapName);
+    if(id < 0)
+        return NULL;
+    return SCML_MAP_FIND(character_maps, id);
+}
+
+bool Data::loadAnimation(int entity, int animation)
+{
+    Entity* entity_ptr = SCML_MAP_FIND(entities, entity);
+    if(entity_ptr == NULL)
+        return false;
+    Entity::Animation* animation_ptr = SCML_MAP_FIND(entity_ptr->animations, animation);
+    if(animation_ptr == NULL)
+        return false;
+    if(animation_ptr->deferred < 0)
+        return true;
+
+    SCML_PROFILE_ZONE("Data::loadAnimation", this);
+
+    int span = animation_ptr->deferred;
+    if(2*span + 1 >= (int)SCML_VECTOR_SIZE(deferred_spans))
+        return false;
+
+    SCML_VECTOR(char) text;
+    const char* element_text = NULL;
+    if(SCML_VECTOR_SIZE(deferred_text) > 0)
+        element_text = &deferred_text[deferred_spans[2*span]];
+    else if(read_text_file(SCML_TO_CSTRING(name), deferred_spans[2*span], deferred_spans[2*span + 1], text))
+        element_text = &text[0];
+    else
+    {
+        SCML::log("SCML::Data failed to load animation %d: Couldn't read %s.\n", animation, SCML_TO_CSTRING(name));
+        return false;
+    }
+
+    TiXmlDocument doc;
+    doc.Parse(element_text);
+    TiXmlElement* elem = doc.FirstChildElement("animation");
+    if(elem == NULL || xmlGetIntAttr(elem, "id", -1) != animation_ptr->id)
+    {
+        SCML::log("SCML::Data failed to load animation %d: %s has changed.\n", animation, SCML_TO_CSTRING(name));
+        return false;
+    }
+
+    // The keys go into the arena with the rest of the document
+    Allocator_Scope arena_scope(&arena);
+    animation_ptr->deferred = -1;
+    if(!animation_ptr->loadKeys(elem))
+        return false;
+    entity_ptr->addVariableNames(animation_ptr);
+    add_tag_names(tag_names, animation_ptr);
+    return true;
+}
+
+Pose_Cache* Data::getPoseCache()
+{
+    if(pose_cache == NULL)
+        pose_cache = new Pose_Cache(this);
+    return pose_cache;
+}
+
+int Data::preloadAnimations(const char* const* animationNames, int numNames)
+{
+    int result = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(entities, int, Entity*, entity_ptr)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(entity_ptr->animations, int, Entity::Animation*, animation_ptr)
+        {
+            for(int i = 0; i < numNames; i++)
+            {
+                if(strcmp(SCML_TO_CSTRING(animation_ptr->name), animationNames[i]) == 0)
+                {
+                    if(loadAnimation(entity_ptr->id, animation_ptr->id))
+                        result++;
+                    break;
+                }
+            }
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    return result;
+}
+
 
 
 
@@ -897,6 +1746,8 @@ bool Data::Entity::load(TiXmlElement* elem)
                 SCML::log("SCML::Data::Entity loaded an animation with a duplicate id (%d).\n", animation->id);
                 delete animation;
             }
+            else
+                addVariableNames(animation);
         }
         else
         {
@@ -905,6 +1756,26 @@ bool Data::Entity::load(TiXmlElement* elem)
         }
     }
 
+    for(TiXmlElement* child = elem->FirstChildElement("character_map"); child != NULL; child = child->NextSiblingElement("character_map"))
+    {
+        Character_Map* character_map = new Character_Map;
+        if(character_map->load(child))
+        {
+            if(!SCML_MAP_INSERT(character_maps, character_map->id, character_map))
+            {
+                SCML::log("SCML::Data::Entity loaded a character_map with a duplicate id (%d).\n", character_map->id);
+                delete character_map;
+            }
+            else
+                character_map_names.insert(SCML_TO_CSTRING(character_map->name), character_map->id);
+        }
+        else
+        {
+            SCML::log("SCML::Data::Entity failed to load a character_map.\n");
+            delete character_map;
+        }
+    }
+
     return true;
 }
 
@@ -929,6 +1800,13 @@ void Data::Entity::log(int recursive_depth) const
     }
     SCML_END_MAP_FOREACH_CONST;
 
+    SCML_BEGIN_MAP_FOREACH_CONST(character_maps, int, Character_Map*, item)
+    {
+        SCML::logi(sLogDepth - recursive_depth, "Character_Map:\n");
+        item->log(recursive_depth - 1);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
 }
 
 void Data::Entity::clear()
@@ -937,6 +1815,7 @@ void Data::Entity::clear()
     name.clear();
     delete meta_data;
     meta_data = NULL;
+    lod_policy = LOD_Policy();
 
     SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
     {
@@ -944,6 +1823,52 @@ void Data::Entity::clear()
     }
     SCML_END_MAP_FOREACH_CONST;
     animations.clear();
+
+    SCML_BEGIN_MAP_FOREACH_CONST(character_maps, int, Character_Map*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    character_maps.clear();
+    character_map_names.clear();
+    variable_names.clear();
+}
+
+Data::Character_Map* Data::Entity::getCharacterMap(const char* characterMapName) const
+{
+    int id = character_map_names.find(characterMapName);
+    if(id < 0)
+        return NULL;
+    return SCML_MAP_FIND(character_maps, id);
+}
+
+// The variables of a timeline key: those of the key itself, or else those of its bone or object
+static const Data::Meta_Data_Tweenable* get_key_variables(const Data::Entity::Animation::Timeline::Key* key)
+{
+    if(key->meta_data != NULL)
+        return key->meta_data;
+    return (key->has_object? key->object.meta_data : key->bone.meta_data);
+}
+
+void Data::Entity::addVariableNames(const Animation* animation)
+{
+    SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, Animation::Timeline*, timeline)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(timeline->keys, int, Animation::Timeline::Key*, key)
+        {
+            const Meta_Data_Tweenable* variables = get_key_variables(key);
+            if(variables == NULL)
+                continue;
+            SCML_BEGIN_MAP_FOREACH_CONST(variables->variables, SCML_STRING, Meta_Data_Tweenable::Variable*, variable)
+            {
+                if(variable_names.find(SCML_TO_CSTRING(variable->name)) < 0)
+                    variable_names.insert(SCML_TO_CSTRING(variable->name), variable_names.size());
+            }
+            SCML_END_MAP_FOREACH_CONST;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
 }
 
 
@@ -955,15 +1880,38 @@ void Data::Entity::clear()
 
 
 Data::Entity::Animation::Animation()
-    : id(0), length(0), looping("true"), loop_to(0), meta_data(NULL)
+    : id(0), length(0), looping("true"), loop_to(0), deferred(-1), meta_data(NULL)
 {}
 
 Data::Entity::Animation::Animation(TiXmlElement* elem)
-    : id(0), length(0), looping("true"), loop_to(0), meta_data(NULL)
+    : id(0), length(0), looping("true"), loop_to(0), deferred(-1), meta_data(NULL)
 {
     load(elem);
 }
 
+// Loads the eventlines or soundlines of an animation.  They are timelines whose keys trigger something, so they are loaded as timelines of that object_type.
+static void load_trigger_lines(TiXmlElement* elem, const char* element_name, const char* object_type, SCML_MAP(int, Data::Entity::Animation::Timeline*)& lines)
+{
+    for(TiXmlElement* child = elem->FirstChildElement(element_name); child != NULL; child = child->NextSiblingElement(element_name))
+    {
+        Data::Entity::Animation::Timeline* line = new Data::Entity::Animation::Timeline;
+        if(line->load(child))
+        {
+            line->object_type = object_type;
+            if(!SCML_MAP_INSERT(lines, line->id, line))
+            {
+                SCML::log("SCML::Data::Entity::Animation loaded a %s with a duplicate id (%d).\n", element_name, line->id);
+                delete line;
+            }
+        }
+        else
+        {
+            SCML::log("SCML::Data::Entity::Animation failed to load a %s.\n", element_name);
+            delete line;
+        }
+    }
+}
+
 bool Data::Entity::Animation::load(TiXmlElement* elem)
 {
     this->id = xmlGetIntAttr(elem, "id", 0);
@@ -972,6 +1920,16 @@ bool Data::Entity::Animation::load(TiXmlElement* elem)
     looping = xmlGetStringAttr(elem, "looping", "true");
     loop_to = xmlGetIntAttr(elem, "loop_to", 0);
 
+    // See Data::defer_animations
+    deferred = xmlGetIntAttr(elem, "scmlpp_deferred", -1);
+    if(deferred >= 0)
+        return true;
+
+    return loadKeys(elem);
+}
+
+bool Data::Entity::Animation::loadKeys(TiXmlElement* elem)
+{
     TiXmlElement* meta_data_child = elem->FirstChildElement("meta_data");
     if(meta_data_child != NULL)
     {
@@ -1005,6 +1963,9 @@ bool Data::Entity::Animation::load(TiXmlElement* elem)
         }
     }
 
+    load_trigger_lines(elem, "eventline", "event", eventlines);
+    load_trigger_lines(elem, "soundline", "sound", soundlines);
+
     return true;
 }
 
@@ -1035,6 +1996,20 @@ void Data::Entity::Animation::log(int recursive_depth) const
     }
     SCML_END_MAP_FOREACH_CONST;
 
+    SCML_BEGIN_MAP_FOREACH_CONST(eventlines, int, Timeline*, item)
+    {
+        SCML::logi(sLogDepth - recursive_depth, "Eventline:\n");
+        item->log(recursive_depth - 1);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(soundlines, int, Timeline*, item)
+    {
+        SCML::logi(sLogDepth - recursive_depth, "Soundline:\n");
+        item->log(recursive_depth - 1);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
 }
 
 Data::Entity::Animation::~Animation(){
@@ -1048,6 +2023,7 @@ void Data::Entity::Animation::clear()
     length = 0;
     looping = "true";
     loop_to = 0;
+    deferred = -1;
 
     delete meta_data;
     meta_data = NULL;
@@ -1060,6 +2036,20 @@ void Data::Entity::Animation::clear()
     }
     SCML_END_MAP_FOREACH_CONST;
     timelines.clear();
+
+    SCML_BEGIN_MAP_FOREACH_CONST(eventlines, int, Timeline*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    eventlines.clear();
+
+    SCML_BEGIN_MAP_FOREACH_CONST(soundlines, int, Timeline*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    soundlines.clear();
 }
 
 
@@ -1940,6 +2930,24 @@ bool Data::Meta_Data_Tweenable::load(TiXmlElement* elem)
         }
     }
 
+    for(TiXmlElement* child = elem->FirstChildElement("tag"); child != NULL; child = child->NextSiblingElement("tag"))
+    {
+        Tag* tag = new Tag;
+        if(tag->load(child))
+        {
+            if(!SCML_MAP_INSERT(tags, tag->name, tag))
+            {
+                SCML::log("SCML::Data::Meta_Data_Tweenable loaded a tag with a duplicate name (%s).\n", SCML_TO_CSTRING(tag->name));
+                delete tag;
+            }
+        }
+        else
+        {
+            SCML::log("SCML::Data::Meta_Data_Tweenable failed to load a tag.\n");
+            delete tag;
+        }
+    }
+
     return true;
 }
 
@@ -1955,6 +2963,13 @@ void Data::Meta_Data_Tweenable::log(int recursive_depth) const
     }
     SCML_END_MAP_FOREACH_CONST;
 
+    SCML_BEGIN_MAP_FOREACH_CONST(tags, SCML_STRING, Tag*, item)
+    {
+        SCML::logi(sLogDepth - recursive_depth, "Tag:\n");
+        item->log(recursive_depth - 1);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
 }
 
 void Data::Meta_Data_Tweenable::clear()
@@ -1965,6 +2980,13 @@ void Data::Meta_Data_Tweenable::clear()
     }
     SCML_END_MAP_FOREACH_CONST;
     variables.clear();
+
+    SCML_BEGIN_MAP_FOREACH_CONST(tags, SCML_STRING, Tag*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    tags.clear();
 }
 
 
@@ -1986,6 +3008,7 @@ Data::Meta_Data_Tweenable::Variable::Variable(TiXmlElement* elem)
 
 bool Data::Meta_Data_Tweenable::Variable::load(TiXmlElement* elem)
 {
+    name = xmlGetStringAttr(elem, "name", "");
     type = xmlGetStringAttr(elem, "type", "string");
     if(type == "string")
         value_string = xmlGetStringAttr(elem, "value", "");
@@ -2003,6 +3026,7 @@ bool Data::Meta_Data_Tweenable::Variable::load(TiXmlElement* elem)
 
 void Data::Meta_Data_Tweenable::Variable::log(int recursive_depth) const
 {
+    SCML::logi(sLogDepth - recursive_depth, "name=%s\n", SCML_TO_CSTRING(name));
     SCML::logi(sLogDepth - recursive_depth, "type=%s\n", SCML_TO_CSTRING(type));
     if(type == "string")
         SCML::logi(sLogDepth - recursive_depth, "value=%s\n", SCML_TO_CSTRING(value_string));
@@ -2019,6 +3043,7 @@ void Data::Meta_Data_Tweenable::Variable::log(int recursive_depth) const
 
 void Data::Meta_Data_Tweenable::Variable::clear()
 {
+    name.clear();
     type = "string";
     value_string.clear();
     value_int = 0;
@@ -2032,6 +3057,34 @@ void Data::Meta_Data_Tweenable::Variable::clear()
 
 
 
+Data::Meta_Data_Tweenable::Tag::Tag()
+{}
+
+Data::Meta_Data_Tweenable::Tag::Tag(TiXmlElement* elem)
+{
+    load(elem);
+}
+
+bool Data::Meta_Data_Tweenable::Tag::load(TiXmlElement* elem)
+{
+    name = xmlGetStringAttr(elem, "name", "");
+
+    return true;
+}
+
+void Data::Meta_Data_Tweenable::Tag::log(int recursive_depth) const
+{
+    SCML::logi(sLogDepth - recursive_depth, "name=%s\n", SCML_TO_CSTRING(name));
+}
+
+void Data::Meta_Data_Tweenable::Tag::clear()
+{
+    name.clear();
+}
+
+
+
+
 
 
 
@@ -2116,11 +3169,11 @@ void Data::Entity::Animation::Timeline::Key::Bone::clear()
 
 
 Data::Entity::Animation::Timeline::Key::Object::Object()
-    : atlas(0), folder(0), file(0), x(0.0f), y(0.0f), pivot_x(0.0f), pivot_y(1.0f), angle(0.0f), w(0.0f), h(0.0f), scale_x(1.0f), scale_y(1.0f), r(1.0f), g(1.0f), b(1.0f), a(1.0f), blend_mode("alpha"), value_int(0), min_int(0), max_int(0), value_float(0.0f), min_float(0.0f), max_float(0.0f), animation(0), t(0.0f), volume(1.0f), panning(0.0f), meta_data(NULL)
+    : atlas(0), folder(0), file(0), x(0.0f), y(0.0f), pivot_x(0.0f), pivot_y(1.0f), angle(0.0f), w(0.0f), h(0.0f), scale_x(1.0f), scale_y(1.0f), r(1.0f), g(1.0f), b(1.0f), a(1.0f), blend_mode("alpha"), value_int(0), min_int(0), max_int(0), value_float(0.0f), min_float(0.0f), max_float(0.0f), entity(-1), animation(0), t(0.0f), volume(1.0f), panning(0.0f), meta_data(NULL)
 {}
 
 Data::Entity::Animation::Timeline::Key::Object::Object(TiXmlElement* elem)
-    : atlas(0), folder(0), file(0), x(0.0f), y(0.0f), pivot_x(0.0f), pivot_y(1.0f), angle(0.0f), w(0.0f), h(0.0f), scale_x(1.0f), scale_y(1.0f), r(1.0f), g(1.0f), b(1.0f), a(1.0f), blend_mode("alpha"), value_int(0), min_int(0), max_int(0), value_float(0.0f), min_float(0.0f), max_float(0.0f), animation(0), t(0.0f), volume(1.0f), panning(0.0f), meta_data(NULL)
+    : atlas(0), folder(0), file(0), x(0.0f), y(0.0f), pivot_x(0.0f), pivot_y(1.0f), angle(0.0f), w(0.0f), h(0.0f), scale_x(1.0f), scale_y(1.0f), r(1.0f), g(1.0f), b(1.0f), a(1.0f), blend_mode("alpha"), value_int(0), min_int(0), max_int(0), value_float(0.0f), min_float(0.0f), max_float(0.0f), entity(-1), animation(0), t(0.0f), volume(1.0f), panning(0.0f), meta_data(NULL)
 {
     load(elem);
 }
@@ -2164,6 +3217,7 @@ bool Data::Entity::Animation::Timeline::Key::Object::load(TiXmlElement* elem)
         max_float = xmlGetFloatAttr(elem, "max", 0.0f);
     }
 
+    entity = xmlGetIntAttr(elem, "entity", -1);
     animation = xmlGetIntAttr(elem, "animation", 0);
     t = xmlGetFloatAttr(elem, "t", 0.0f);
     //if(object_type == "sound")
@@ -2222,6 +3276,7 @@ void Data::Entity::Animation::Timeline::Key::Object::log(int recursive_depth) co
         SCML::logi(sLogDepth - recursive_depth, "min=%f\n", min_float);
         SCML::logi(sLogDepth - recursive_depth, "max=%f\n", max_float);
     }*/
+    SCML::logi(sLogDepth - recursive_depth, "entity=%d\n", entity);
     SCML::logi(sLogDepth - recursive_depth, "animation=%d\n", animation);
     SCML::logi(sLogDepth - recursive_depth, "t=%f\n", t);
     //if(object_type == "sound")
@@ -2270,6 +3325,7 @@ void Data::Entity::Animation::Timeline::Key::Object::clear()
     min_float = 0.0f;
     max_int = 0;
     max_float = 0.0f;
+    entity = -1;
     animation = 0;
     t = 0.0f;
     volume = 1.0f;
@@ -2299,10 +3355,17 @@ bool Data::Character_Map::load(TiXmlElement* elem)
     this->id = xmlGetIntAttr(elem, "id", 0);
     name = xmlGetStringAttr(elem, "name", "");
 
-    TiXmlElement* child = elem->FirstChildElement("map");
-    if(child == NULL || !map.load(child))
+    for(TiXmlElement* child = elem->FirstChildElement("map"); child != NULL; child = child->NextSiblingElement("map"))
     {
-        SCML::log("SCML::Data::Entity failed to load an animation.\n");
+        Map map;
+        if(map.load(child))
+        {
+            int n = SCML_VECTOR_SIZE(maps);
+            SCML_VECTOR_RESIZE(maps, n + 1);
+            maps[n] = map;
+        }
+        else
+            SCML::log("SCML::Data::Character_Map failed to load a map.\n");
     }
 
     return true;
@@ -2316,9 +3379,12 @@ void Data::Character_Map::log(int recursive_depth) const
     if(recursive_depth == 0)
         return;
 
-    SCML::logi(sLogDepth - recursive_depth, "Map:\n");
-    map.log(recursive_depth - 1);
-
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(maps); i++)
+    {
+        SCML::logi(sLogDepth - recursive_depth, "Map:\n");
+        maps[i].log(recursive_depth - 1);
+    }
+
 }
 
 void Data::Character_Map::clear()
@@ -2326,7 +3392,7 @@ void Data::Character_Map::clear()
     this->id = 0;
     name.clear();
 
-    map.clear();
+    SCML_VECTOR_CLEAR(maps);
 }
 
 
@@ -2336,11 +3402,11 @@ void Data::Character_Map::clear()
 
 
 Data::Character_Map::Map::Map()
-    : atlas(0), folder(0), file(0), target_atlas(0), target_folder(0), target_file(0)
+    : atlas(0), folder(0), file(0), target_atlas(0), target_folder(-1), target_file(-1)
 {}
 
 Data::Character_Map::Map::Map(TiXmlElement* elem)
-    : atlas(0), folder(0), file(0), target_atlas(0), target_folder(0), target_file(0)
+    : atlas(0), folder(0), file(0), target_atlas(0), target_folder(-1), target_file(-1)
 {
     load(elem);
 }
@@ -2351,8 +3417,9 @@ bool Data::Character_Map::Map::load(TiXmlElement* elem)
     folder = xmlGetIntAttr(elem, "folder", 0);
     file = xmlGetIntAttr(elem, "file", 0);
     target_atlas = xmlGetIntAttr(elem, "target_atlas", 0);
-    target_folder = xmlGetIntAttr(elem, "target_folder", 0);
-    target_file = xmlGetIntAttr(elem, "target_file", 0);
+    // A map without a target hides the image
+    target_folder = xmlGetIntAttr(elem, "target_folder", -1);
+    target_file = xmlGetIntAttr(elem, "target_file", -1);
 
     return true;
 }
@@ -2373,8 +3440,8 @@ void Data::Character_Map::Map::clear()
     folder = 0;
     file = 0;
     target_atlas = 0;
-    target_folder = 0;
-    target_file = 0;
+    target_folder = -1;
+    target_file = -1;
 }
 
 
@@ -2449,8 +3516,14 @@ static bool pathIsAbsolute(const SCML_STRING& path)
 }
 
 
+FileSystem::FileSystem()
+    : registry(NULL)
+{}
+
 void FileSystem::load(SCML::Data* data)
 {
+    SCML_PROFILE_ZONE("FileSystem::load", data);
+
     if(data == NULL || SCML_STRING_SIZE(data->name) == 0)
         return;
 
@@ -2485,306 +3558,2288 @@ void FileSystem::load(SCML::Data* data)
 
 
 
+Asset_Stats::Asset_Stats()
+    : hits(0), misses(0), bytes_saved(0), num_data(0), num_images(0)
+{}
 
-Entity::Entity()
-    : entity(-1), animation(-1), key(-1), time(0)
+Asset_Registry::Asset::Asset()
+    : object(NULL), is_data(false), free_image(NULL), width(0), height(0), bytes(0), references(1), contents(0, 0)
 {}
 
-Entity::Entity(SCML::Data* data, int entity, int animation, int key)
-    : entity(entity), animation(animation), key(key), time(0)
+Asset_Registry::Asset_Registry()
+    : m_missed_contents(0, 0)
+{}
+
+Asset_Registry::~Asset_Registry()
 {
-    load(data);
+    SCML_BEGIN_MAP_FOREACH_CONST(m_objects, void*, Asset*, asset)
+    {
+        if(asset->is_data)
+            delete static_cast<Data*>(asset->object);
+        else if(asset->free_image != NULL)
+            asset->free_image(asset->object);
+        delete asset;
+    }
+    SCML_END_MAP_FOREACH_CONST;
 }
 
-Entity::Entity(SCML::Data* data, const char* entityName, int animation, int key)
-    : entity(-1), animation(animation), key(key), time(0)
+// Resolves relative paths, "..", and links, so that a file has one name.  Falls back to the path as given.
+static SCML_STRING canonical_path(const char* file)
 {
-    load(data);
-    SCML_BEGIN_MAP_FOREACH_CONST(data->entities, int, SCML::Data::Entity*, entity_ptr)
+    char buf[PATH_MAX];
+#if defined(_MSC_VER) && !defined(MARMALADE)
+    if(_fullpath(buf, file, PATH_MAX) != NULL)
+        return buf;
+#elif !defined(MARMALADE)
+    if(realpath(file, buf) != NULL)
+        return buf;
+#endif
+    return file;
+}
+
+// The hash and size of a file's contents (text ends with an extra '\0').  With in_directory, the directory of path is hashed too.
+static SCML_PAIR(unsigned int, unsigned int) hash_contents(const SCML_VECTOR(char)& text, const SCML_STRING& path, bool in_directory)
+{
+    unsigned int size = SCML_VECTOR_SIZE(text) - 1;
+    unsigned int result = 2166136261u;
+    for(unsigned int i = 0; i < size; i++)
+    {
+        result ^= (unsigned char)text[i];
+        result *= 16777619u;
+    }
+
+    if(in_directory)
     {
-    	if (std::strcmp( entity_ptr->name.c_str(), entityName ) == 0)
-    	{
-    		entity = entity_ptr->id;
-    		break;
-    	}
+        const char* p = SCML_TO_CSTRING(path);
+        const char* end = strrchr(p, '/');
+        const char* back = strrchr(p, '\\');
+        if(back != NULL && (end == NULL || back > end))
+            end = back;
+        for(; end != NULL && p < end; p++)
+        {
+            result ^= (unsigned char)*p;
+            result *= 16777619u;
+        }
     }
-	SCML_END_MAP_FOREACH_CONST;
+    return SCML_MAKE_PAIR(result, size);
 }
 
-Entity::~Entity()
+Asset_Registry::Asset* Asset_Registry::find(const SCML_STRING& path, const SCML_PAIR(unsigned int, unsigned int)& contents)
 {
-    clear();
+    Asset* asset = SCML_MAP_FIND(m_contents, contents);
+    if(asset != NULL)
+        insert(asset, path);
+    return asset;
 }
 
-void Entity::load(SCML::Data* data)
+void Asset_Registry::insert(Asset* asset, const SCML_STRING& path)
 {
-    if(data == NULL)
+    if(!SCML_MAP_INSERT(m_paths, path, asset))
         return;
+    int n = SCML_VECTOR_SIZE(asset->paths);
+    SCML_VECTOR_RESIZE(asset->paths, n + 1);
+    asset->paths[n] = path;
+}
 
-    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(data->entities, entity);
-    if(entity_ptr == NULL)
+Data* Asset_Registry::acquireData(const char* file)
+{
+    SCML_PROFILE_ZONE("Asset_Registry::acquireData", this);
+
+    SCML_STRING path = canonical_path(file);
+    SCML_VECTOR(char) text;
+    SCML_PAIR(unsigned int, unsigned int) contents(0, 0);
+
+    Asset* asset = SCML_MAP_FIND(m_paths, path);
+    if(asset == NULL)
+    {
+        if(!read_text_file(SCML_TO_CSTRING(path), 0, -1, text))
+        {
+            SCML::log("SCML::Asset_Registry failed to load: Couldn't open %s.\n", file);
+            return NULL;
+        }
+        contents = hash_contents(text, path, true);
+        asset = find(path, contents);
+    }
+
+    if(asset != NULL)
+    {
+        if(!asset->is_data)
+        {
+            SCML::log("SCML::Asset_Registry failed to load: %s is an image.\n", file);
+            return NULL;
+        }
+        asset->references++;
+        m_stats.hits++;
+        m_stats.bytes_saved += asset->bytes;
+        return static_cast<Data*>(asset->object);
+    }
+
+    m_stats.misses++;
+    Data* data = new Data;
+    data->name = file;
+    if(!data->fromTextData(&text[0]))
+    {
+        delete data;
+        return NULL;
+    }
+
+    asset = new Asset;
+    asset->object = data;
+    asset->is_data = true;
+    asset->bytes = data->arena.getBytesUsed();
+    asset->contents = contents;
+    insert(asset, path);
+    SCML_MAP_INSERT_ONLY(m_contents, contents, asset);
+    SCML_MAP_INSERT_ONLY(m_objects, asset->object, asset);
+    m_stats.num_data++;
+    return data;
+}
+
+void Asset_Registry::releaseData(Data* data)
+{
+    release(data);
+}
+
+void* Asset_Registry::acquireImage(const char* file, unsigned int* width, unsigned int* height)
+{
+    SCML_STRING path = canonical_path(file);
+
+    Asset* asset = SCML_MAP_FIND(m_paths, path);
+    if(asset == NULL)
+    {
+        // Hashed here so that a copy of the image is found, and kept for addImage()
+        SCML_VECTOR(char) text;
+        m_missed_path = path;
+        m_missed_contents = SCML_MAKE_PAIR(0u, 0u);
+        if(read_text_file(SCML_TO_CSTRING(path), 0, -1, text))
+        {
+            m_missed_contents = hash_contents(text, path, false);
+            asset = find(path, m_missed_contents);
+        }
+    }
+
+    if(asset == NULL || asset->is_data)
+    {
+        m_stats.misses++;
+        return NULL;
+    }
+
+    asset->references++;
+    m_stats.hits++;
+    m_stats.bytes_saved += asset->bytes;
+    if(width != NULL)
+        *width = asset->width;
+    if(height != NULL)
+        *height = asset->height;
+    return asset->object;
+}
+
+void Asset_Registry::addImage(const char* file, void* image, unsigned int width, unsigned int height, Free_Image free_image)
+{
+    if(image == NULL)
+        return;
+    if(SCML_MAP_FIND(m_objects, image) != NULL)
+    {
+        SCML::log("SCML::Asset_Registry was given an image twice (%s).\n", file);
         return;
+    }
 
-    name = entity_ptr->name;
+    Asset* asset = new Asset;
+    asset->object = image;
+    asset->free_image = free_image;
+    asset->width = width;
+    asset->height = height;
+    asset->bytes = 4ul*width*height;
 
-    SCML_BEGIN_MAP_FOREACH_CONST(entity_ptr->animations, int, SCML::Data::Entity::Animation*, item)
+    SCML_STRING path = canonical_path(file);
+    if(path == m_missed_path)
+        asset->contents = m_missed_contents;
+    else
     {
-        SCML_MAP_INSERT_ONLY(animations, item->id, new Animation(item));
+        SCML_VECTOR(char) text;
+        if(read_text_file(SCML_TO_CSTRING(path), 0, -1, text))
+            asset->contents = hash_contents(text, path, false);
     }
-    SCML_END_MAP_FOREACH_CONST;
 
-    // Need to keep track of initial pivots
-    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, iFolder)
+    insert(asset, path);
+    if(SCML_PAIR_SECOND(asset->contents) > 0)
+        SCML_MAP_INSERT_ONLY(m_contents, asset->contents, asset);
+    SCML_MAP_INSERT_ONLY(m_objects, image, asset);
+    m_stats.num_images++;
+}
+
+void Asset_Registry::releaseImage(void* image)
+{
+    release(image);
+}
+
+void Asset_Registry::release(void* object)
+{
+    Asset* asset = SCML_MAP_FIND(m_objects, object);
+    if(asset == NULL)
     {
-        SCML_BEGIN_MAP_FOREACH_CONST(iFolder->files, int, SCML::Data::Folder::File*, iFile)
+        SCML::log("SCML::Asset_Registry can't release an asset that it doesn't hold.\n");
+        return;
+    }
+    if(--asset->references > 0)
+        return;
+
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(asset->paths); i++)
+        SCML_MAP_ERASE(m_paths, asset->paths[i]);
+    if(SCML_MAP_FIND(m_contents, asset->contents) == asset)
+        SCML_MAP_ERASE(m_contents, asset->contents);
+    SCML_MAP_ERASE(m_objects, object);
+
+    if(asset->is_data)
+    {
+        m_stats.num_data--;
+        delete static_cast<Data*>(object);
+    }
+    else
+    {
+        m_stats.num_images--;
+        if(asset->free_image != NULL)
+            asset->free_image(object);
+    }
+    delete asset;
+}
+
+const Asset_Stats& Asset_Registry::getStats() const
+{
+    return m_stats;
+}
+
+Asset_Registry& getAssetRegistry()
+{
+    static Asset_Registry registry;
+    return registry;
+}
+
+
+
+
+
+
+
+LOD_Policy::LOD_Policy()
+    : reduced_rate_scale(0.0f), reduced_rate_interval(1), snap_scale(0.0f), min_pixel_size(0.0f)
+{}
+
+LOD_Policy::LOD_Policy(float reduced_rate_scale, int reduced_rate_interval, float snap_scale, float min_pixel_size)
+    : reduced_rate_scale(reduced_rate_scale), reduced_rate_interval(reduced_rate_interval), snap_scale(snap_scale), min_pixel_size(min_pixel_size)
+{}
+
+int LOD_Policy::getLevel(float projected_scale) const
+{
+    projected_scale = fabs(projected_scale);
+    if(projected_scale < snap_scale)
+        return Entity::LOD_SNAP_TO_KEY;
+    if(projected_scale < reduced_rate_scale)
+        return Entity::LOD_REDUCED_RATE;
+    return Entity::LOD_FULL;
+}
+
+
+
+Name_Table::Name_Table()
+    : slots(NULL), num_slots(0), num_names(0)
+{}
+
+Name_Table::~Name_Table()
+{
+    clear();
+}
+
+// FNV-1a
+unsigned int Name_Table::hash(const char* name)
+{
+    unsigned int result = 2166136261u;
+    for(; *name != '\0'; name++)
+    {
+        result ^= (unsigned char)*name;
+        result *= 16777619u;
+    }
+    return result;
+}
+
+bool Name_Table::insert(const char* name, int id)
+{
+    if(name == NULL)
+        return false;
+
+    // Keep the table at most half full so that probes stay short
+    if(2*(num_names + 1) > (int)num_slots)
+        rehash(num_slots > 0? 2*num_slots : 16);
+
+    unsigned int h = hash(name);
+    unsigned int mask = num_slots - 1;
+    for(unsigned int i = h & mask; ; i = (i + 1) & mask)
+    {
+        Slot& slot = slots[i];
+        if(slot.name == NULL)
         {
-            FolderFile_t folderFile = FolderFile_t(iFolder->id, iFile->id);
-            Pivot_t pivot = Pivot_t(iFile->pivot_x, iFile->pivot_y);
-            SCML_MAP_INSERT_ONLY(m_pivots, folderFile, pivot);
+            slot.hash = h;
+            slot.id = id;
+            slot.name = name;
+            num_names++;
+            return true;
         }
-        SCML_END_MAP_FOREACH_CONST;
+        if(slot.hash == h && strcmp(slot.name, name) == 0)
+            return false;
     }
-    SCML_END_MAP_FOREACH_CONST;
 }
 
-void Entity::clear()
+int Name_Table::find(const char* name) const
 {
-    entity = -1;
-    animation = -1;
-    key = -1;
-    time = 0;
+    if(name == NULL || num_names == 0)
+        return -1;
+
+    unsigned int h = hash(name);
+    unsigned int mask = num_slots - 1;
+    for(unsigned int i = h & mask; slots[i].name != NULL; i = (i + 1) & mask)
+    {
+        if(slots[i].hash == h && strcmp(slots[i].name, name) == 0)
+            return slots[i].id;
+    }
+    return -1;
+}
+
+int Name_Table::size() const
+{
+    return num_names;
+}
+
+void Name_Table::clear()
+{
+    SCML::deallocate(slots);
+    slots = NULL;
+    num_slots = 0;
+    num_names = 0;
+}
+
+void Name_Table::rehash(unsigned int new_num_slots)
+{
+    Slot* new_slots = static_cast<Slot*>(SCML::allocate(new_num_slots * sizeof(Slot)));
+    if(new_slots == NULL)
+        throw std::bad_alloc();
+    for(unsigned int i = 0; i < new_num_slots; i++)
+        new_slots[i].name = NULL;
+
+    unsigned int mask = new_num_slots - 1;
+    for(unsigned int i = 0; i < num_slots; i++)
+    {
+        if(slots[i].name == NULL)
+            continue;
+        unsigned int j = slots[i].hash & mask;
+        while(new_slots[j].name != NULL)
+            j = (j + 1) & mask;
+        new_slots[j] = slots[i];
+    }
+
+    SCML::deallocate(slots);
+    slots = new_slots;
+    num_slots = new_num_slots;
+}
+
+
+
+
+Tag_Set::Tag_Set()
+{
+    clear();
+}
+
+void Tag_Set::add(int handle)
+{
+    if(handle >= 0 && handle < MAX_TAGS)
+        bits[handle/32] |= (1u << (handle%32));
+}
+
+bool Tag_Set::has(int handle) const
+{
+    if(handle < 0 || handle >= MAX_TAGS)
+        return false;
+    return (bits[handle/32] & (1u << (handle%32))) != 0;
+}
+
+bool Tag_Set::hasAll(const Tag_Set& tags) const
+{
+    for(int i = 0; i < MAX_TAGS/32; i++)
+    {
+        if((bits[i] & tags.bits[i]) != tags.bits[i])
+            return false;
+    }
+    return true;
+}
+
+bool Tag_Set::hasAny(const Tag_Set& tags) const
+{
+    for(int i = 0; i < MAX_TAGS/32; i++)
+    {
+        if((bits[i] & tags.bits[i]) != 0)
+            return true;
+    }
+    return false;
+}
+
+bool Tag_Set::empty() const
+{
+    for(int i = 0; i < MAX_TAGS/32; i++)
+    {
+        if(bits[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+void Tag_Set::clear()
+{
+    for(int i = 0; i < MAX_TAGS/32; i++)
+        bits[i] = 0;
+}
+
+Tag_Set& Tag_Set::operator|=(const Tag_Set& tags)
+{
+    for(int i = 0; i < MAX_TAGS/32; i++)
+        bits[i] |= tags.bits[i];
+    return *this;
+}
+
+bool Tag_Set::operator==(const Tag_Set& tags) const
+{
+    for(int i = 0; i < MAX_TAGS/32; i++)
+    {
+        if(bits[i] != tags.bits[i])
+            return false;
+    }
+    return true;
+}
+
+
+
+
+// A whole turn and half of one in 16.16 degrees
+static const Fixed sFixedTurn = 360*65536;
+static const Fixed sFixedHalfTurn = 180*65536;
+
+// The crossfade channel of a timeline, or -1
+static int get_channel(const Entity::Animation* animation_ptr, int timeline)
+{
+    if(timeline < 0 || timeline >= (int)SCML_VECTOR_SIZE(animation_ptr->timeline_channels))
+        return -1;
+    return animation_ptr->timeline_channels[timeline];
+}
+
+// Finds the keys of a timeline to tween between.  key2 is key1 at the end of the timeline.
+static bool get_tween_keys(const Entity::Animation* animation_ptr, int timeline, int key, Entity::Animation::Timeline::Sample& key1, Entity::Animation::Timeline::Sample& key2)
+{
+    Entity::Animation::Timeline* timeline_ptr = SCML_MAP_FIND(animation_ptr->timelines, timeline);
+    if(timeline_ptr == NULL)
+        return false;
+
+    // Only the last key needs to know whether to wrap around
+    bool looping = (key+1 >= timeline_ptr->getNumKeys() && animation_ptr->looping == "true");
+    if(!timeline_ptr->getSample(key, looping, key1))
+        return false;
+    if(!timeline_ptr->getSample(key+1, looping, key2))
+        key2 = key1;
+    return true;
+}
+
+// How far between the times of two keys the time is.  A second key before the first wraps around the end of the animation.
+// fixed_t, if given, gets t in 16.16 fixed point, worked out from the key times without floats.
+static void get_tween_time(int length, int time1, int time2, int time, float& t, Fixed* fixed_t)
+{
+    t = 0.0f;
+    if(time2 > time1)
+        t = (time - time1)/float(time2 - time1);
+    else if(time2 < time1)
+        t = (time - time1)/float(length - time1);
+
+    if(fixed_t != NULL)
+    {
+        int span = (time2 >= time1? time2 - time1 : length - time1);
+        *fixed_t = (span > 0? Fixed((long long)(time - time1) * 65536 / span) : 0);
+    }
+}
+
+// Finds the keys of a timeline to tween between and how far between them the time is.  key2 is key1 at the end of the timeline.
+// fixed_t, if given, gets t in 16.16 fixed point, worked out from the key times without floats.
+static bool get_tween(const Entity::Animation* animation_ptr, int timeline, int key, int time, Entity::Animation::Timeline::Sample& key1, Entity::Animation::Timeline::Sample& key2, float& t, Fixed* fixed_t = NULL)
+{
+    if(!get_tween_keys(animation_ptr, timeline, key, key1, key2))
+        return false;
+    get_tween_time(animation_ptr->length, key1.time, key2.time, time, t, fixed_t);
+    return true;
+}
+
+// Keeps the keys of a bone or object timeline for its channel, if it has keys to tween
+static void find_channel_keys(Entity::Pose_Keys& keys, const Entity::Animation* animation_ptr, int timeline, int key)
+{
+    int channel = get_channel(animation_ptr, timeline);
+    if(channel < 0 || channel >= (int)SCML_VECTOR_SIZE(keys.tweens))
+        return;
+
+    Entity::Animation::Timeline::Sample key1, key2;
+    if(!get_tween_keys(animation_ptr, timeline, key, key1, key2) || key1.has_object != key2.has_object)
+        return;
+
+    Entity::Pose_Keys::Tween& tween = keys.tweens[channel];
+    tween.from = key1.transform;
+    tween.to = key2.transform;
+    tween.from_time = key1.time;
+    tween.to_time = key2.time;
+    tween.spin = key1.spin;
+    tween.valid = true;
+}
+
+// Tweens a bone or object between the keys kept for its channel at the given time, in its parent's space
+static void get_local_transform(Transform& result, const Entity::Pose_Keys::Tween& tween, int length, int time, bool fixed_point)
+{
+    float t;
+    Fixed fixed_t;
+    get_tween_time(length, tween.from_time, tween.to_time, time, t, &fixed_t);
+
+    if(fixed_point)
+    {
+        Fixed_Transform fixed_result(tween.from);
+        if(fixed_t != 0)
+            fixed_result.lerp(Fixed_Transform(tween.to), fixed_t, tween.spin);
+        result = fixed_result.toTransform();
+        return;
+    }
+
+    result = tween.from;
+    if(t != 0.0f)
+        result.lerp(tween.to, t, tween.spin);
+}
+
+// Evaluates the local transforms of an animation by channel, for the channels in mask (all of them if mask is NULL).  keys
+// are from the last call, and the timelines are searched again only when the mainline key has changed.
+static bool evaluate_pose(Entity* entity_ptr, int animation, int key, int time, Entity::Pose_Keys& keys, SCML_VECTOR(Transform)& transforms, SCML_VECTOR(char)& channels, const SCML_VECTOR(char)* mask)
+{
+    Entity::Animation* animation_ptr = entity_ptr->getAnimation(animation);
+    int num_channels = entity_ptr->getNumChannels();
+    // Loading an animation can add channels
+    if(animation_ptr != NULL && (keys.animation != animation || keys.key != key || (int)SCML_VECTOR_SIZE(keys.tweens) != num_channels))
+    {
+        Entity::Animation::Mainline::Key* key_ptr = entity_ptr->getKey(animation, key);
+        keys.animation = (key_ptr != NULL? animation : -1);
+        keys.key = key;
+        SCML_VECTOR_RESIZE(keys.tweens, num_channels);
+        for(int i = 0; i < num_channels; i++)
+            keys.tweens[i].valid = false;
+
+        // Only the local transforms are needed: the parents come from the animation being blended into
+        if(key_ptr != NULL)
+        {
+            SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Entity::Animation::Mainline::Key::Bone_Container, item)
+            {
+                if(item.hasBone_Ref())
+                    find_channel_keys(keys, animation_ptr, item.bone_ref->timeline, item.bone_ref->key);
+            }
+            SCML_END_MAP_FOREACH_CONST;
+
+            SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->objects, int, Entity::Animation::Mainline::Key::Object_Container, item)
+            {
+                if(!item.hasObject())
+                    find_channel_keys(keys, animation_ptr, item.object_ref->timeline, item.object_ref->key);
+            }
+            SCML_END_MAP_FOREACH_CONST;
+        }
+    }
+    if(animation_ptr == NULL || keys.animation != animation)
+    {
+        SCML_VECTOR_CLEAR(channels);
+        return false;
+    }
+
+    SCML_VECTOR_RESIZE(transforms, num_channels);
+    SCML_VECTOR_RESIZE(channels, num_channels);
+    for(int i = 0; i < num_channels; i++)
+    {
+        const Entity::Pose_Keys::Tween& tween = keys.tweens[i];
+        channels[i] = (tween.valid && (mask == NULL || (*mask)[i]));
+        if(channels[i])
+            get_local_transform(transforms[i], tween, animation_ptr->length, time, entity_ptr->fixed_point);
+    }
+    return true;
+}
+
+// Blends a local transform toward another, turning the shortest way around
+static void blend_toward(Transform& local, const Transform& target, float weight)
+{
+    float delta = target.angle - local.angle;
+    int spin = (delta > 180.0f || (delta < 0.0f && delta >= -180.0f))? -1 : 1;
+    local.lerp(target, weight, spin);
+}
+
+static void blend_toward(Fixed_Transform& local, const Fixed_Transform& target, Fixed weight)
+{
+    Fixed delta = target.angle - local.angle;
+    int spin = (delta > sFixedHalfTurn || (delta < 0 && delta >= -sFixedHalfTurn))? -1 : 1;
+    local.lerp(target, weight, spin);
+}
+
+
+
+// Spreads the reduced-rate evaluations of a crowd across frames
+static int sLODStagger = 0;
+
+#ifdef SCML_FIXED_POINT
+static const bool sFixedPointDefault = true;
+#else
+static const bool sFixedPointDefault = false;
+#endif
+
+Entity::Entity()
+    : entity(-1), animation(-1), key(-1), time(0), lod_level(LOD_FULL), fixed_point(sFixedPointDefault), auto_sleep(false), sleeps(0), wakes(0), hold_pose(false), affine_output(false), retained_output(false), m_num_channels(0), m_data(NULL), m_trigger_buffer(NULL), m_trigger_capacity(0), m_num_triggers(0), m_lod_frame(sLODStagger++), m_lod_pending_ms(0), m_recording_views(false)
+    , m_asleep(false), m_sleep_cached(false), m_sleep_drawn(false), m_sleep_animation(-1), m_sleep_key(-1), m_sleep_time(-1), m_sleep_lod_level(LOD_FULL), m_sleep_fixed_point(false), m_pose_kept(false)
+{}
+
+Entity::Entity(SCML::Data* data, int entity, int animation, int key)
+    : entity(entity), animation(animation), key(key), time(0), lod_level(LOD_FULL), fixed_point(sFixedPointDefault), auto_sleep(false), sleeps(0), wakes(0), hold_pose(false), affine_output(false), retained_output(false), m_num_channels(0), m_data(NULL), m_trigger_buffer(NULL), m_trigger_capacity(0), m_num_triggers(0), m_lod_frame(sLODStagger++), m_lod_pending_ms(0), m_recording_views(false)
+    , m_asleep(false), m_sleep_cached(false), m_sleep_drawn(false), m_sleep_animation(-1), m_sleep_key(-1), m_sleep_time(-1), m_sleep_lod_level(LOD_FULL), m_sleep_fixed_point(false), m_pose_kept(false)
+{
+    load(data);
+}
+
+Entity::Entity(SCML::Data* data, const char* entityName, int animation, int key)
+    : entity(-1), animation(animation), key(key), time(0), lod_level(LOD_FULL), fixed_point(sFixedPointDefault), auto_sleep(false), sleeps(0), wakes(0), hold_pose(false), affine_output(false), retained_output(false), m_num_channels(0), m_data(NULL), m_trigger_buffer(NULL), m_trigger_capacity(0), m_num_triggers(0), m_lod_frame(sLODStagger++), m_lod_pending_ms(0), m_recording_views(false)
+    , m_asleep(false), m_sleep_cached(false), m_sleep_drawn(false), m_sleep_animation(-1), m_sleep_key(-1), m_sleep_time(-1), m_sleep_lod_level(LOD_FULL), m_sleep_fixed_point(false), m_pose_kept(false)
+{
+    if(data == NULL)
+        return;
+    // The id has to be known before load() copies the entity's animations
+    entity = data->getEntityID(entityName);
+    load(data);
+}
+
+Entity::~Entity()
+{
+    clear();
+}
+
+void Entity::load(SCML::Data* data)
+{
+    if(data == NULL)
+        return;
+
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(data->entities, entity);
+    if(entity_ptr == NULL)
+        return;
+
+    m_data = data;
+    name = entity_ptr->name;
+    lod_policy = entity_ptr->lod_policy;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(entity_ptr->animations, int, SCML::Data::Entity::Animation*, item)
+    {
+        Animation* animation_ptr = new Animation(item, data->quantize_keys);
+        SCML_MAP_INSERT_ONLY(animations, item->id, animation_ptr);
+        animation_names.insert(SCML_TO_CSTRING(animation_ptr->name), animation_ptr->id);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    // Give each timeline name a crossfade channel, so bones and objects can be matched between animations
+    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, animation_ptr)
+    {
+        assignChannels(animation_ptr);
+        assignVariables(animation_ptr);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    // Need to keep track of initial pivots
+    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, iFolder)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(iFolder->files, int, SCML::Data::Folder::File*, iFile)
+        {
+            FolderFile_t folderFile = FolderFile_t(iFolder->id, iFile->id);
+            Pivot_t pivot = Pivot_t(iFile->pivot_x, iFile->pivot_y);
+            SCML_MAP_INSERT_ONLY(m_pivots, folderFile, pivot);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    // Lay out the images for the character maps, with each image drawing itself to begin with
+    int num_folders = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, iFolder)
+    {
+        if(iFolder->id >= num_folders)
+            num_folders = iFolder->id + 1;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    SCML_VECTOR_RESIZE(m_image_offsets, num_folders + 1);
+    for(int i = 0; i <= num_folders; i++)
+        m_image_offsets[i] = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, iFolder)
+    {
+        if(iFolder->id < 0)
+            continue;
+        SCML_BEGIN_MAP_FOREACH_CONST(iFolder->files, int, SCML::Data::Folder::File*, iFile)
+        {
+            if(iFile->id >= m_image_offsets[iFolder->id + 1])
+                m_image_offsets[iFolder->id + 1] = iFile->id + 1;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    for(int i = 0; i < num_folders; i++)
+        m_image_offsets[i + 1] += m_image_offsets[i];
+
+    SCML_VECTOR_RESIZE(m_image_map, m_image_offsets[num_folders]);
+    for(int i = 0; i < num_folders; i++)
+    {
+        for(int j = m_image_offsets[i]; j < m_image_offsets[i + 1]; j++)
+            m_image_map[j] = FolderFile_t(i, j - m_image_offsets[i]);
+    }
+
+    loadAnimation(animation);
+}
+
+void Entity::assignChannels(Animation* animation_ptr)
+{
+    int num_timelines = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(animation_ptr->timelines, int, Animation::Timeline*, timeline)
+    {
+        if(timeline->id >= num_timelines)
+            num_timelines = timeline->id + 1;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    SCML_VECTOR_RESIZE(animation_ptr->timeline_channels, num_timelines);
+    for(int i = 0; i < num_timelines; i++)
+        animation_ptr->timeline_channels[i] = -1;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(animation_ptr->timelines, int, Animation::Timeline*, timeline)
+    {
+        if(timeline->id < 0)
+            continue;
+        // Unnamed timelines can't be matched, so they get a channel of their own
+        int channel = -1;
+        if(SCML_STRING_SIZE(timeline->name) > 0)
+            channel = m_channel_names.find(SCML_TO_CSTRING(timeline->name));
+        if(channel < 0)
+        {
+            channel = m_num_channels++;
+            if(SCML_STRING_SIZE(timeline->name) > 0)
+                m_channel_names.insert(SCML_TO_CSTRING(timeline->name), channel);
+        }
+        animation_ptr->timeline_channels[timeline->id] = channel;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+void Entity::assignVariables(Animation* animation_ptr)
+{
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(m_data->entities, entity);
+    int num_handles = entity_ptr->variable_names.size();
+
+    SCML_VECTOR_RESIZE(animation_ptr->variable_varlines, num_handles);
+    for(int i = 0; i < num_handles; i++)
+        animation_ptr->variable_varlines[i] = -1;
+
+    for(int i = 0; i < (int)SCML_VECTOR_SIZE(animation_ptr->varlines); i++)
+    {
+        int handle = entity_ptr->variable_names.find(SCML_TO_CSTRING(animation_ptr->varlines[i]->name));
+        if(handle >= 0 && animation_ptr->variable_varlines[handle] < 0)
+            animation_ptr->variable_varlines[handle] = i;
+    }
+}
+
+void Entity::clear()
+{
+    entity = -1;
+    animation = -1;
+    key = -1;
+    time = 0;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
+    {
+        delete item;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    animations.clear();
+    animation_names.clear();
+    m_channel_names.clear();
+    m_num_channels = 0;
+    crossfade = Crossfade();
+    bone_transform_state.fade_keys = Pose_Keys();
+    clearLayers();
+
+    SCML_VECTOR_CLEAR(m_image_offsets);
+    SCML_VECTOR_CLEAR(m_image_map);
+    SCML_VECTOR_CLEAR(m_character_maps);
+    m_data = NULL;
+    wake();
+}
+
+void Entity::startAnimation(int animation)
+{
+    loadAnimation(animation);
+    this->animation = animation;
+    key = 0;
+    time = 0;
+    m_lod_pending_ms = 0;
+    crossfade.animation = -1;
+    wake();
+}
+
+void Entity::startAnimation(const char* animationName)
+{
+    startAnimation(animation_names.find(animationName));
+}
+
+void Entity::crossfadeAnimation(int animation, int fade_ms)
+{
+    loadAnimation(animation);
+    if(fade_ms <= 0 || getKey(this->animation, key) == NULL)
+    {
+        startAnimation(animation);
+        return;
+    }
+
+    // The current animation carries on at its own time while it fades out
+    crossfade.animation = this->animation;
+    crossfade.key = key;
+    crossfade.time = time;
+    crossfade.length = fade_ms;
+    crossfade.elapsed = 0;
+
+    this->animation = animation;
+    key = 0;
+    time = 0;
+    m_lod_pending_ms = 0;
+    wake();
+}
+
+void Entity::crossfadeAnimation(const char* animationName, int fade_ms)
+{
+    crossfadeAnimation(animation_names.find(animationName), fade_ms);
+}
+
+bool Entity::loadAnimation(int animation)
+{
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL)
+        return false;
+    if(animation_ptr->loaded)
+        return true;
+
+    if(m_data == NULL || !m_data->loadAnimation(entity, animation))
+        return false;
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(m_data->entities, entity);
+    animation_ptr->load(SCML_MAP_FIND(entity_ptr->animations, animation), m_data->quantize_keys);
+
+    // The new timelines may add channels, which the layers' masks have to cover
+    int num_channels = m_num_channels;
+    assignChannels(animation_ptr);
+    assignVariables(animation_ptr);
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(layers); i++)
+    {
+        Layer* layer = layers[i];
+        SCML_VECTOR_RESIZE(layer->mask, m_num_channels);
+        for(int j = num_channels; j < m_num_channels; j++)
+            layer->mask[j] = (layer->root < 0);
+        if(layer->root >= 0)
+            maskLayer(layer, animation_ptr);
+    }
+
+    // A pose built before the keys were loaded is stale
+    bone_transform_state.entity = -1;
+    wake();
+    return animation_ptr->loaded;
+}
+
+int Entity::addLayer(int animation, const char* boneName, float weight)
+{
+    if(!loadAnimation(animation))
+        return -1;
+
+    int root = -1;
+    if(boneName != NULL)
+    {
+        root = m_channel_names.find(boneName);
+        if(root < 0)
+            return -1;
+    }
+
+    Layer* layer = new Layer(animation, weight);
+    SCML_VECTOR_RESIZE(layer->mask, m_num_channels);
+    for(int i = 0; i < m_num_channels; i++)
+        layer->mask[i] = (root < 0);
+
+    if(root >= 0)
+    {
+        layer->root = root;
+        layer->mask[root] = 1;
+
+        // Anything attached to a masked bone in any key of any animation is masked
+        SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, animation_ptr)
+        {
+            maskLayer(layer, animation_ptr);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+
+    int n = SCML_VECTOR_SIZE(layers);
+    SCML_VECTOR_RESIZE(layers, n + 1);
+    layers[n] = layer;
+    return n;
+}
+
+void Entity::maskLayer(Layer* layer, const Animation* animation_ptr)
+{
+    // Parents come before their children in a key
+    SCML_VECTOR(int) bone_channels;
+    SCML_BEGIN_MAP_FOREACH_CONST(animation_ptr->mainline.keys, int, Animation::Mainline::Key*, key_ptr)
+    {
+        SCML_VECTOR_CLEAR(bone_channels);
+        SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Animation::Mainline::Key::Bone_Container, item)
+        {
+            if(!item.hasBone_Ref())
+                continue;
+            Animation::Mainline::Key::Bone_Ref* ref = item.bone_ref;
+            if(ref->id < 0)
+                continue;
+            int n = SCML_VECTOR_SIZE(bone_channels);
+            if(ref->id >= n)
+            {
+                SCML_VECTOR_RESIZE(bone_channels, ref->id + 1);
+                for(int i = n; i <= ref->id; i++)
+                    bone_channels[i] = -1;
+            }
+
+            int channel = get_channel(animation_ptr, ref->timeline);
+            bone_channels[ref->id] = channel;
+            if(channel >= 0 && ref->parent >= 0 && ref->parent < (int)SCML_VECTOR_SIZE(bone_channels)
+               && bone_channels[ref->parent] >= 0 && layer->mask[bone_channels[ref->parent]])
+                layer->mask[channel] = 1;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+
+        SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->objects, int, Animation::Mainline::Key::Object_Container, item)
+        {
+            if(item.hasObject())
+                continue;
+            Animation::Mainline::Key::Object_Ref* ref = item.object_ref;
+            int channel = get_channel(animation_ptr, ref->timeline);
+            if(channel >= 0 && ref->parent >= 0 && ref->parent < (int)SCML_VECTOR_SIZE(bone_channels)
+               && bone_channels[ref->parent] >= 0 && layer->mask[bone_channels[ref->parent]])
+                layer->mask[channel] = 1;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+void Entity::startLayerAnimation(int layer, int animation)
+{
+    if(layer < 0 || layer >= (int)SCML_VECTOR_SIZE(layers))
+        return;
+    loadAnimation(animation);
+    layers[layer]->animation = animation;
+    layers[layer]->key = 0;
+    layers[layer]->time = 0;
+}
+
+void Entity::clearLayers()
+{
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(layers); i++)
+        delete layers[i];
+    SCML_VECTOR_CLEAR(layers);
+    wake();
+}
+
+int Entity::getNumChannels() const
+{
+    return m_num_channels;
+}
+
+int Entity::getChannel(const char* timelineName) const
+{
+    return m_channel_names.find(timelineName);
+}
+
+void Entity::setLODPolicy(const LOD_Policy& policy)
+{
+    lod_policy = policy;
+    wake();
+}
+
+void Entity::setLODLevel(int level)
+{
+    lod_level = level;
+}
+
+int Entity::setLODScale(float projected_scale)
+{
+    lod_level = lod_policy.getLevel(projected_scale);
+    return lod_level;
+}
+
+void Entity::applyCharacterMap(const SCML::Data::Character_Map* character_map)
+{
+    if(character_map == NULL)
+        return;
+
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(character_map->maps); i++)
+    {
+        const SCML::Data::Character_Map::Map& map = character_map->maps[i];
+        int index = getImageIndex(map.folder, map.file);
+        if(index >= 0)
+            m_image_map[index] = FolderFile_t(map.target_folder, map.target_file);
+    }
+
+    int n = SCML_VECTOR_SIZE(m_character_maps);
+    SCML_VECTOR_RESIZE(m_character_maps, n + 1);
+    m_character_maps[n] = character_map;
+    wake();
+}
+
+void Entity::clearCharacterMaps()
+{
+    // Only the images that were mapped need to be put back
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(m_character_maps); i++)
+    {
+        const SCML::Data::Character_Map* character_map = m_character_maps[i];
+        for(unsigned int j = 0; j < SCML_VECTOR_SIZE(character_map->maps); j++)
+        {
+            const SCML::Data::Character_Map::Map& map = character_map->maps[j];
+            int index = getImageIndex(map.folder, map.file);
+            if(index >= 0)
+                m_image_map[index] = FolderFile_t(map.folder, map.file);
+        }
+    }
+    SCML_VECTOR_CLEAR(m_character_maps);
+    wake();
+}
+
+int Entity::getImageIndex(int folderID, int fileID) const
+{
+    if(folderID < 0 || fileID < 0 || folderID + 1 >= (int)SCML_VECTOR_SIZE(m_image_offsets))
+        return -1;
+    int index = m_image_offsets[folderID] + fileID;
+    if(index >= m_image_offsets[folderID + 1])
+        return -1;
+    return index;
+}
+
+bool Entity::getMappedImage(int& folderID, int& fileID) const
+{
+    if(SCML_VECTOR_SIZE(m_character_maps) == 0)
+        return true;
+
+    int index = getImageIndex(folderID, fileID);
+    if(index < 0)
+        return true;
+
+    const FolderFile_t& image = m_image_map[index];
+    folderID = SCML_PAIR_FIRST(image);
+    fileID = SCML_PAIR_SECOND(image);
+    return (folderID >= 0 && fileID >= 0);
+}
+
+
+void Entity::update(int dt_ms)
+{
+    SCML_PROFILE_ZONE("Entity::update", this);
+
+    // The trigger buffer holds only this update's events, even when it returns early
+    m_num_triggers = 0;
+
+    if(entity < 0 || animation < 0 || key < 0)
+        return;
+
+    SCML::Entity::Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL)
+        return;
+
+    // A sleeping entity whose animation has ended has nothing left to advance or fire
+    if(m_asleep && animation_ptr->looping != "true" && time >= animation_ptr->length && crossfade.animation < 0 && SCML_VECTOR_SIZE(layers) == 0)
+        return;
+
+    // At reduced rate, bank the elapsed time and only advance every Nth update so the pose holds in between.
+    if(lod_level >= LOD_REDUCED_RATE && lod_policy.reduced_rate_interval > 1)
+    {
+        m_lod_pending_ms += dt_ms;
+        if(++m_lod_frame % lod_policy.reduced_rate_interval != 0)
+            return;
+        dt_ms = 0;
+    }
+    // This also flushes time banked before leaving reduced rate.
+    dt_ms += m_lod_pending_ms;
+    m_lod_pending_ms = 0;
+
+    if(SCML_VECTOR_SIZE(animation_ptr->triggers) > 0)
+        fireTriggers(animation_ptr, time, dt_ms);
+
+    advance(animation_ptr, key, time, dt_ms);
+
+    if(crossfade.animation >= 0)
+    {
+        crossfade.elapsed += dt_ms;
+        Animation* fade_ptr = getAnimation(crossfade.animation);
+        if(fade_ptr == NULL || crossfade.elapsed >= crossfade.length)
+            crossfade.animation = -1;
+        else
+            advance(fade_ptr, crossfade.key, crossfade.time, dt_ms);
+    }
+
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(layers); i++)
+    {
+        Layer* layer = layers[i];
+        Animation* layer_ptr = getAnimation(layer->animation);
+        if(layer_ptr != NULL)
+            advance(layer_ptr, layer->key, layer->time, dt_ms);
+    }
+}
+
+// Calls onTrigger() for the triggers in the dt_ms after time, wrapping around a looping animation
+void Entity::fireTriggers(const Animation* animation_ptr, int time, int dt_ms)
+{
+    int length = animation_ptr->length;
+    bool looping = (animation_ptr->looping == "true");
+    int num_triggers = SCML_VECTOR_SIZE(animation_ptr->triggers);
+
+    // Each pass covers [time, end), wrapping around to the start of a looping animation until dt_ms is spent
+    while(dt_ms > 0 && length > 0)
+    {
+        int end = time + dt_ms;
+        if(end > length)
+            end = length;
+
+        for(int i = animation_ptr->findTrigger(time); i < num_triggers && animation_ptr->triggers[i].time < end; i++)
+        {
+            onTrigger(animation_ptr->triggers[i]);
+            m_num_triggers++;
+        }
+
+        if(!looping)
+            break;
+        dt_ms -= end - time;
+        time = 0;
+    }
+}
+
+void Entity::onTrigger(const Animation::Trigger& trigger)
+{
+    if(m_num_triggers < m_trigger_capacity)
+        m_trigger_buffer[m_num_triggers] = &trigger;
+}
+
+void Entity::setTriggerBuffer(const Animation::Trigger** buffer, int capacity)
+{
+    m_trigger_buffer = buffer;
+    m_trigger_capacity = (buffer != NULL? capacity : 0);
+    m_num_triggers = 0;
+}
+
+int Entity::getNumTriggers() const
+{
+    return m_num_triggers;
+}
+
+Entity::Variable_Value::Variable_Value()
+    : type(-1), value_int(0), value_float(0.0f), value_string("")
+{}
+
+int Entity::getVariableHandle(const char* variableName) const
+{
+    if(m_data == NULL)
+        return -1;
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(m_data->entities, entity);
+    if(entity_ptr == NULL)
+        return -1;
+    return entity_ptr->variable_names.find(variableName);
+}
+
+// Eases t (0 to 1) between two keys
+static float apply_curve(int curve_type, float c1, float c2, float t)
+{
+    switch(curve_type)
+    {
+    case Entity::Animation::Varline::INSTANT:
+        return 0.0f;
+    case Entity::Animation::Varline::QUADRATIC:
+        // Bezier through 0, c1, 1
+        return 2*(1-t)*t*c1 + t*t;
+    case Entity::Animation::Varline::CUBIC:
+        // Bezier through 0, c1, c2, 1
+        return 3*(1-t)*(1-t)*t*c1 + 3*(1-t)*t*t*c2 + t*t*t;
+    default:
+        return t;
+    }
+}
+
+bool Entity::getVariable(int handle, Variable_Value& value) const
+{
+    value = Variable_Value();
+
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL || handle < 0 || handle >= (int)SCML_VECTOR_SIZE(animation_ptr->variable_varlines))
+        return false;
+    int index = animation_ptr->variable_varlines[handle];
+    if(index < 0)
+        return false;
+    const Animation::Varline* varline = animation_ptr->varlines[index];
+    int num_keys = SCML_VECTOR_SIZE(varline->keys);
+    if(num_keys == 0)
+        return false;
+
+    // Tween from the last key at or before the time to the next one, wrapping around if the animation loops
+    bool looping = (animation_ptr->looping == "true");
+    int key1 = varline->findKey(time);
+    int key2 = key1 + 1;
+    int time1 = 0;
+    int time2 = 0;
+    if(key1 < 0)
+    {
+        key1 = (looping? num_keys - 1 : 0);
+        key2 = 0;
+        time1 = varline->keys[key1].time - (looping? animation_ptr->length : 0);
+        time2 = varline->keys[key2].time;
+    }
+    else if(key2 >= num_keys)
+    {
+        key2 = (looping? 0 : key1);
+        time1 = varline->keys[key1].time;
+        time2 = varline->keys[key2].time + (looping? animation_ptr->length : 0);
+    }
+    else
+    {
+        time1 = varline->keys[key1].time;
+        time2 = varline->keys[key2].time;
+    }
+
+    const Animation::Varline::Key& k1 = varline->keys[key1];
+    const Animation::Varline::Key& k2 = varline->keys[key2];
+    float t = (time2 > time1? (time - time1)/float(time2 - time1) : 0.0f);
+    t = apply_curve(k1.curve_type, k1.c1, k1.c2, t);
+
+    value.type = varline->type;
+    if(varline->type == Animation::Varline::INT)
+    {
+        // From the ints themselves, in double precision, so values past a float's 24 bits don't lose their low digits
+        double tweened = k1.value_int + (double(k2.value_int) - k1.value_int)*t;
+        value.value_int = int(tweened);
+        value.value_float = float(tweened);
+    }
+    else
+    {
+        value.value_float = k1.value_float + (k2.value_float - k1.value_float)*t;
+        value.value_int = 0;
+    }
+    value.value_string = SCML_TO_CSTRING(k1.value_string);
+    return true;
+}
+
+int Entity::getTagHandle(const char* tagName) const
+{
+    if(m_data == NULL)
+        return -1;
+    return m_data->tag_names.find(tagName);
+}
+
+Tag_Set Entity::getTags() const
+{
+    Animation::Mainline::Key* key_ptr = getKey(animation, key);
+    if(key_ptr == NULL)
+        return Tag_Set();
+    return key_ptr->tags;
+}
+
+int Entity::findTagged(const Entity* const* entities, int num_entities, const Tag_Set& tags, int* matches)
+{
+    int num_matches = 0;
+    for(int i = 0; i < num_entities; i++)
+    {
+        Animation::Mainline::Key* key_ptr = entities[i]->getKey(entities[i]->animation, entities[i]->key);
+        if(key_ptr != NULL && key_ptr->tags.hasAll(tags))
+            matches[num_matches++] = i;
+    }
+    return num_matches;
+}
+
+int Entity::getVariables(const Entity* const* entities, int num_entities, int handle, Variable_Value* values)
+{
+    int num_found = 0;
+    for(int i = 0; i < num_entities; i++)
+    {
+        if(entities[i]->getVariable(handle, values[i]))
+            num_found++;
+    }
+    return num_found;
+}
+
+// Moves an animation's time forward and finds the mainline key for it
+void Entity::advance(Animation* animation_ptr, int& key, int& time, int dt_ms) const
+{
+    time += dt_ms;
+
+    if(animation_ptr->looping == "true")
+    {
+        time %= animation_ptr->length;
+    }
+    else
+    {
+        if(time > animation_ptr->length)
+            time = animation_ptr->length;
+    }
+
+    for(key = 0; key+1 < (int)SCML_MAP_SIZE(animation_ptr->mainline.keys); key++)
+    {
+        if(SCML_MAP_FIND(animation_ptr->mainline.keys, key + 1)->time > time)
+            break;
+    }
+}
+
+
+inline float lerp(float a, float b, float t)
+{
+    return a + (b-a)*t;
+}
+
+// This is for rotating untranslated points and offsetting them to a new origin, for an angle whose sine and cosine are known.
+static void rotate_point(float& x, float& y, float s, float c, float origin_x, float origin_y)
+{
+    float xnew = (x * c) - (y * s);
+    float ynew = (x * s) + (y * c);
+    xnew += origin_x;
+    ynew += origin_y;
+
+    x = xnew;
+    y = ynew;
+}
+
+// The same, for an angle in degrees
+static void rotate_point(float& x, float& y, float angle, float origin_x, float origin_y, bool flipped)
+{
+    float s = sinf(angle*M_PI/180);
+    float c = cosf(angle*M_PI/180);
+    float xnew = (x * c) - (y * s);
+    float ynew = (x * s) + (y * c);
+    xnew += origin_x;
+    ynew += origin_y;
+
+    x = xnew;
+    y = ynew;
+}
+
+// The transform of an untweened object, in world space
+static Transform get_simple_object_transform(const Entity::Bone_Transform_State& state, const Entity::Animation::Mainline::Key::Object* obj1)
+{
+    Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
+    if(state.fixed_point)
+    {
+        Fixed_Transform fixed_transform(obj_transform);
+        fixed_transform.apply_parent_transform(state.getFixedParent(obj1->parent));
+        return fixed_transform.toTransform();
+    }
+
+    // Get parent bone transform
+    Transform parent_transform;
+    if(obj1->parent < 0)
+        parent_transform = state.base_transform;
+    else
+        parent_transform = state.transforms[obj1->parent];
+
+    obj_transform.apply_parent_transform(parent_transform);
+    return obj_transform;
+}
+
+// Finds where the center of an object's image goes, rotated about its pivot point (pivot_x, pivot_y: fractions of the image
+// from its bottom left corner).  The image's own pivot moves it by (image_pivot_x, image_pivot_y - 1) images.  Also gives the
+// sine and cosine of the object's angle.
+static void place_image(const Transform& obj_transform, float image_pivot_x, float image_pivot_y, float pivot_x, float pivot_y, const SCML_PAIR(unsigned int, unsigned int)& img_dims,
+                        bool fixed_point, float& x, float& y, float& sin_angle, float& cos_angle)
+{
+    int width = SCML_PAIR_FIRST(img_dims);
+    int height = SCML_PAIR_SECOND(img_dims);
+    if(fixed_point)
+    {
+        // The image and object pivots together, less a half and a half plus one: 32768 and 98304 are 0.5 and 1.5 in 16.16
+        Fixed_Transform obj(obj_transform);
+        Fixed offset_x = (Fixed_Transform::toFixed(image_pivot_x) + Fixed_Transform::toFixed(pivot_x) - 32768) * width;
+        Fixed offset_y = (Fixed_Transform::toFixed(image_pivot_y) + Fixed_Transform::toFixed(pivot_y) - 98304) * height;
+        Fixed sprite_x = -Fixed_Transform::mul(offset_x, obj.scale_x);
+        Fixed sprite_y = -Fixed_Transform::mul(offset_y, obj.scale_y);
+
+        Fixed s = Fixed_Transform::sin(obj.angle);
+        Fixed c = Fixed_Transform::cos(obj.angle);
+        x = Fixed_Transform::toFloat(Fixed_Transform::mul(sprite_x, c) - Fixed_Transform::mul(sprite_y, s) + obj.x);
+        y = Fixed_Transform::toFloat(Fixed_Transform::mul(sprite_x, s) + Fixed_Transform::mul(sprite_y, c) + obj.y);
+        sin_angle = Fixed_Transform::toFloat(s);
+        cos_angle = Fixed_Transform::toFloat(c);
+        return;
+    }
+
+    // The origin
+    float origin_x = image_pivot_x * width;
+    float origin_y = (image_pivot_y - 1.f) * height;
+
+    float offset_x = origin_x + (pivot_x - 0.5f)*width;
+    float offset_y = origin_y + (pivot_y - 0.5f)*height;
+    x = -offset_x*obj_transform.scale_x;
+    y = -offset_y*obj_transform.scale_y;
+
+    sin_angle = sinf(obj_transform.angle*M_PI/180);
+    cos_angle = cosf(obj_transform.angle*M_PI/180);
+    rotate_point(x, y, sin_angle, cos_angle, obj_transform.x, obj_transform.y);
+}
+
+void Entity::draw(float x, float y, float angle, float scale_x, float scale_y)
+{
+    SCML_PROFILE_ZONE("Entity::draw", this);
+
+    convert_to_SCML_coords(x, y, angle);
+    Transform base_transform(x, y, angle, scale_x, scale_y);
+    const Sprite* sprites = NULL;
+    int num_sprites = 0;
+    if(getSleepingPose(&base_transform, sprites, num_sprites))
+        drawPlaced(sprites, num_sprites, Transform(base_transform.x, base_transform.y, 0.0f, 1.0f, 1.0f));
+    else
+        drawPose(base_transform);
+}
+
+bool Entity::isSleeping() const
+{
+    return m_asleep;
+}
+
+void Entity::wake()
+{
+    if(m_asleep)
+        wakes++;
+    m_asleep = false;
+    m_sleep_cached = false;
+    m_sleep_drawn = false;
+    m_sleep_animation = -1;
+}
+
+void Entity::refreshPose()
+{
+    // Evaluate at the rotation and scale of the last draw, which only has to move the pose then
+    int num_sprites = 0;
+    evaluateSprites(Transform(0.0f, 0.0f, m_sleep_transform.angle, m_sleep_transform.scale_x, m_sleep_transform.scale_y), num_sprites);
+    m_sleep_cached = true;
+    m_sleep_drawn = false;
+    m_pose_kept = true;
+}
+
+bool Entity::getSleepingPose(const Transform* base_transform, const Sprite*& sprites, int& num_sprites)
+{
+    if(hold_pose)
+    {
+        // A pose kept while asleep may be from before hold_pose was set
+        if(m_asleep)
+            wake();
+    }
+    else if(!auto_sleep)
+    {
+        if(m_asleep)
+            wake();
+        return false;
+    }
+    else if(!checkSleep())
+        return false;
+
+    // Moving a pose draws it the same as evaluating it there, but mirroring or scaling it after the fact would not, so a
+    // draw with another rotation or scale evaluates the pose again.  Views place a pose from the origin themselves.
+    Transform placement = (base_transform != NULL? *base_transform : Transform());
+    bool moved = !(placement == m_sleep_transform);
+    bool reoriented = (placement.angle != m_sleep_transform.angle || placement.scale_x != m_sleep_transform.scale_x
+                       || placement.scale_y != m_sleep_transform.scale_y);
+    m_sleep_transform = placement;
+    if(!m_sleep_cached || reoriented)
+        refreshPose();
+
+    num_sprites = SCML_VECTOR_SIZE(m_view_sprites);
+    sprites = (num_sprites > 0? &m_view_sprites[0] : NULL);
+
+    // Several views draw to several places, so only a single draw() can be skipped
+    if(base_transform == NULL)
+        m_sleep_drawn = false;
+    else
+    {
+        if(retained_output && m_sleep_drawn && !moved)
+            num_sprites = 0;
+        m_sleep_drawn = retained_output;
+    }
+    return true;
+}
+
+bool Entity::checkSleep()
+{
+    // Blends change the pose without changing the time, and a static animation looks the same at every time
+    Animation* animation_ptr = getAnimation(animation);
+    bool blending = (crossfade.animation >= 0 || bone_transform_state.fade_weight > 0.0f || SCML_VECTOR_SIZE(layers) > 0);
+    int pose_time = (animation_ptr != NULL && animation_ptr->is_static? 0 : time);
+    if(blending || animation_ptr == NULL || m_sleep_animation != animation || m_sleep_key != key || m_sleep_time != pose_time
+       || m_sleep_lod_level != lod_level || m_sleep_fixed_point != fixed_point)
+    {
+        if(m_asleep)
+            wake();
+        m_sleep_animation = (blending? -1 : animation);
+        m_sleep_key = key;
+        m_sleep_time = pose_time;
+        m_sleep_lod_level = lod_level;
+        m_sleep_fixed_point = fixed_point;
+        return false;
+    }
+
+    if(!m_asleep)
+    {
+        m_asleep = true;
+        sleeps++;
+    }
+    return true;
+}
+
+Entity::Animation::Mainline::Key* Entity::evaluateBones(const Transform& base_transform, const SCML_VECTOR(char)* channels)
+{
+    // The bones are placed by base_transform from here on, unless refreshPose() is evaluating them for draw() to move
+    m_pose_kept = false;
+
+    // Get key
+    Animation::Mainline::Key* key_ptr = getKey(animation, key);
+    if(key_ptr == NULL)
+        return NULL;
+
+    // When snapping to keys, evaluate the pose at the mainline key's time so it is only rebuilt on key changes
+    int pose_time = (lod_level >= LOD_SNAP_TO_KEY? key_ptr->time : time);
+
+    // Build up the bone transform hierarchy
+    // Crossfades and layers change the pose even when the time doesn't, and the pose after a crossfade has to lose the blend.
+    // A pose of only some bones is no good for drawing, and the other way around is wasted work.
+    bool blending = (crossfade.animation >= 0 || bone_transform_state.fade_weight > 0.0f || SCML_VECTOR_SIZE(layers) > 0);
+    if(blending || bone_transform_state.fixed_point != fixed_point || bone_transform_state.partial != (channels != NULL)
+       || bone_transform_state.should_rebuild(entity, animation, key, pose_time, base_transform))
+    {
+        bone_transform_state.rebuild(entity, animation, key, pose_time, this, base_transform, channels);
+    }
+    return key_ptr;
+}
+
+void Entity::drawPose(const Transform& base_transform)
+{
+    Animation::Mainline::Key* key_ptr = evaluateBones(base_transform);
+    if(key_ptr == NULL)
+        return;
+
+
+    // Go through each object
+    SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->objects, int, Animation::Mainline::Key::Object_Container, item)
+    {
+        if(item.hasObject())
+        {
+            draw_simple_object(item.object);
+        }
+        else
+        {
+            draw_tweened_object(item.object_ref);
+        }
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+void Entity::drawViews(const Transform* views, int num_views)
+{
+    SCML_PROFILE_ZONE("Entity::drawViews", this);
+
+    // Evaluate the pose once, at the origin, unless the entity is asleep and has it already
+    const Sprite* sprites = NULL;
+    int num_sprites = 0;
+    if(!getSleepingPose(NULL, sprites, num_sprites))
+        sprites = evaluateSprites(Transform(), num_sprites);
+
+    for(int v = 0; v < num_views; v++)
+    {
+        beginView(v);
+
+        Transform view = views[v];
+        convert_to_SCML_coords(view.x, view.y, view.angle);
+        drawPlaced(sprites, num_sprites, view);
+    }
+}
+
+void Entity::drawPlaced(const Sprite* sprites, int num_sprites, const Transform& view)
+{
+    View_Transform placement(view);
+    for(int i = 0; i < num_sprites; i++)
+    {
+        const Sprite& sprite = sprites[i];
+        Transform sprite_transform = placement.apply(sprite.transform);
+
+        if(isCulled(SCML_MAKE_PAIR(sprite.width, sprite.height), sprite_transform))
+            continue;
+
+        SCML_PROFILE_ZONE("draw_internal", this);
+        if(affine_output)
+            draw_internal_affine(sprite.folder, sprite.file, Affine(sprite_transform));
+        else
+            draw_internal(sprite.folder, sprite.file, sprite_transform.x, sprite_transform.y, sprite_transform.angle, sprite_transform.scale_x, sprite_transform.scale_y);
+    }
+}
+
+void Entity::beginView(int view)
+{}
+
+View_Transform::View_Transform(const Transform& view)
+    : view(view), flipped((view.scale_x < 0) != (view.scale_y < 0)), sin_angle(sinf(view.angle*M_PI/180)), cos_angle(cosf(view.angle*M_PI/180))
+{}
+
+const Entity::Sprite* Entity::evaluateSprites(const Transform& base_transform, int& num_sprites)
+{
+    // The sleeping pose is kept here too, and this one may be somewhere else
+    m_sleep_cached = false;
+    SCML_VECTOR_CLEAR(m_view_sprites);
+    m_recording_views = true;
+    drawPose(base_transform);
+    m_recording_views = false;
+
+    num_sprites = SCML_VECTOR_SIZE(m_view_sprites);
+    return (num_sprites > 0? &m_view_sprites[0] : NULL);
+}
+
+void Entity::drawSprite(int folderID, int fileID, const SCML_PAIR(unsigned int, unsigned int)& img_dims, float x, float y, float angle, float scale_x, float scale_y, float sin_angle, float cos_angle)
+{
+    if(m_recording_views)
+    {
+        int i = SCML_VECTOR_SIZE(m_view_sprites);
+        SCML_VECTOR_RESIZE(m_view_sprites, i+1);
+        m_view_sprites[i].folder = folderID;
+        m_view_sprites[i].file = fileID;
+        m_view_sprites[i].transform = Transform(x, y, angle, scale_x, scale_y);
+        m_view_sprites[i].width = SCML_PAIR_FIRST(img_dims);
+        m_view_sprites[i].height = SCML_PAIR_SECOND(img_dims);
+        return;
+    }
+
+    SCML_PROFILE_ZONE("draw_internal", this);
+    if(affine_output)
+        draw_internal_affine(folderID, fileID, Affine(Transform(x, y, angle, scale_x, scale_y), sin_angle, cos_angle));
+    else
+        draw_internal(folderID, fileID, x, y, angle, scale_x, scale_y);
+}
+
+void Entity::draw_internal_affine(int folderID, int fileID, const Affine& transform)
+{
+    // A renderer that doesn't take matrices gets the Transform back.  The determinant's sign says whether it mirrors.
+    float scale_x = sqrtf(transform.xx*transform.xx + transform.yx*transform.yx);
+    float angle = atan2f(transform.yx, transform.xx)*180/M_PI;
+    float scale_y = (scale_x != 0.0f? (transform.xx*transform.yy - transform.xy*transform.yx)/scale_x : sqrtf(transform.xy*transform.xy + transform.yy*transform.yy));
+    draw_internal(folderID, fileID, transform.tx, transform.ty, angle, scale_x, scale_y);
+}
+
+Entity::Pivot_t Entity::getImagePivots(int folder, int file) const
+{
+    return SCML_MAP_FIND(m_pivots, SCML_PAIR(int, int)(folder, file));
+}
+
+// Checks the projected size of an image against the LOD policy's minimum
+bool Entity::isCulled(const SCML_PAIR(unsigned int, unsigned int)& img_dims, const Transform& obj_transform) const
+{
+    // drawViews() culls for each view
+    if(lod_policy.min_pixel_size <= 0.0f || m_recording_views)
+        return false;
+
+    float w = SCML_PAIR_FIRST(img_dims) * fabs(obj_transform.scale_x);
+    float h = SCML_PAIR_SECOND(img_dims) * fabs(obj_transform.scale_y);
+    return (w < lod_policy.min_pixel_size && h < lod_policy.min_pixel_size);
+}
+
+void Entity::draw_simple_object(Animation::Mainline::Key::Object* obj1)
+{
+    // Use the image from the character maps
+    int folderID = obj1->folder;
+    int fileID = obj1->file;
+    if(!getMappedImage(folderID, fileID))
+        return;
+
+    // Set object transform, then transform it by the parent bone's
+    Transform obj_transform = get_simple_object_transform(bone_transform_state, obj1);
+
+    SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(folderID, fileID);
+    if(isCulled(img_dims, obj_transform))
+        return;
+
+
+    // Transform the sprite by its own transform now.
+
+    float pivot_x_ratio = obj1->pivot_x;
+    float pivot_y_ratio = obj1->pivot_y;
+
+    // No image tweening
+    SCML_PAIR(float, float) img_pivot = getImagePivots(folderID, fileID);
+
+    // Rotate about the pivot point and draw from the center of the image.  The sine and cosine also go to draw_internal_affine().
+    float sprite_x, sprite_y, sin_angle, cos_angle;
+    place_image(obj_transform, SCML_PAIR_FIRST(img_pivot), SCML_PAIR_SECOND(img_pivot), pivot_x_ratio, pivot_y_ratio, img_dims, bone_transform_state.fixed_point, sprite_x, sprite_y, sin_angle, cos_angle);
+
+    // Let the renderer draw it
+    drawSprite(folderID, fileID, img_dims, sprite_x, sprite_y, obj_transform.angle, obj_transform.scale_x, obj_transform.scale_y, sin_angle, cos_angle);
+}
+
+
+void Entity::draw_tweened_object(Animation::Mainline::Key::Object_Ref* ref)
+{
+    if(ref == NULL)
+        return;
+    // Tween the object at the time the bones were evaluated for (see LOD_SNAP_TO_KEY)
+    Animation* animation_ptr = getAnimation(animation);
+    if(animation_ptr == NULL)
+        return;
+    Bone_Transform_State::Object_Transform obj;
+    if(!evaluateObject(animation_ptr, ref, bone_transform_state.time, obj))
+        return;
+    float t = obj.t;
+
+    // Sub-entities draw a whole pose instead of an image
+    Animation::Timeline* timeline_ptr = SCML_MAP_FIND(animation_ptr->timelines, ref->timeline);
+    bool sub_entity = (timeline_ptr != NULL && timeline_ptr->sub_entity);
+
+    // Use the image from the character maps
+    int folderID = obj.folder;
+    int fileID = obj.file;
+    if(!sub_entity && !getMappedImage(folderID, fileID))
+        return;
+
+    Transform obj_transform = obj.transform;
+
+    if(sub_entity)
+    {
+        drawSubEntity(animation_ptr, timeline_ptr, ref->key, t, obj_transform);
+        return;
+    }
+
+    SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(folderID, fileID);
+    if(isCulled(img_dims, obj_transform))
+        return;
+
+    // Transform the sprite by its own transform now.
+
+    float pivot_x_ratio = obj.pivot_x;
+    float pivot_y_ratio = obj.pivot_y;
+
+    // No image tweening
+    SCML_PAIR(float, float) img_pivot = getImagePivots(folderID, fileID);
+
+    // Rotate about the pivot point and draw from the center of the image.  The sine and cosine also go to draw_internal_affine().
+    float sprite_x, sprite_y, sin_angle, cos_angle;
+    place_image(obj_transform, SCML_PAIR_FIRST(img_pivot), SCML_PAIR_SECOND(img_pivot), pivot_x_ratio, pivot_y_ratio, img_dims, bone_transform_state.fixed_point, sprite_x, sprite_y, sin_angle, cos_angle);
+
+    // Let the renderer draw it
+    drawSprite(folderID, fileID, img_dims, sprite_x, sprite_y, obj_transform.angle, obj_transform.scale_x, obj_transform.scale_y, sin_angle, cos_angle);
+}
+
+
+bool Entity::evaluateObject(const Animation* animation_ptr, const Animation::Mainline::Key::Object_Ref* ref, int time, Bone_Transform_State::Object_Transform& result)
+{
+    // Only the pose that the bones were last rebuilt for is cached
+    Bone_Transform_State& state = bone_transform_state;
+    bool cache = (state.entity == entity && state.animation == animation && state.key == key && state.time == time
+                  && ref->timeline >= 0 && ref->timeline < (int)SCML_VECTOR_SIZE(state.objects));
+    if(cache && state.objects[ref->timeline].evaluated)
+    {
+        result = state.objects[ref->timeline];
+        return result.valid;
+    }
+
+    // Dereference object_ref and get the next one in the timeline for tweening
+    Animation::Timeline::Sample obj1, obj2;
+    float t;
+    Fixed fixed_t;
+    result.evaluated = true;
+    result.valid = (get_tween(animation_ptr, ref->timeline, ref->key, time, obj1, obj2, t, &fixed_t) && obj1.has_object && obj2.has_object);
+    if(result.valid && state.fixed_point)
+    {
+        // The same in fixed point, with the bones that were rebuilt in fixed point
+        Fixed_Transform obj_transform(obj1.transform);
+        if(fixed_t != 0)
+            obj_transform.lerp(Fixed_Transform(obj2.transform), fixed_t, obj1.spin);
+        state.blend(obj_transform, this, animation_ptr, ref->timeline);
+        obj_transform.apply_parent_transform(state.getFixedParent(ref->parent));
+        result.transform = obj_transform.toTransform();
+
+        Fixed pivot_x = Fixed_Transform::toFixed(obj1.pivot_x);
+        Fixed pivot_y = Fixed_Transform::toFixed(obj1.pivot_y);
+        result.t = t;
+        result.pivot_x = Fixed_Transform::toFloat(pivot_x + Fixed_Transform::mul(Fixed_Transform::toFixed(obj2.pivot_x) - pivot_x, fixed_t));
+        result.pivot_y = Fixed_Transform::toFloat(pivot_y + Fixed_Transform::mul(Fixed_Transform::toFixed(obj2.pivot_y) - pivot_y, fixed_t));
+        result.folder = obj1.folder;
+        result.file = obj1.file;
+    }
+    else if(result.valid)
+    {
+        // Get parent bone transform
+        Transform parent_transform;
+        if(ref->parent < 0)
+            parent_transform = state.base_transform;
+        else
+            parent_transform = state.transforms[ref->parent];
+
+        // Set object transform
+        result.transform = obj1.transform;
+
+        // Tween with next key's object
+        if(t != 0.0f)
+            result.transform.lerp(obj2.transform, t, obj1.spin);
+
+        state.blend(result.transform, this, animation_ptr, ref->timeline);
+
+        // Transform the object by the parent transform.
+        result.transform.apply_parent_transform(parent_transform);
+
+        result.t = t;
+        result.pivot_x = lerp(obj1.pivot_x, obj2.pivot_x, t);
+        result.pivot_y = lerp(obj1.pivot_y, obj2.pivot_y, t);
+        result.folder = obj1.folder;
+        result.file = obj1.file;
+    }
+
+    if(cache)
+        state.objects[ref->timeline] = result;
+    return result.valid;
+}
+
+void Entity::drawSubEntity(const Animation* animation_ptr, const Animation::Timeline* timeline_ptr, int key, float t, const Transform& obj_transform)
+{
+    if(m_data == NULL)
+        return;
+
+    Animation::Timeline::Key* key1 = SCML_MAP_FIND(timeline_ptr->keys, key);
+    if(key1 == NULL || !key1->has_object)
+        return;
+    Animation::Timeline::Key* key2 = SCML_MAP_FIND(timeline_ptr->keys, key+1);
+    if(key2 == NULL)
+        key2 = (animation_ptr->looping == "true"? SCML_MAP_FIND(timeline_ptr->keys, 0) : key1);
+
+    // The sub-entity's time is tweened too, unless the key switches to another one of its animations
+    const Animation::Timeline::Key::Object& obj1 = key1->object;
+    float sub_t = obj1.t;
+    if(key2 != NULL && key2->has_object && key2->object.entity == obj1.entity && key2->object.animation == obj1.animation)
+        sub_t = lerp(obj1.t, key2->object.t, t);
+
+    int num_sprites = 0;
+    const Pose_Cache::Sprite* sprites = m_data->getPoseCache()->getPose(obj1.entity, obj1.animation, sub_t, this, num_sprites);
+    if(sprites == NULL)
+        return;
+
+    for(int i = 0; i < num_sprites; i++)
+    {
+        int folderID = sprites[i].folder;
+        int fileID = sprites[i].file;
+        if(!getMappedImage(folderID, fileID))
+            continue;
+
+        Transform sprite_transform = sprites[i].transform;
+        if(bone_transform_state.fixed_point)
+        {
+            Fixed_Transform fixed_transform(sprite_transform);
+            fixed_transform.apply_parent_transform(Fixed_Transform(obj_transform));
+            sprite_transform = fixed_transform.toTransform();
+        }
+        else
+            sprite_transform.apply_parent_transform(obj_transform);
+        // Only culling needs the size, now or when a recorded sprite is drawn.  The character maps may have replaced the
+        // image that the cached pose was evaluated with.
+        SCML_PAIR(unsigned int, unsigned int) img_dims = SCML_MAKE_PAIR(0u, 0u);
+        if(lod_policy.min_pixel_size > 0.0f || m_recording_views)
+            img_dims = getImageDimensions(folderID, fileID);
+        if(isCulled(img_dims, sprite_transform))
+            continue;
+
+        // Only draw_internal_affine() needs the sine and cosine
+        float sin_angle = 0.0f;
+        float cos_angle = 1.0f;
+        if(affine_output && bone_transform_state.fixed_point)
+        {
+            Fixed angle = Fixed_Transform::toFixed(sprite_transform.angle);
+            sin_angle = Fixed_Transform::toFloat(Fixed_Transform::sin(angle));
+            cos_angle = Fixed_Transform::toFloat(Fixed_Transform::cos(angle));
+        }
+        else if(affine_output)
+        {
+            sin_angle = sinf(sprite_transform.angle*M_PI/180);
+            cos_angle = cosf(sprite_transform.angle*M_PI/180);
+        }
+        drawSprite(folderID, fileID, img_dims, sprite_transform.x, sprite_transform.y, sprite_transform.angle, sprite_transform.scale_x, sprite_transform.scale_y, sin_angle, cos_angle);
+    }
+}
+
+
+// Evaluates the poses of a Pose_Cache by drawing them into a list of sprites
+class Pose_Recorder : public Entity
+{
+public:
+
+    SCML_VECTOR(Pose_Cache::Sprite) sprites;
+    // The entity whose images are being drawn, for their dimensions
+    const Entity* source;
+    // Set while drawing, so that an entity that shows itself can't recurse
+    bool busy;
+
+    Pose_Recorder(SCML::Data* data, int entity)
+        : Entity(data, entity), source(NULL), busy(false)
+    {
+        // Sprites are culled when they are drawn in the end, at their real size
+        lod_policy = LOD_Policy();
+    }
 
-    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Animation*, item)
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const
     {
-        delete item;
+        return source->getImageDimensions(folderID, fileID);
     }
-    SCML_END_MAP_FOREACH_CONST;
-    animations.clear();
-}
 
-void Entity::startAnimation(int animation)
-{
-    this->animation = animation;
-    key = 0;
-    time = 0;
-}
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+    {
+        int i = SCML_VECTOR_SIZE(sprites);
+        SCML_VECTOR_RESIZE(sprites, i+1);
+        sprites[i].folder = folderID;
+        sprites[i].file = fileID;
+        sprites[i].transform = Transform(x, y, angle, scale_x, scale_y);
+        sprites[i].width = 0;
+        sprites[i].height = 0;
+    }
+};
 
-void Entity::startAnimation(const char* animationName)
+Pose_Cache::Pose_Cache(SCML::Data* data)
+    : max_sprites(65536), hits(0), misses(0), m_data(data)
+{}
+
+Pose_Cache::~Pose_Cache()
 {
-    SCML::Entity::Animation* animation_ptr = getAnimation(animationName);
-	if (animation_ptr == NULL) {
-		this->animation = -1;
-	} else {
-    	this->animation = animation_ptr->id;
+    SCML_BEGIN_MAP_FOREACH_CONST(m_recorders, int, Entity*, recorder)
+    {
+        delete recorder;
     }
-    key = 0;
-    time = 0;
+    SCML_END_MAP_FOREACH_CONST;
 }
 
-
-void Entity::update(int dt_ms)
+const Pose_Cache::Sprite* Pose_Cache::getPose(int entity, int animation, float t, const Entity* source, int& num_sprites)
 {
-    if(entity < 0 || animation < 0 || key < 0)
-        return;
+    num_sprites = 0;
 
-    SCML::Entity::Animation* animation_ptr = getAnimation(animation);
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(m_data->entities, entity);
+    if(entity_ptr == NULL)
+        return NULL;
+    SCML::Data::Entity::Animation* animation_ptr = SCML_MAP_FIND(entity_ptr->animations, animation);
     if(animation_ptr == NULL)
-        return;
-
-    time += dt_ms;
+        return NULL;
 
-    if(animation_ptr->looping == "true")
-    {
-        time %= animation_ptr->length;
-    }
-    else
+    int time = int(t*animation_ptr->length + 0.5f);
+    Pose_Key pose_key = SCML_MAKE_PAIR(SCML_MAKE_PAIR(entity, animation), SCML_MAKE_PAIR(time, source->fixed_point));
+    SCML_PAIR(int, int) pose = SCML_MAP_FIND(m_poses, pose_key);
+    if(SCML_PAIR_SECOND(pose) > 0)
     {
-        if(time > animation_ptr->length)
-            time = animation_ptr->length;
+        hits++;
+        num_sprites = SCML_PAIR_SECOND(pose);
+        return &m_sprites[SCML_PAIR_FIRST(pose)];
     }
 
-    for(key = 0; key+1 < (int)SCML_MAP_SIZE(animation_ptr->mainline.keys); key++)
+    Pose_Recorder* recorder = static_cast<Pose_Recorder*>(SCML_MAP_FIND(m_recorders, entity));
+    if(recorder == NULL)
     {
-        if(getKey(animation, key + 1)->time > time)
-            break;
+        recorder = new Pose_Recorder(m_data, entity);
+        SCML_MAP_INSERT(m_recorders, entity, recorder);
     }
+    if(recorder->busy)
+        return NULL;
+
+    misses++;
+    recorder->source = source;
+    recorder->fixed_point = source->fixed_point;
+    recorder->startAnimation(animation);
+    recorder->update(time);
+    SCML_VECTOR_CLEAR(recorder->sprites);
+    recorder->busy = true;
+    recorder->draw(0.0f, 0.0f);
+    recorder->busy = false;
+
+    int count = SCML_VECTOR_SIZE(recorder->sprites);
+    if(count == 0)
+        return NULL;
+    if((int)SCML_VECTOR_SIZE(m_sprites) + count > max_sprites)
+        clear();
+
+    int first = SCML_VECTOR_SIZE(m_sprites);
+    SCML_VECTOR_RESIZE(m_sprites, first + count);
+    for(int i = 0; i < count; i++)
+        m_sprites[first + i] = recorder->sprites[i];
+    SCML_MAP_INSERT(m_poses, pose_key, SCML_MAKE_PAIR(first, count));
+
+    num_sprites = count;
+    return &m_sprites[first];
+}
+
+void Pose_Cache::clear()
+{
+    m_poses.clear();
+    SCML_VECTOR_CLEAR(m_sprites);
 }
 
 
-inline float lerp(float a, float b, float t)
+
+
+Headless_Entity::Headless_Entity()
+    : Entity(), m_channel_bones_animation(-1), m_channel_bones_key(-1)
+{}
+
+Headless_Entity::Headless_Entity(SCML::Data* data, int entity, int animation, int key)
+    : Entity(data, entity, animation, key), m_channel_bones_animation(-1), m_channel_bones_key(-1)
 {
-    return a + (b-a)*t;
+    // Entity's constructor loads before this class is there to override load()
+    loadImageSizes(data);
 }
 
-// This is for rotating untranslated points and offsetting them to a new origin.
-static void rotate_point(float& x, float& y, float angle, float origin_x, float origin_y, bool flipped)
+void Headless_Entity::load(SCML::Data* data)
 {
-    float s = sinf(angle*M_PI/180);
-    float c = cosf(angle*M_PI/180);
-    float xnew = (x * c) - (y * s);
-    float ynew = (x * s) + (y * c);
-    xnew += origin_x;
-    ynew += origin_y;
+    Entity::load(data);
+    loadImageSizes(data);
+}
 
-    x = xnew;
-    y = ynew;
+void Headless_Entity::clear()
+{
+    Entity::clear();
+    m_image_sizes.clear();
+    SCML_VECTOR_CLEAR(m_bone_channels);
+    SCML_VECTOR_CLEAR(m_channel_bones);
+    m_channel_bones_animation = -1;
+    m_channel_bones_key = -1;
 }
 
-void Entity::draw(float x, float y, float angle, float scale_x, float scale_y)
+void Headless_Entity::loadImageSizes(SCML::Data* data)
 {
-    // Get key
-    Animation::Mainline::Key* key_ptr = getKey(animation, key);
-    if(key_ptr == NULL)
+    m_image_sizes.clear();
+    if(data == NULL)
         return;
 
-    convert_to_SCML_coords(x, y, angle);
-
-    int nextKeyID = getNextKeyID(animation, key);
-    Animation::Mainline::Key* nextkey_ptr = getKey(animation, nextKeyID);
-    if(nextkey_ptr == NULL)
-        nextkey_ptr = key_ptr;
-
-    // Build up the bone transform hierarchy
-    Transform base_transform(x, y, angle, scale_x, scale_y);
-    if(bone_transform_state.should_rebuild(entity, animation, key, time, base_transform))
-    {
-        bone_transform_state.rebuild(entity, animation, key, time, this, base_transform);
-    }
-
-
-    // Go through each object
-    SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->objects, int, Animation::Mainline::Key::Object_Container, item)
+    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, folder)
     {
-        if(item.hasObject())
-        {
-            draw_simple_object(item.object);
-        }
-        else
+        SCML_BEGIN_MAP_FOREACH_CONST(folder->files, int, SCML::Data::Folder::File*, file)
         {
-            draw_tweened_object(item.object_ref);
+            if(file->type == "image")
+                SCML_MAP_INSERT_ONLY(m_image_sizes, FolderFile_t(folder->id, file->id), SCML_MAKE_PAIR((unsigned int)file->width, (unsigned int)file->height));
         }
+        SCML_END_MAP_FOREACH_CONST;
     }
     SCML_END_MAP_FOREACH_CONST;
 }
 
-Entity::Pivot_t Entity::getImagePivots(int folder, int file) const
+SCML_PAIR(unsigned int, unsigned int) Headless_Entity::getImageDimensions(int folderID, int fileID) const
 {
-    return SCML_MAP_FIND(m_pivots, SCML_PAIR(int, int)(folder, file));
+    return SCML_MAP_FIND(m_image_sizes, FolderFile_t(folderID, fileID));
 }
 
-void Entity::draw_simple_object(Animation::Mainline::Key::Object* obj1)
+void Headless_Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+{}
+
+int Headless_Entity::getBoneHandle(const char* boneName) const
 {
-    // Get parent bone transform
-    Transform parent_transform;
+    return getChannel(boneName);
+}
 
-    if(obj1->parent < 0)
-        parent_transform = bone_transform_state.base_transform;
-    else
-        parent_transform = bone_transform_state.transforms[obj1->parent];
+void Headless_Entity::setBones(const int* handles, int num_handles)
+{
+    SCML_VECTOR_CLEAR(m_bone_channels);
+    if(handles != NULL)
+    {
+        int num_channels = getNumChannels();
+        SCML_VECTOR_RESIZE(m_bone_channels, num_channels);
+        for(int i = 0; i < num_channels; i++)
+            m_bone_channels[i] = 0;
+        for(int i = 0; i < num_handles; i++)
+        {
+            if(handles[i] >= 0 && handles[i] < num_channels)
+                m_bone_channels[handles[i]] = 1;
+        }
+    }
 
+    // The bones built for the old set may be missing some of the new one
+    bone_transform_state.entity = -1;
+}
 
-    // Set object transform
-    Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
+void Headless_Entity::evaluate(const Transform& base_transform)
+{
+    SCML_PROFILE_ZONE("Headless_Entity::evaluate", this);
 
-    // Transform the sprite by the parent transform.
-    obj_transform.apply_parent_transform(parent_transform);
+    Animation::Mainline::Key* key_ptr = evaluateBones(base_transform, (SCML_VECTOR_SIZE(m_bone_channels) > 0? &m_bone_channels : NULL));
 
+    // Which bone of the key each channel is only changes with the key
+    if(animation == m_channel_bones_animation && key == m_channel_bones_key)
+        return;
+    m_channel_bones_animation = animation;
+    m_channel_bones_key = key;
 
-    // Transform the sprite by its own transform now.
+    int num_channels = getNumChannels();
+    SCML_VECTOR_RESIZE(m_channel_bones, num_channels);
+    for(int i = 0; i < num_channels; i++)
+        m_channel_bones[i] = -1;
+    Animation* animation_ptr = getAnimation(animation);
+    if(key_ptr == NULL || animation_ptr == NULL)
+        return;
+    SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Animation::Mainline::Key::Bone_Container, item)
+    {
+        if(!item.hasBone_Ref())
+            continue;
+        int channel = get_channel(animation_ptr, item.bone_ref->timeline);
+        if(channel >= 0 && channel < num_channels)
+            m_channel_bones[channel] = item.bone_ref->id;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
 
-    float pivot_x_ratio = obj1->pivot_x;
-    float pivot_y_ratio = obj1->pivot_y;
+bool Headless_Entity::getBone(int handle, Transform& result) const
+{
+    if(handle < 0 || handle >= (int)SCML_VECTOR_SIZE(m_channel_bones))
+        return false;
+    int bone = m_channel_bones[handle];
+    const Bone_Transform_State& state = bone_transform_state;
+    if(bone < 0 || bone >= (int)SCML_VECTOR_SIZE(state.transforms))
+        return false;
+    if(state.partial && (bone >= (int)SCML_VECTOR_SIZE(state.needed_bones) || !state.needed_bones[bone]))
+        return false;
 
-    // No image tweening
-    SCML_PAIR(float, float) img_pivot = getImagePivots(obj1->folder, obj1->file);
-    SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(obj1->folder, obj1->file);
+    result = state.transforms[bone];
+    return true;
+}
 
-    // The origin
-    float origin_x = SCML_PAIR_FIRST(img_pivot) * img_dims.first;
-    float origin_y = (SCML_PAIR_SECOND(img_pivot) - 1.f) * img_dims.second;
 
-    // Rotate about the pivot point and draw from the center of the image
-    float offset_x = origin_x + (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-    float offset_y = origin_y + (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-    float sprite_x = -offset_x*obj_transform.scale_x;
-    float sprite_y = -offset_y*obj_transform.scale_y;
 
-    bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-    rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
 
-    // Let the renderer draw it
-    draw_internal(obj1->folder, obj1->file, sprite_x, sprite_y, obj_transform.angle, obj_transform.scale_x, obj_transform.scale_y);
+Schedule_Stats::Schedule_Stats()
+    : budget_us(0.0f), used_us(0.0f), num_evaluated(0), num_held(0), max_staleness(0), mean_staleness(0.0f)
+{
+    for(int i = 0; i < NUM_STALENESS_BUCKETS; i++)
+        staleness[i] = 0;
 }
 
+Update_Scheduler::Update_Scheduler(float budget_us)
+    : budget_us(budget_us), every_frame_priority(1.0f), max_staleness(30), m_next(0)
+{}
 
-void Entity::draw_tweened_object(Animation::Mainline::Key::Object_Ref* ref)
+int Update_Scheduler::add(Entity* entity, float priority)
 {
-    if(ref == NULL)
+    if(entity == NULL)
+        return -1;
+
+    int n = SCML_VECTOR_SIZE(m_entries);
+    SCML_VECTOR_RESIZE(m_entries, n + 1);
+    m_entries[n].entity = entity;
+    m_entries[n].priority = priority;
+    m_entries[n].staleness = -1;
+    entity->hold_pose = true;
+    return n;
+}
+
+void Update_Scheduler::remove(Entity* entity)
+{
+    int n = SCML_VECTOR_SIZE(m_entries);
+    for(int i = 0; i < n; i++)
+    {
+        if(m_entries[i].entity != entity)
+            continue;
+
+        entity->hold_pose = false;
+        for(int j = i; j+1 < n; j++)
+            m_entries[j] = m_entries[j+1];
+        SCML_VECTOR_RESIZE(m_entries, n - 1);
+        if(m_next > i)
+            m_next--;
+        if(m_next >= n - 1)
+            m_next = 0;
         return;
-    // Dereference object_ref and get the next one in the timeline for tweening
-    Animation* animation_ptr = getAnimation(animation);  // Need this only if looping...
-    Animation::Timeline::Key* t_key1 = getTimelineKey(animation, ref->timeline, ref->key);
-    Animation::Timeline::Key* t_key2 = getTimelineKey(animation, ref->timeline, ref->key+1);
-    if(t_key2 == NULL)
-        t_key2 = t_key1;
-    if(t_key1 == NULL || !t_key1->has_object || !t_key2->has_object)
-        return;
-
-    Animation::Timeline::Key::Object* obj1 = &t_key1->object;
-    Animation::Timeline::Key::Object* obj2 = &t_key2->object;
-    if(obj2 == NULL)
-        obj2 = obj1;
-    if(obj1 != NULL)
-    {
-        // Get interpolation (tweening) factor
-        float t = 0.0f;
-        if(t_key2->time > t_key1->time)
-            t = (time - t_key1->time)/float(t_key2->time - t_key1->time);
-        else if(t_key2->time < t_key1->time)
-            t = (time - t_key1->time)/float(animation_ptr->length - t_key1->time);
+    }
+}
 
-        // Get parent bone transform
-        Transform parent_transform;
-        if(ref->parent < 0)
-            parent_transform = bone_transform_state.base_transform;
-        else
-            parent_transform = bone_transform_state.transforms[ref->parent];
+void Update_Scheduler::clear()
+{
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(m_entries); i++)
+        m_entries[i].entity->hold_pose = false;
+    SCML_VECTOR_CLEAR(m_entries);
+    m_next = 0;
+}
 
-        // Set object transform
-        Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
+int Update_Scheduler::getNumEntities() const
+{
+    return SCML_VECTOR_SIZE(m_entries);
+}
 
-        // Tween with next key's object
-        obj_transform.lerp(Transform(obj2->x, obj2->y, obj2->angle, obj2->scale_x, obj2->scale_y), t, t_key1->spin);
+Entity* Update_Scheduler::getEntity(int index) const
+{
+    if(index < 0 || index >= (int)SCML_VECTOR_SIZE(m_entries))
+        return NULL;
+    return m_entries[index].entity;
+}
 
-        // Transform the sprite by the parent transform.
-        obj_transform.apply_parent_transform(parent_transform);
+void Update_Scheduler::setPriority(int index, float priority)
+{
+    if(index >= 0 && index < (int)SCML_VECTOR_SIZE(m_entries))
+        m_entries[index].priority = priority;
+}
 
+void Update_Scheduler::update(int dt_ms)
+{
+    SCML_PROFILE_ZONE("Update_Scheduler::update", this);
 
-        // Transform the sprite by its own transform now.
+    unsigned long long start = now_ns();
+    unsigned long long budget_ns = (unsigned long long)(budget_us > 0.0f? budget_us*1000.0f : 0.0f);
+    int n = SCML_VECTOR_SIZE(m_entries);
 
-        float pivot_x_ratio = lerp(obj1->pivot_x, obj2->pivot_x, t);
-        float pivot_y_ratio = lerp(obj1->pivot_y, obj2->pivot_y, t);
+    m_stats = Schedule_Stats();
+    m_stats.budget_us = budget_us;
 
-        // No image tweening
-        SCML_PAIR(float, float) img_pivot = getImagePivots(obj1->folder, obj1->file);
-        SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(obj1->folder, obj1->file);
+    // Every entity's time moves on, whether its pose does or not
+    for(int i = 0; i < n; i++)
+        m_entries[i].entity->update(dt_ms);
 
-        // The origin
-        float origin_x = SCML_PAIR_FIRST(img_pivot) * img_dims.first;
-        float origin_y = (SCML_PAIR_SECOND(img_pivot) - 1.f) * img_dims.second;
+    // The important entities, new ones, and ones that have held their pose for too long can't wait
+    for(int i = 0; i < n; i++)
+    {
+        Entry& entry = m_entries[i];
+        if(entry.priority >= every_frame_priority || entry.staleness < 0 || (max_staleness > 0 && entry.staleness >= max_staleness))
+        {
+            entry.entity->refreshPose();
+            entry.staleness = 0;
+            m_stats.num_evaluated++;
+        }
+        else
+            entry.staleness++;
+    }
 
-        // Rotate about the pivot point and draw from the center of the image
-        float offset_x = origin_x + (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-        float offset_y = origin_y + (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-        float sprite_x = -offset_x*obj_transform.scale_x;
-        float sprite_y = -offset_y*obj_transform.scale_y;
+    // The rest take turns while there is time left
+    for(int count = 0; count < n && now_ns() - start < budget_ns; count++)
+    {
+        Entry& entry = m_entries[m_next];
+        m_next = (m_next + 1) % n;
+        if(entry.staleness == 0)
+            continue;
 
-        bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-        rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
+        entry.entity->refreshPose();
+        entry.staleness = 0;
+        m_stats.num_evaluated++;
+    }
 
-        // Let the renderer draw it
-        draw_internal(obj1->folder, obj1->file, sprite_x, sprite_y, obj_transform.angle, obj_transform.scale_x, obj_transform.scale_y);
+    m_stats.num_held = n - m_stats.num_evaluated;
+    long total_staleness = 0;
+    for(int i = 0; i < n; i++)
+    {
+        int staleness = m_entries[i].staleness;
+        m_stats.staleness[staleness < Schedule_Stats::NUM_STALENESS_BUCKETS? staleness : Schedule_Stats::NUM_STALENESS_BUCKETS - 1]++;
+        if(staleness > m_stats.max_staleness)
+            m_stats.max_staleness = staleness;
+        total_staleness += staleness;
     }
+    m_stats.mean_staleness = (n > 0? total_staleness / float(n) : 0.0f);
+    m_stats.used_us = (now_ns() - start) / 1000.0f;
+}
+
+const Schedule_Stats& Update_Scheduler::getStats() const
+{
+    return m_stats;
 }
 
 
@@ -2841,11 +5896,195 @@ void Transform::apply_parent_transform(const Transform& parent)
     scale_y *= parent.scale_y;
 }
 
+Affine::Affine()
+    : xx(1.0f), xy(0.0f), tx(0.0f), yx(0.0f), yy(1.0f), ty(0.0f)
+{}
+
+Affine::Affine(float xx, float xy, float tx, float yx, float yy, float ty)
+    : xx(xx), xy(xy), tx(tx), yx(yx), yy(yy), ty(ty)
+{}
+
+Affine::Affine(const Transform& transform, float sin_angle, float cos_angle)
+    : xx(cos_angle*transform.scale_x), xy(-sin_angle*transform.scale_y), tx(transform.x)
+    , yx(sin_angle*transform.scale_x), yy(cos_angle*transform.scale_y), ty(transform.y)
+{}
+
+Affine::Affine(const Transform& transform)
+{
+    *this = Affine(transform, sinf(transform.angle*M_PI/180), cosf(transform.angle*M_PI/180));
+}
+
+void Affine::getCorners(float w, float h, float* corners) const
+{
+    float hw = w/2;
+    float hh = h/2;
+    // Bottom left, bottom right, top right, top left
+    float u[4] = {-hw, hw, hw, -hw};
+    float v[4] = {-hh, -hh, hh, hh};
+    for(int i = 0; i < 4; i++)
+    {
+        corners[2*i] = xx*u[i] + xy*v[i] + tx;
+        corners[2*i+1] = yx*u[i] + yy*v[i] + ty;
+    }
+}
+
+
+
+// sin(i*90/256 degrees) in 16.16, computed offline so that every platform has the same values
+static const Fixed sFixedSine[257] = {
+    0, 402, 804, 1206, 1608, 2010, 2412, 2814, 3216, 3617, 4019, 4420, 4821, 5222, 5623, 6023,
+    6424, 6824, 7224, 7623, 8022, 8421, 8820, 9218, 9616, 10014, 10411, 10808, 11204, 11600, 11996, 12391,
+    12785, 13180, 13573, 13966, 14359, 14751, 15143, 15534, 15924, 16314, 16703, 17091, 17479, 17867, 18253, 18639,
+    19024, 19409, 19792, 20175, 20557, 20939, 21320, 21699, 22078, 22457, 22834, 23210, 23586, 23961, 24335, 24708,
+    25080, 25451, 25821, 26190, 26558, 26925, 27291, 27656, 28020, 28383, 28745, 29106, 29466, 29824, 30182, 30538,
+    30893, 31248, 31600, 31952, 32303, 32652, 33000, 33347, 33692, 34037, 34380, 34721, 35062, 35401, 35738, 36075,
+    36410, 36744, 37076, 37407, 37736, 38064, 38391, 38716, 39040, 39362, 39683, 40002, 40320, 40636, 40951, 41264,
+    41576, 41886, 42194, 42501, 42806, 43110, 43412, 43713, 44011, 44308, 44604, 44898, 45190, 45480, 45769, 46056,
+    46341, 46624, 46906, 47186, 47464, 47741, 48015, 48288, 48559, 48828, 49095, 49361, 49624, 49886, 50146, 50404,
+    50660, 50914, 51166, 51417, 51665, 51911, 52156, 52398, 52639, 52878, 53114, 53349, 53581, 53812, 54040, 54267,
+    54491, 54714, 54934, 55152, 55368, 55582, 55794, 56004, 56212, 56418, 56621, 56823, 57022, 57219, 57414, 57607,
+    57798, 57986, 58172, 58356, 58538, 58718, 58896, 59071, 59244, 59415, 59583, 59750, 59914, 60075, 60235, 60392,
+    60547, 60700, 60851, 60999, 61145, 61288, 61429, 61568, 61705, 61839, 61971, 62101, 62228, 62353, 62476, 62596,
+    62714, 62830, 62943, 63054, 63162, 63268, 63372, 63473, 63572, 63668, 63763, 63854, 63944, 64031, 64115, 64197,
+    64277, 64354, 64429, 64501, 64571, 64639, 64704, 64766, 64827, 64884, 64940, 64993, 65043, 65091, 65137, 65180,
+    65220, 65259, 65294, 65328, 65358, 65387, 65413, 65436, 65457, 65476, 65492, 65505, 65516, 65525, 65531, 65535,
+    65536
+};
+
+
+Fixed_Transform::Fixed_Transform()
+    : x(0), y(0), angle(0), scale_x(65536), scale_y(65536)
+{}
+
+Fixed_Transform::Fixed_Transform(const Transform& transform)
+    : x(toFixed(transform.x)), y(toFixed(transform.y)), angle(toFixed(transform.angle)), scale_x(toFixed(transform.scale_x)), scale_y(toFixed(transform.scale_y))
+{}
+
+Transform Fixed_Transform::toTransform() const
+{
+    return Transform(toFloat(x), toFloat(y), toFloat(angle), toFloat(scale_x), toFloat(scale_y));
+}
+
+void Fixed_Transform::lerp(const Fixed_Transform& transform, Fixed t, int spin)
+{
+    x += mul(transform.x - x, t);
+    y += mul(transform.y - y, t);
+
+    // 'spin' is based on what you are coming from (key1)
+    if(spin != 0)
+    {
+        if(spin > 0 && angle > transform.angle)
+            angle += mul(transform.angle + sFixedTurn - angle, t);
+        else if(spin < 0 && angle < transform.angle)
+            angle += mul(transform.angle - sFixedTurn - angle, t);
+        else
+            angle += mul(transform.angle - angle, t);
+    }
+
+    scale_x += mul(transform.scale_x - scale_x, t);
+    scale_y += mul(transform.scale_y - scale_y, t);
+}
+
+void Fixed_Transform::apply_parent_transform(const Fixed_Transform& parent)
+{
+    x = mul(x, parent.scale_x);
+    y = mul(y, parent.scale_y);
+
+    Fixed s = sin(parent.angle);
+    Fixed c = cos(parent.angle);
+    Fixed xnew = mul(x, c) - mul(y, s) + parent.x;
+    Fixed ynew = mul(x, s) + mul(y, c) + parent.y;
+    x = xnew;
+    y = ynew;
+
+    angle += parent.angle;
+    scale_x = mul(scale_x, parent.scale_x);
+    scale_y = mul(scale_y, parent.scale_y);
+}
+
+Fixed Fixed_Transform::toFixed(float value)
+{
+    // Scaling by a power of two is exact, and so is truncating, so this doesn't depend on the FPU's rounding
+    return Fixed(value * 65536.0f);
+}
+
+float Fixed_Transform::toFloat(Fixed value)
+{
+    return value * (1.0f/65536);
+}
+
+Fixed Fixed_Transform::mul(Fixed a, Fixed b)
+{
+    // Every supported compiler shifts negative numbers arithmetically
+    return Fixed(((long long)a * b) >> 16);
+}
+
+Fixed Fixed_Transform::sin(Fixed degrees)
+{
+    // Reduce to [0, 360), then measure in 1024ths of a turn with 16 bits of fraction
+    Fixed reduced = degrees % sFixedTurn;
+    if(reduced < 0)
+        reduced += sFixedTurn;
+    long long steps = ((long long)reduced << 26) / sFixedTurn;
+
+    int index = int(steps >> 16);
+    Fixed fraction = Fixed(steps & 0xFFFF);
+    int quadrant = index >> 8;
+    int i = index & 255;
+
+    // The table covers the first quadrant.  The second runs it backward, and the last two are the first two negated.
+    Fixed value;
+    if(quadrant & 1)
+        value = sFixedSine[256 - i] - (((sFixedSine[256 - i] - sFixedSine[255 - i]) * fraction) >> 16);
+    else
+        value = sFixedSine[i] + (((sFixedSine[i + 1] - sFixedSine[i]) * fraction) >> 16);
+    return ((quadrant & 2)? -value : value);
+}
+
+Fixed Fixed_Transform::cos(Fixed degrees)
+{
+    return sin(degrees + sFixedTurn/4);
+}
+
+
+
+
+Entity::Crossfade::Crossfade()
+    : animation(-1), key(0), time(0), length(0), elapsed(0)
+{}
+
+float Entity::Crossfade::getWeight() const
+{
+    if(animation < 0 || length <= 0 || elapsed >= length)
+        return 0.0f;
+    return 1.0f - elapsed/float(length);
+}
+
+Fixed Entity::Crossfade::getFixedWeight() const
+{
+    if(animation < 0 || length <= 0 || elapsed >= length)
+        return 0;
+    return Fixed(((long long)(length - elapsed) << 16) / length);
+}
+
+Entity::Pose_Keys::Tween::Tween()
+    : from_time(0), to_time(0), spin(1), valid(false)
+{}
 
+Entity::Pose_Keys::Pose_Keys()
+    : animation(-1), key(-1)
+{}
 
+Entity::Layer::Layer(int animation, float weight)
+    : animation(animation), key(0), time(0), weight(weight), root(-1)
+{}
 
 Entity::Bone_Transform_State::Bone_Transform_State()
-    : entity(-1), animation(-1), key(-1), time(-1)
+    : entity(-1), animation(-1), key(-1), time(-1), fixed_point(false), partial(false), fade_weight(0.0f)
+{}
+
+Entity::Bone_Transform_State::Object_Transform::Object_Transform()
+    : t(0.0f), pivot_x(0.0f), pivot_y(0.0f), folder(-1), file(-1), evaluated(false), valid(false)
 {}
 
 bool Entity::Bone_Transform_State::should_rebuild(int entity, int animation, int key, int time, const Transform& base_transform)
@@ -2857,14 +6096,18 @@ bool Entity::Bone_Transform_State::should_rebuild(int entity, int animation, int
             this->base_transform != base_transform);
 }
 
-void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, int time, Entity* entity_ptr, const Transform& base_transform)
+void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, int time, Entity* entity_ptr, const Transform& base_transform, const SCML_VECTOR(char)* channels)
 {
+    SCML_PROFILE_ZONE("Bone_Transform_State::rebuild", entity_ptr);
+
     if(entity_ptr == NULL)
     {
         this->entity = -1;
         this->animation = -1;
         this->key = -1;
         this->time = -1;
+        fade_weight = 0.0f;
+        SCML_VECTOR_CLEAR(objects);
         return;
     }
 
@@ -2873,11 +6116,37 @@ void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, i
     this->key = key;
     this->time = time;
     this->base_transform = base_transform;
+    fixed_point = entity_ptr->fixed_point;
+    partial = (channels != NULL);
     SCML_VECTOR_CLEAR(transforms);
+    SCML_VECTOR_CLEAR(fixed_transforms);
+
+    // The faded-out pose and the layers are evaluated once here and blended into both the bones and the objects
+    fade_weight = entity_ptr->crossfade.getWeight();
+    if(fade_weight > 0.0f)
+    {
+        const Crossfade& fade = entity_ptr->crossfade;
+        if(!evaluate_pose(entity_ptr, fade.animation, fade.key, fade.time, fade_keys, fade_transforms, fade_channels, NULL))
+            fade_weight = 0.0f;
+    }
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entity_ptr->layers); i++)
+    {
+        Layer* layer = entity_ptr->layers[i];
+        if(layer->weight > 0.0f)
+            evaluate_pose(entity_ptr, layer->animation, layer->key, layer->time, layer->keys, layer->transforms, layer->channels, &layer->mask);
+    }
 
     Entity::Animation::Mainline::Key* key_ptr = entity_ptr->getKey(animation, key);
     // FIXME: Check key_ptr == NULL here?
 
+    // The objects are evaluated when draw() or a query first gets to them.  Sized by the animation, not the key, so it
+    // doesn't grow again in the middle of the animation.
+    Entity::Animation* animation_ptr = entity_ptr->getAnimation(animation);
+    int num_timelines = (animation_ptr != NULL? SCML_MAP_SIZE(animation_ptr->timelines) : 0);
+    SCML_VECTOR_RESIZE(objects, num_timelines);
+    for(int i = 0; i < num_timelines; i++)
+        objects[i].evaluated = false;
+
     // Resize the transform vector according to the biggest bone index
     int max_index = -1;
     SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Animation::Mainline::Key::Bone_Container, item)
@@ -2897,32 +6166,72 @@ void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, i
         return;
 
     SCML_VECTOR_RESIZE(transforms, max_index+1);
+    if(fixed_point)
+        SCML_VECTOR_RESIZE(fixed_transforms, max_index+1);
 
-    Entity::Animation* animation_ptr = entity_ptr->getAnimation(animation);
+    // For a partial pose, find the bones on the channels asked for
+    if(partial)
+    {
+        SCML_VECTOR_RESIZE(needed_bones, max_index+1);
+        SCML_VECTOR_RESIZE(bone_parents, max_index+1);
+        for(int i = 0; i <= max_index; i++)
+        {
+            needed_bones[i] = 0;
+            bone_parents[i] = -1;
+        }
+        SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Animation::Mainline::Key::Bone_Container, item)
+        {
+            if(item.hasBone_Ref())
+            {
+                int channel = get_channel(animation_ptr, item.bone_ref->timeline);
+                needed_bones[item.bone_ref->id] = (channel >= 0 && channel < (int)SCML_VECTOR_SIZE(*channels) && (*channels)[channel]);
+                bone_parents[item.bone_ref->id] = item.bone_ref->parent;
+            }
+            else if(item.hasBone())
+                bone_parents[item.bone->id] = item.bone->parent;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+
+        // And the bones above them.  Parents come before their children, so one pass from the end reaches them all.
+        for(int i = max_index; i >= 0; i--)
+        {
+            if(needed_bones[i] && bone_parents[i] >= 0)
+                needed_bones[bone_parents[i]] = 1;
+        }
+    }
 
     // Calculate and store the transforms
     SCML_BEGIN_MAP_FOREACH_CONST(key_ptr->bones, int, Animation::Mainline::Key::Bone_Container, item)
     {
+        if(partial)
+        {
+            int id = (item.hasBone_Ref()? item.bone_ref->id : (item.hasBone()? item.bone->id : -1));
+            if(id < 0 || !needed_bones[id])
+                continue;
+        }
+
         if(item.hasBone_Ref())
         {
             Animation::Mainline::Key::Bone_Ref* ref = item.bone_ref;
 
             // Dereference bone_refs
-            Animation::Timeline::Key* b_key1 = entity_ptr->getTimelineKey(animation, ref->timeline, ref->key);
-            Animation::Timeline::Key* b_key2 = entity_ptr->getTimelineKey(animation, ref->timeline, ref->key+1);
-            if(b_key2 == NULL)
-                b_key2 = b_key1;
-            if(b_key1 != NULL)
+            Animation::Timeline::Sample b_key1, b_key2;
+            float t;
+            Fixed fixed_t;
+            if(fixed_point && get_tween(animation_ptr, ref->timeline, ref->key, time, b_key1, b_key2, t, &fixed_t))
+            {
+                // The same in fixed point
+                Fixed_Transform b_transform(b_key1.transform);
+                if(fixed_t != 0)
+                    b_transform.lerp(Fixed_Transform(b_key2.transform), fixed_t, b_key1.spin);
+                blend(b_transform, entity_ptr, animation_ptr, ref->timeline);
+                b_transform.apply_parent_transform(getFixedParent(ref->parent));
+
+                fixed_transforms[ref->id] = b_transform;
+                transforms[ref->id] = b_transform.toTransform();
+            }
+            else if(!fixed_point && get_tween(animation_ptr, ref->timeline, ref->key, time, b_key1, b_key2, t))
             {
-                float t = 0.0f;
-                if(b_key2->time > b_key1->time)
-                    t = (time - b_key1->time)/float(b_key2->time - b_key1->time);
-                else if(b_key2->time < b_key1->time)
-                    t = (time - b_key1->time)/float(animation_ptr->length - b_key1->time);
-
-                Entity::Animation::Timeline::Key::Bone* bone1 = &b_key1->bone;
-                Entity::Animation::Timeline::Key::Bone* bone2 = &b_key2->bone;
-
                 // Assuming that bones come in hierarchical order so that the parents have already been processed.
                 Transform parent_transform;
                 if(ref->parent < 0)
@@ -2931,10 +6240,13 @@ void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, i
                     parent_transform = transforms[ref->parent];
 
                 // Set bone transform
-                Transform b_transform(bone1->x, bone1->y, bone1->angle, bone1->scale_x, bone1->scale_y);
+                Transform b_transform = b_key1.transform;
 
                 // Tween with next key's bone
-                b_transform.lerp(Transform(bone2->x, bone2->y, bone2->angle, bone2->scale_x, bone2->scale_y), t, b_key1->spin);
+                if(t != 0.0f)
+                    b_transform.lerp(b_key2.transform, t, b_key1.spin);
+
+                blend(b_transform, entity_ptr, animation_ptr, ref->timeline);
 
                 // Transform the bone by the parent transform.
                 b_transform.apply_parent_transform(parent_transform);
@@ -2948,6 +6260,16 @@ void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, i
         {
             Animation::Mainline::Key::Bone* bone1 = item.bone;
 
+            if(fixed_point)
+            {
+                Fixed_Transform b_transform(Transform(bone1->x, bone1->y, bone1->angle, bone1->scale_x, bone1->scale_y));
+                b_transform.apply_parent_transform(getFixedParent(bone1->parent));
+
+                fixed_transforms[bone1->id] = b_transform;
+                transforms[bone1->id] = b_transform.toTransform();
+                continue;
+            }
+
             // Assuming that bones come in hierarchical order so that the parents have already been processed.
             Transform parent_transform;
             if(bone1->parent < 0)
@@ -2969,36 +6291,293 @@ void Entity::Bone_Transform_State::rebuild(int entity, int animation, int key, i
 
 }
 
+void Entity::Bone_Transform_State::blend(Transform& local, const Entity* entity_ptr, const Entity::Animation* animation_ptr, int timeline) const
+{
+    int channel = get_channel(animation_ptr, timeline);
+    if(channel < 0)
+        return;
+
+    if(fade_weight > 0.0f && channel < (int)SCML_VECTOR_SIZE(fade_channels) && fade_channels[channel])
+        blend_toward(local, fade_transforms[channel], fade_weight);
+
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entity_ptr->layers); i++)
+    {
+        const Layer* layer = entity_ptr->layers[i];
+        if(layer->weight > 0.0f && channel < (int)SCML_VECTOR_SIZE(layer->channels) && layer->channels[channel])
+            blend_toward(local, layer->transforms[channel], layer->weight);
+    }
+}
+
+void Entity::Bone_Transform_State::blend(Fixed_Transform& local, const Entity* entity_ptr, const Entity::Animation* animation_ptr, int timeline) const
+{
+    int channel = get_channel(animation_ptr, timeline);
+    if(channel < 0)
+        return;
 
+    if(fade_weight > 0.0f && channel < (int)SCML_VECTOR_SIZE(fade_channels) && fade_channels[channel])
+        blend_toward(local, Fixed_Transform(fade_transforms[channel]), entity_ptr->crossfade.getFixedWeight());
 
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(entity_ptr->layers); i++)
+    {
+        const Layer* layer = entity_ptr->layers[i];
+        if(layer->weight > 0.0f && channel < (int)SCML_VECTOR_SIZE(layer->channels) && layer->channels[channel])
+            blend_toward(local, Fixed_Transform(layer->transforms[channel]), Fixed_Transform::toFixed(layer->weight));
+    }
+}
 
-Entity::Animation::Animation(SCML::Data::Entity::Animation* animation)
-    : id(animation->id), name(animation->name), length(animation->length), looping(animation->looping), loop_to(animation->loop_to)
-    , mainline(&animation->mainline)
+Fixed_Transform Entity::Bone_Transform_State::getFixedParent(int parent) const
 {
-    SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, SCML::Data::Entity::Animation::Timeline*, item)
+    // Assuming that bones come in hierarchical order so that the parents have already been processed.
+    if(parent < 0)
+        return Fixed_Transform(base_transform);
+    return fixed_transforms[parent];
+}
+
+
+
+
+static void add_trigger_keys(const SCML::Data::Entity::Animation::Timeline* line, int type, SCML_VECTOR(Entity::Animation::Trigger)& triggers, SCML_VECTOR(SCML_STRING)& names)
+{
+    int name = SCML_VECTOR_SIZE(names);
+    SCML_VECTOR_RESIZE(names, name + 1);
+    names[name] = line->name;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(line->keys, int, SCML::Data::Entity::Animation::Timeline::Key*, item)
+    {
+        int n = SCML_VECTOR_SIZE(triggers);
+        SCML_VECTOR_RESIZE(triggers, n + 1);
+        Entity::Animation::Trigger& trigger = triggers[n];
+        trigger.time = item->time;
+        trigger.type = type;
+        trigger.name = name;
+        if(type == Entity::Animation::Trigger::SOUND)
+        {
+            trigger.folder = item->object.folder;
+            trigger.file = item->object.file;
+            trigger.volume = item->object.volume;
+            trigger.panning = item->object.panning;
+        }
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+static void add_triggers(const SCML_MAP(int, SCML::Data::Entity::Animation::Timeline*)& lines, int type, SCML_VECTOR(Entity::Animation::Trigger)& triggers, SCML_VECTOR(SCML_STRING)& names)
+{
+    SCML_BEGIN_MAP_FOREACH_CONST(lines, int, SCML::Data::Entity::Animation::Timeline*, item)
+    {
+        add_trigger_keys(item, type, triggers, names);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+static bool trigger_is_earlier(const Entity::Animation::Trigger& a, const Entity::Animation::Trigger& b)
+{
+    return a.time < b.time;
+}
+
+static int get_curve_type(const SCML_STRING& curve_type)
+{
+    if(curve_type == "instant")
+        return Entity::Animation::Varline::INSTANT;
+    if(curve_type == "quadratic")
+        return Entity::Animation::Varline::QUADRATIC;
+    if(curve_type == "cubic")
+        return Entity::Animation::Varline::CUBIC;
+    return Entity::Animation::Varline::LINEAR;
+}
+
+// Gives each variable in the keys of a timeline a varline of its own
+static void add_varlines(const SCML::Data::Entity::Animation::Timeline* timeline, SCML_VECTOR(Entity::Animation::Varline*)& varlines)
+{
+    int first = SCML_VECTOR_SIZE(varlines);
+    SCML_BEGIN_MAP_FOREACH_CONST(timeline->keys, int, SCML::Data::Entity::Animation::Timeline::Key*, key)
     {
-        SCML_MAP_INSERT_ONLY(timelines, item->id, new Timeline(item));
+        const SCML::Data::Meta_Data_Tweenable* variables = get_key_variables(key);
+        if(variables == NULL)
+            continue;
+        SCML_BEGIN_MAP_FOREACH_CONST(variables->variables, SCML_STRING, SCML::Data::Meta_Data_Tweenable::Variable*, variable)
+        {
+            int i = first;
+            while(i < (int)SCML_VECTOR_SIZE(varlines) && varlines[i]->name != variable->name)
+                i++;
+            if(i == (int)SCML_VECTOR_SIZE(varlines))
+            {
+                Entity::Animation::Varline* varline = new Entity::Animation::Varline;
+                varline->name = variable->name;
+                varline->timeline = timeline->id;
+                if(variable->type == "int")
+                    varline->type = Entity::Animation::Varline::INT;
+                else if(variable->type == "float")
+                    varline->type = Entity::Animation::Varline::FLOAT;
+                SCML_VECTOR_RESIZE(varlines, i + 1);
+                varlines[i] = varline;
+            }
+
+            SCML_VECTOR(Entity::Animation::Varline::Key)& var_keys = varlines[i]->keys;
+            int n = SCML_VECTOR_SIZE(var_keys);
+            SCML_VECTOR_RESIZE(var_keys, n + 1);
+            Entity::Animation::Varline::Key& var_key = var_keys[n];
+            var_key.time = key->time;
+            var_key.curve_type = get_curve_type(variable->curve_type);
+            var_key.c1 = variable->c1;
+            var_key.c2 = variable->c2;
+            var_key.value_int = variable->value_int;
+            var_key.value_float = (varlines[i]->type == Entity::Animation::Varline::INT? variable->value_int : variable->value_float);
+            var_key.value_string = variable->value_string;
+        }
+        SCML_END_MAP_FOREACH_CONST;
     }
     SCML_END_MAP_FOREACH_CONST;
 }
 
+Entity::Animation::Animation(SCML::Data::Entity::Animation* animation, bool quantize_keys)
+    : id(animation->id), name(animation->name), length(animation->length), looping(animation->looping), loop_to(animation->loop_to)
+    , loaded(false), is_static(false)
+{
+    load(animation, quantize_keys);
+}
+
 Entity::Animation::~Animation(){
     clear();
 }
 
+void Entity::Animation::load(SCML::Data::Entity::Animation* animation, bool quantize_keys)
+{
+    clear();
+
+    mainline.load(&animation->mainline);
+    SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, SCML::Data::Entity::Animation::Timeline*, item)
+    {
+        Timeline* timeline = new Timeline(item, quantize_keys);
+        SCML_MAP_INSERT_ONLY(timelines, item->id, timeline);
+        timeline_names.insert(SCML_TO_CSTRING(timeline->name), timeline->id);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    // The trigger index.  Sound timelines (from older files) fire a sound at each key, like soundlines.
+    add_triggers(animation->eventlines, Trigger::EVENT, triggers, trigger_names);
+    add_triggers(animation->soundlines, Trigger::SOUND, triggers, trigger_names);
+    SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, SCML::Data::Entity::Animation::Timeline*, item)
+    {
+        if(item->object_type == "sound")
+            add_trigger_keys(item, Trigger::SOUND, triggers, trigger_names);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    if(SCML_VECTOR_SIZE(triggers) > 1)
+        std::stable_sort(&triggers[0], &triggers[0] + SCML_VECTOR_SIZE(triggers), trigger_is_earlier);
+
+    // Variables are kept apart from the timeline keys, so they survive quantization
+    SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, SCML::Data::Entity::Animation::Timeline*, item)
+    {
+        add_varlines(item, varlines);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    is_static = (SCML_MAP_SIZE(mainline.keys) <= 1);
+    SCML_BEGIN_MAP_FOREACH_CONST(timelines, int, Timeline*, timeline)
+    {
+        if(timeline->getNumKeys() > 1)
+            is_static = false;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    loaded = (animation->deferred < 0);
+}
+
 void Entity::Animation::clear()
 {
+    mainline.clear();
+
     SCML_BEGIN_MAP_FOREACH_CONST(timelines, int, Timeline*, item)
     {
         delete item;
     }
     SCML_END_MAP_FOREACH_CONST;
     timelines.clear();
+    timeline_names.clear();
+    SCML_VECTOR_CLEAR(timeline_channels);
+    SCML_VECTOR_CLEAR(triggers);
+    SCML_VECTOR_CLEAR(trigger_names);
+
+    for(unsigned int i = 0; i < SCML_VECTOR_SIZE(varlines); i++)
+        delete varlines[i];
+    SCML_VECTOR_CLEAR(varlines);
+    SCML_VECTOR_CLEAR(variable_varlines);
+}
+
+int Entity::Animation::getTimelineID(const char* timelineName) const
+{
+    return timeline_names.find(timelineName);
+}
+
+int Entity::Animation::findTrigger(int time) const
+{
+    int low = 0;
+    int high = SCML_VECTOR_SIZE(triggers);
+    while(low < high)
+    {
+        int mid = low + (high - low)/2;
+        if(triggers[mid].time < time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+const char* Entity::Animation::getTriggerName(const Trigger& trigger) const
+{
+    return SCML_TO_CSTRING(trigger_names[trigger.name]);
+}
+
+Entity::Animation::Trigger::Trigger()
+    : time(0), type(EVENT), name(0), folder(-1), file(-1), volume(1.0f), panning(0.0f)
+{}
+
+Entity::Animation::Varline::Varline()
+    : timeline(-1), type(STRING), cursor(0)
+{}
+
+Entity::Animation::Varline::Key::Key()
+    : time(0), curve_type(LINEAR), c1(0.0f), c2(0.0f), value_int(0), value_float(0.0f)
+{}
+
+int Entity::Animation::Varline::findKey(int time) const
+{
+    int num_keys = SCML_VECTOR_SIZE(keys);
+
+    // Playing forward, the key is the one from last time or one soon after it
+    if(cursor < num_keys && keys[cursor].time <= time)
+    {
+        while(cursor+1 < num_keys && keys[cursor+1].time <= time)
+            cursor++;
+        return cursor;
+    }
+
+    int low = 0;
+    int high = num_keys;
+    while(low < high)
+    {
+        int mid = low + (high - low)/2;
+        if(keys[mid].time <= time)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    cursor = (low > 0? low - 1 : 0);
+    return low - 1;
 }
 
 
+Entity::Animation::Mainline::Mainline()
+{}
+
 Entity::Animation::Mainline::Mainline(SCML::Data::Entity::Animation::Mainline* mainline)
+{
+    load(mainline);
+}
+
+void Entity::Animation::Mainline::load(SCML::Data::Entity::Animation::Mainline* mainline)
 {
     SCML_BEGIN_MAP_FOREACH_CONST(mainline->keys, int, SCML::Data::Entity::Animation::Mainline::Key*, item)
     {
@@ -3023,7 +6602,7 @@ void Entity::Animation::Mainline::clear()
 
 
 Entity::Animation::Mainline::Key::Key(SCML::Data::Entity::Animation::Mainline::Key* key)
-    : id(key->id), time(key->time)
+    : id(key->id), time(key->time), tags(key->tags)
 {
     // Load bones and objects
     SCML_BEGIN_MAP_FOREACH_CONST(key->bones, int, SCML::Data::Entity::Animation::Mainline::Key::Bone_Container, item)
@@ -3123,9 +6702,19 @@ void Entity::Animation::Mainline::Key::Object_Ref::clear()
 {}
 
 
-Entity::Animation::Timeline::Timeline(SCML::Data::Entity::Animation::Timeline* timeline)
+Entity::Animation::Timeline::Timeline(SCML::Data::Entity::Animation::Timeline* timeline, bool quantize)
     : id(timeline->id), name(timeline->name), object_type(timeline->object_type), variable_type(timeline->variable_type), usage(timeline->usage)
+    , sub_entity(timeline->object_type == "entity"), packed(NULL)
 {
+    if(quantize && !sub_entity)
+    {
+        packed = new Packed_Keys;
+        if(packed->pack(timeline))
+            return;
+        delete packed;
+        packed = NULL;
+    }
+
     SCML_BEGIN_MAP_FOREACH_CONST(timeline->keys, int, SCML::Data::Entity::Animation::Timeline::Key*, item)
     {
         SCML_MAP_INSERT_ONLY(keys, item->id, new Key(item));
@@ -3145,6 +6734,190 @@ void Entity::Animation::Timeline::clear()
     }
     SCML_END_MAP_FOREACH_CONST;
     keys.clear();
+
+    delete packed;
+    packed = NULL;
+}
+
+int Entity::Animation::Timeline::getNumKeys() const
+{
+    if(packed != NULL)
+        return packed->num_keys;
+    return SCML_MAP_SIZE(keys);
+}
+
+bool Entity::Animation::Timeline::getSample(int key, bool looping, Sample& sample) const
+{
+    if(key < 0)
+        return false;
+
+    if(packed != NULL)
+    {
+        if(key >= packed->num_keys)
+        {
+            if(!looping)
+                return false;
+            key = 0;
+        }
+
+        sample.time = packed->times[key];
+        sample.spin = (int)packed->get(Packed_Keys::SPIN, key);
+        sample.has_object = packed->has_object;
+        sample.folder = (int)packed->get(Packed_Keys::FOLDER, key);
+        sample.file = (int)packed->get(Packed_Keys::FILE, key);
+        sample.transform = Transform(packed->get(Packed_Keys::X, key), packed->get(Packed_Keys::Y, key), packed->get(Packed_Keys::ANGLE, key),
+                                     packed->get(Packed_Keys::SCALE_X, key), packed->get(Packed_Keys::SCALE_Y, key));
+        sample.pivot_x = packed->get(Packed_Keys::PIVOT_X, key);
+        sample.pivot_y = packed->get(Packed_Keys::PIVOT_Y, key);
+        return true;
+    }
+
+    int no_keys = SCML_MAP_SIZE(keys);
+    Key* k = NULL;
+    if(key < no_keys)
+        k = SCML_MAP_FIND(keys, key);
+    else if(looping)
+        k = SCML_MAP_FIND(keys, 0);
+    if(k == NULL)
+        return false;
+
+    sample.time = k->time;
+    sample.spin = k->spin;
+    sample.has_object = k->has_object;
+    if(k->has_object)
+    {
+        sample.folder = k->object.folder;
+        sample.file = k->object.file;
+        sample.transform = Transform(k->object.x, k->object.y, k->object.angle, k->object.scale_x, k->object.scale_y);
+        sample.pivot_x = k->object.pivot_x;
+        sample.pivot_y = k->object.pivot_y;
+    }
+    else
+    {
+        sample.folder = -1;
+        sample.file = -1;
+        sample.transform = Transform(k->bone.x, k->bone.y, k->bone.angle, k->bone.scale_x, k->bone.scale_y);
+        sample.pivot_x = 0.0f;
+        sample.pivot_y = 0.0f;
+    }
+    return true;
+}
+
+
+Entity::Animation::Timeline::Packed_Keys::Channel::Channel()
+    : lowest(0.0f), step(0.0f), offset(0)
+{}
+
+Entity::Animation::Timeline::Packed_Keys::Packed_Keys()
+    : num_keys(0), has_object(false)
+{}
+
+bool Entity::Animation::Timeline::Packed_Keys::pack(SCML::Data::Entity::Animation::Timeline* timeline)
+{
+    num_keys = SCML_MAP_SIZE(timeline->keys);
+    if(num_keys == 0)
+        return false;
+
+    // Gather the values of each channel in a row
+    SCML_VECTOR(float) raw;
+    SCML_VECTOR_RESIZE(raw, NUM_CHANNELS*num_keys);
+    SCML_VECTOR_RESIZE(times, num_keys);
+    int i = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(timeline->keys, int, SCML::Data::Entity::Animation::Timeline::Key*, item)
+    {
+        if(item->id != i)
+            return false;
+        if(i == 0)
+            has_object = item->has_object;
+        else if(item->has_object != has_object)
+            return false;
+
+        times[i] = item->time;
+        raw[SPIN*num_keys + i] = (float)item->spin;
+        if(has_object)
+        {
+            const SCML::Data::Entity::Animation::Timeline::Key::Object& obj = item->object;
+            raw[X*num_keys + i] = obj.x;
+            raw[Y*num_keys + i] = obj.y;
+            raw[ANGLE*num_keys + i] = obj.angle;
+            raw[SCALE_X*num_keys + i] = obj.scale_x;
+            raw[SCALE_Y*num_keys + i] = obj.scale_y;
+            raw[PIVOT_X*num_keys + i] = obj.pivot_x;
+            raw[PIVOT_Y*num_keys + i] = obj.pivot_y;
+            raw[FOLDER*num_keys + i] = (float)obj.folder;
+            raw[FILE*num_keys + i] = (float)obj.file;
+        }
+        else
+        {
+            const SCML::Data::Entity::Animation::Timeline::Key::Bone& bone = item->bone;
+            raw[X*num_keys + i] = bone.x;
+            raw[Y*num_keys + i] = bone.y;
+            raw[ANGLE*num_keys + i] = bone.angle;
+            raw[SCALE_X*num_keys + i] = bone.scale_x;
+            raw[SCALE_Y*num_keys + i] = bone.scale_y;
+            raw[PIVOT_X*num_keys + i] = 0.0f;
+            raw[PIVOT_Y*num_keys + i] = 0.0f;
+            raw[FOLDER*num_keys + i] = -1.0f;
+            raw[FILE*num_keys + i] = -1.0f;
+        }
+        i++;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    // Lay out the channels that change.  Images and spins are counted in whole steps so they come back exactly.
+    int num_values = 0;
+    for(int c = 0; c < NUM_CHANNELS; c++)
+    {
+        const float* v = &raw[c*num_keys];
+        float lowest = v[0];
+        float highest = v[0];
+        for(int k = 1; k < num_keys; k++)
+        {
+            if(v[k] < lowest)
+                lowest = v[k];
+            if(v[k] > highest)
+                highest = v[k];
+        }
+
+        Channel& channel = channels[c];
+        channel.lowest = lowest;
+        channel.step = 0.0f;
+        channel.offset = 0;
+        if(highest == lowest)
+            continue;
+
+        if(c >= FOLDER)
+        {
+            if(highest - lowest > 65535.0f)
+                return false;
+            channel.step = 1.0f;
+        }
+        else
+            channel.step = (highest - lowest)/65535.0f;
+        channel.offset = num_values;
+        num_values += num_keys;
+    }
+
+    SCML_VECTOR_RESIZE(values, num_values);
+    for(int c = 0; c < NUM_CHANNELS; c++)
+    {
+        const Channel& channel = channels[c];
+        if(channel.step == 0.0f)
+            continue;
+        for(int k = 0; k < num_keys; k++)
+        {
+            float q = (raw[c*num_keys + k] - channel.lowest)/channel.step + 0.5f;
+            values[channel.offset + k] = (unsigned short)(q < 65535.0f? q : 65535.0f);
+        }
+    }
+    return true;
+}
+
+float Entity::Animation::Timeline::Packed_Keys::getMaxError(int channel) const
+{
+    if(channel >= FOLDER)
+        return 0.0f;
+    return channels[channel].step*0.5f;
 }
 
 
@@ -3178,7 +6951,7 @@ Entity::Animation::Timeline::Key::Object::Object(SCML::Data::Entity::Animation::
     , x(object->x), y(object->y), pivot_x(object->pivot_x), pivot_y(object->pivot_y), angle(object->angle)
     , w(object->w), h(object->h), scale_x(object->scale_x), scale_y(object->scale_y), r(object->r), g(object->g), b(object->b), a(object->a)
     , blend_mode(object->blend_mode), value_string(object->value_string), value_int(object->value_int), min_int(object->min_int), max_int(object->max_int)
-    , value_float(object->value_float), min_float(object->min_float), max_float(object->max_float), animation(object->animation), t(object->t)
+    , value_float(object->value_float), min_float(object->min_float), max_float(object->max_float), entity(object->entity), animation(object->animation), t(object->t)
     , volume(object->volume), panning(object->panning)
 {
 
@@ -3206,15 +6979,15 @@ Entity::Animation* Entity::getAnimation(int animation) const
 
 Entity::Animation* Entity::getAnimation(const char* animationName) const
 {
-    SCML_BEGIN_MAP_FOREACH_CONST(animations, int, Entity::Animation*, anim_ptr)
-    {
-    	if (std::strcmp( anim_ptr->name.c_str(), animationName ) == 0)
-    	{
-    		return anim_ptr;
-    	}
-    }
-    SCML_END_MAP_FOREACH_CONST;
-    return NULL;
+    int id = animation_names.find(animationName);
+    if(id < 0)
+        return NULL;
+    return SCML_MAP_FIND(animations, id);
+}
+
+int Entity::getAnimationID(const char* animationName) const
+{
+    return animation_names.find(animationName);
 }
 
 Entity::Animation::Mainline::Key* Entity::getKey(int animation, int key) const
@@ -3373,6 +7146,16 @@ int Entity::getNumObjects() const
     return SCML_MAP_SIZE(key_ptr->objects);
 }
 
+void Entity::placeQueryResult(Transform& result) const
+{
+    // A sleeping or held pose is evaluated at the rotation and scale it is drawn with, and moved to where it is drawn
+    if(m_pose_kept)
+    {
+        result.x += m_sleep_transform.x;
+        result.y += m_sleep_transform.y;
+    }
+}
+
 bool Entity::getBoneTransform(Transform& result, int boneID)
 {
     // Get key
@@ -3387,6 +7170,8 @@ bool Entity::getBoneTransform(Transform& result, int boneID)
         // Get bone transform
         result = bone_transform_state.transforms[item.bone->id];
 
+        placeQueryResult(result);
+
         // FIXME: Actually the inverse conversion...
         convert_to_SCML_coords(result.x, result.y, result.angle);
         return true;
@@ -3396,6 +7181,8 @@ bool Entity::getBoneTransform(Transform& result, int boneID)
         // Get bone transform
         result = bone_transform_state.transforms[item.bone_ref->id];
 
+        placeQueryResult(result);
+
         // FIXME: Actually the inverse conversion...
         convert_to_SCML_coords(result.x, result.y, result.angle);
         return true;
@@ -3430,20 +7217,8 @@ bool Entity::getSimpleObjectTransform(Transform& result, SCML::Entity::Animation
     if(obj1 == NULL)
         return false;
 
-    // Get parent bone transform
-    Transform parent_transform;
-
-    if(obj1->parent < 0)
-        parent_transform = bone_transform_state.base_transform;
-    else
-        parent_transform = bone_transform_state.transforms[obj1->parent];
-
-
-    // Set object transform
-    Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
-
-    // Transform the sprite by the parent transform.
-    obj_transform.apply_parent_transform(parent_transform);
+    // Set object transform, then transform it by the parent bone's
+    Transform obj_transform = get_simple_object_transform(bone_transform_state, obj1);
 
 
     // Transform the sprite by its own transform now.
@@ -3451,17 +7226,21 @@ bool Entity::getSimpleObjectTransform(Transform& result, SCML::Entity::Animation
     float pivot_x_ratio = obj1->pivot_x;
     float pivot_y_ratio = obj1->pivot_y;
 
-    // No image tweening
-    std::pair<unsigned int, unsigned int> img_dims = getImageDimensions(obj1->folder, obj1->file);
+    // No image tweening.  A hidden image keeps its own size.
+    int folderID = obj1->folder;
+    int fileID = obj1->file;
+    if(!getMappedImage(folderID, fileID))
+    {
+        folderID = obj1->folder;
+        fileID = obj1->file;
+    }
+    SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(folderID, fileID);
 
     // Rotate about the pivot point and draw from the center of the image
-    float offset_x = (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-    float offset_y = (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-    float sprite_x = -offset_x*obj_transform.scale_x;
-    float sprite_y = -offset_y*obj_transform.scale_y;
+    float sprite_x, sprite_y, sin_angle, cos_angle;
+    place_image(obj_transform, 0.0f, 1.0f, pivot_x_ratio, pivot_y_ratio, img_dims, bone_transform_state.fixed_point, sprite_x, sprite_y, sin_angle, cos_angle);
 
     bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-    rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
 
     // Save the result
     result.x = sprite_x;
@@ -3470,6 +7249,8 @@ bool Entity::getSimpleObjectTransform(Transform& result, SCML::Entity::Animation
     result.scale_x = obj_transform.scale_x;
     result.scale_y = obj_transform.scale_y;
 
+    placeQueryResult(result);
+
     // FIXME: Actually the inverse conversion...
     convert_to_SCML_coords(result.x, result.y, result.angle);
     return true;
@@ -3477,62 +7258,40 @@ bool Entity::getSimpleObjectTransform(Transform& result, SCML::Entity::Animation
 
 bool Entity::getTweenedObjectTransform(Transform& result, SCML::Entity::Animation::Mainline::Key::Object_Ref* ref)
 {
-    // Dereference object_ref and get the next one in the timeline for tweening
-    Animation* animation_ptr = getAnimation(animation);  // Only needed if looping...
-    Animation::Timeline::Key* t_key1 = getTimelineKey(animation, ref->timeline, ref->key);
-    Animation::Timeline::Key* t_key2 = getTimelineKey(animation, ref->timeline, ref->key+1);
-    if(t_key2 == NULL)
-        t_key2 = t_key1;
-    if(t_key1 == NULL || !t_key1->has_object || !t_key2->has_object)
+    Animation* animation_ptr = getAnimation(animation);
+    if(ref == NULL || animation_ptr == NULL)
         return false;
 
-    Animation::Timeline::Key::Object* obj1 = &t_key1->object;
-    Animation::Timeline::Key::Object* obj2 = &t_key2->object;
-    if(obj2 == NULL)
-        obj2 = obj1;
-    if(obj1 == NULL)
+    // Reuse what draw() evaluated when the bones are current, so the result is also what was drawn
+    int pose_time = time;
+    if(bone_transform_state.animation == animation && bone_transform_state.key == key)
+        pose_time = bone_transform_state.time;
+    Bone_Transform_State::Object_Transform obj;
+    if(!evaluateObject(animation_ptr, ref, pose_time, obj))
         return false;
 
-    // Get interpolation (tweening) factor
-    float t = 0.0f;
-    if(t_key2->time > t_key1->time)
-        t = (time - t_key1->time)/float(t_key2->time - t_key1->time);
-    else if(t_key2->time < t_key1->time)
-        t = (time - t_key1->time)/float(animation_ptr->length - t_key1->time);
-
-    // Get parent bone transform
-    Transform parent_transform;
-    if(ref->parent < 0)
-        parent_transform = bone_transform_state.base_transform;
-    else
-        parent_transform = bone_transform_state.transforms[ref->parent];
-
-    // Set object transform
-    Transform obj_transform(obj1->x, obj1->y, obj1->angle, obj1->scale_x, obj1->scale_y);
-
-    // Tween with next key's object
-    obj_transform.lerp(Transform(obj2->x, obj2->y, obj2->angle, obj2->scale_x, obj2->scale_y), t, t_key1->spin);
-
-    // Transform the sprite by the parent transform.
-    obj_transform.apply_parent_transform(parent_transform);
-
+    Transform obj_transform = obj.transform;
 
     // Transform the sprite by its own transform now.
 
-    float pivot_x_ratio = lerp(obj1->pivot_x, obj2->pivot_x, t);
-    float pivot_y_ratio = lerp(obj1->pivot_y, obj2->pivot_y, t);
+    float pivot_x_ratio = obj.pivot_x;
+    float pivot_y_ratio = obj.pivot_y;
 
-    // No image tweening
-    std::pair<unsigned int, unsigned int> img_dims = getImageDimensions(obj1->folder, obj1->file);
+    // No image tweening.  A hidden image keeps its own size.
+    int folderID = obj.folder;
+    int fileID = obj.file;
+    if(!getMappedImage(folderID, fileID))
+    {
+        folderID = obj.folder;
+        fileID = obj.file;
+    }
+    SCML_PAIR(unsigned int, unsigned int) img_dims = getImageDimensions(folderID, fileID);
 
     // Rotate about the pivot point and draw from the center of the image
-    float offset_x = (pivot_x_ratio - 0.5f)*SCML_PAIR_FIRST(img_dims);
-    float offset_y = (pivot_y_ratio - 0.5f)*SCML_PAIR_SECOND(img_dims);
-    float sprite_x = -offset_x*obj_transform.scale_x;
-    float sprite_y = -offset_y*obj_transform.scale_y;
+    float sprite_x, sprite_y, sin_angle, cos_angle;
+    place_image(obj_transform, 0.0f, 1.0f, pivot_x_ratio, pivot_y_ratio, img_dims, bone_transform_state.fixed_point, sprite_x, sprite_y, sin_angle, cos_angle);
 
     bool flipped = ((obj_transform.scale_x < 0) != (obj_transform.scale_y < 0));
-    rotate_point(sprite_x, sprite_y, obj_transform.angle, obj_transform.x, obj_transform.y, flipped);
 
     // Save the result
     result.x = sprite_x;
@@ -3541,6 +7300,8 @@ bool Entity::getTweenedObjectTransform(Transform& result, SCML::Entity::Animatio
     result.scale_x = obj_transform.scale_x;
     result.scale_y = obj_transform.scale_y;
 
+    placeQueryResult(result);
+
     // FIXME: Actually the inverse conversion...
     convert_to_SCML_coords(result.x, result.y, result.angle);
     return true;
@@ -1,6 +1,162 @@
 #ifndef _SCMLPP_H__
 #define _SCMLPP_H__
 
+#include <cstddef>
+#include <new>
+
+
+namespace SCML
+{
+
+/*! \brief Interface for the memory that SCMLpp uses.
+ *
+ * Install one with SCML::setAllocator().  Memory is returned to the allocator that provided it, even if another allocator has been installed since.
+ */
+class Allocator
+{
+public:
+    virtual ~Allocator() {}
+
+    /*! Returns NULL on failure. */
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* ptr, size_t size) = 0;
+};
+
+/*! \brief Running totals of the allocations made through SCML::allocate().
+ *
+ * Take one before and one after some work and subtract them to see what that work allocated.
+ */
+class Allocation_Stats
+{
+public:
+    unsigned long allocations;
+    unsigned long deallocations;
+    unsigned long bytes_allocated;
+    unsigned long bytes_deallocated;
+
+    Allocation_Stats();
+
+    Allocation_Stats operator-(const Allocation_Stats& other) const;
+};
+
+/*! \brief Sets the allocator for new SCMLpp allocations on the calling thread.  NULL restores the default (malloc).
+ * \return The previous allocator
+ */
+Allocator* setAllocator(Allocator* allocator);
+Allocator* getAllocator();
+Allocation_Stats getAllocationStats();
+
+/*! \brief Allocates from the current allocator and counts it.  Returns NULL on failure. */
+void* allocate(size_t size);
+/*! \brief Frees memory from SCML::allocate(), using the allocator that provided it. */
+void deallocate(void* ptr);
+
+/*! \brief Base for SCMLpp's heap-allocated classes, so that new and delete go through SCML::allocate(). */
+class Allocated
+{
+public:
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+    static void* operator new(size_t size, void* where)
+    {
+        return where;
+    }
+    static void operator delete(void* ptr, void* where)
+    {}
+};
+
+/*! \brief Allocator that carves memory out of large blocks and frees it all at once.
+ *
+ * deallocate() does nothing.  release() returns every block to the allocator it came from.
+ */
+class Arena_Allocator : public Allocator
+{
+public:
+    /*! parent provides the blocks.  NULL means the default (malloc). */
+    Arena_Allocator(size_t block_size = 65536, Allocator* parent = NULL);
+    virtual ~Arena_Allocator();
+
+    virtual void* allocate(size_t size);
+    virtual void deallocate(void* ptr, size_t size);
+
+    /*! \brief Frees all blocks.  Everything allocated from this arena is invalid afterward. */
+    void release();
+
+    /*! \brief Sets where new blocks come from.  Blocks already allocated still go back to their own allocator. */
+    void setParent(Allocator* parent);
+
+    /*! \return The number of bytes handed out since the last release() */
+    size_t getBytesUsed() const;
+    /*! \return The number of blocks held */
+    int getNumBlocks() const;
+
+private:
+    class Block;
+    Block* blocks;
+    char* cursor;
+    char* end;
+    size_t block_size;
+    size_t bytes_used;
+    int num_blocks;
+    Allocator* parent;
+
+    Block* allocateBlock(size_t size);
+
+    Arena_Allocator(const Arena_Allocator&);
+    Arena_Allocator& operator=(const Arena_Allocator&);
+};
+
+/*! \brief Installs an allocator for the calling thread while this object exists. */
+class Allocator_Scope
+{
+public:
+    Allocator* previous;
+
+    Allocator_Scope(Allocator* allocator)
+        : previous(setAllocator(allocator))
+    {}
+    ~Allocator_Scope()
+    {
+        setAllocator(previous);
+    }
+};
+
+
+/*! \brief Writes the recorded profiling zones as Chrome trace_event JSON (for chrome://tracing or Perfetto).
+ *
+ * Zones are only recorded when SCMLpp is compiled with SCML_PROFILE defined.  Call this while no other thread is recording zones.
+ * \return false if the file could not be written or profiling is compiled out
+ */
+bool writeProfileTrace(const char* filename);
+/*! \brief Discards the recorded profiling zones of every thread. */
+void clearProfile();
+
+#ifdef SCML_PROFILE
+
+/*! \brief Times the enclosing scope and records it in the calling thread's ring buffer.  Use SCML_PROFILE_ZONE() instead of this directly.
+ *
+ * Each thread has its own fixed-size ring (SCML_PROFILE_RING_SIZE events), so recording never locks.  The oldest zones are overwritten when a ring is full.
+ */
+class Profile_Zone
+{
+public:
+    /*! name must stay valid until the trace is written (e.g. a string literal).  tag identifies the object being worked on, such as an entity. */
+    Profile_Zone(const char* name, const void* tag);
+    ~Profile_Zone();
+
+private:
+    const char* name;
+    const void* tag;
+    unsigned long long start_ns;
+};
+
+    #define SCML_PROFILE_ZONE(name, tag) SCML::Profile_Zone _scml_profile_zone(name, tag)
+#else
+    #define SCML_PROFILE_ZONE(name, tag)
+#endif
+
+}
+
 
 // Compile-time switches for container classes
 // Do you want the STL to be used?
@@ -9,9 +165,91 @@
     #include <map>
     #include <vector>
 
+    namespace SCML
+    {
+
+    /*! \brief STL allocator that sends the containers' memory through SCML::allocate().
+     */
+    template<typename T>
+    class STL_Allocator
+    {
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<typename U>
+        struct rebind
+        {
+            typedef STL_Allocator<U> other;
+        };
+
+        STL_Allocator()
+        {}
+        STL_Allocator(const STL_Allocator&)
+        {}
+        template<typename U>
+        STL_Allocator(const STL_Allocator<U>&)
+        {}
+
+        pointer address(reference x) const
+        {
+            return &x;
+        }
+        const_pointer address(const_reference x) const
+        {
+            return &x;
+        }
+
+        pointer allocate(size_type n, const void* hint = NULL)
+        {
+            void* ptr = SCML::allocate(n * sizeof(T));
+            if(ptr == NULL)
+                throw std::bad_alloc();
+            return static_cast<pointer>(ptr);
+        }
+        void deallocate(pointer ptr, size_type n)
+        {
+            SCML::deallocate(ptr);
+        }
+
+        size_type max_size() const
+        {
+            return size_type(-1) / sizeof(T);
+        }
+
+        void construct(pointer ptr, const T& value)
+        {
+            ::new(static_cast<void*>(ptr)) T(value);
+        }
+        void destroy(pointer ptr)
+        {
+            ptr->~T();
+        }
+    };
+
+    template<typename A, typename B>
+    inline bool operator==(const STL_Allocator<A>&, const STL_Allocator<B>&)
+    {
+        return true;
+    }
+
+    template<typename A, typename B>
+    inline bool operator!=(const STL_Allocator<A>&, const STL_Allocator<B>&)
+    {
+        return false;
+    }
+
+    }
+
+    // Strings stay on std::allocator so they can still be passed as std::string.
     #define SCML_STRING std::string
-    #define SCML_MAP(a,b) std::map< a, b >
-    #define SCML_VECTOR(a) std::vector< a >
+    #define SCML_MAP(a,b) std::map< a, b, std::less< a >, SCML::STL_Allocator< std::pair< a const, b > > >
+    #define SCML_VECTOR(a) std::vector< a, SCML::STL_Allocator< a > >
     #define SCML_PAIR(a,b) std::pair< a, b >
 
     #define SCML_VECTOR_SIZE(v) (v).size()
@@ -30,6 +268,7 @@
     #define SCML_MAP_SIZE(m) (m).size()
     #define SCML_MAP_INSERT(m,a,b) m.insert(std::make_pair((a),(b))).second
     #define SCML_MAP_INSERT_ONLY(m,a,b) m.insert(std::make_pair((a),(b)))
+    #define SCML_MAP_ERASE(m,a) (m).erase(a)
 
     // Be careful with these...  Macros don't nest well.  Use a typedef as necessary for the map parameters.
     #define SCML_BEGIN_MAP_FOREACH(m,a,b,name) for(SCML_MAP(a , b)::iterator _iter_e = m.begin(); _iter_e != m.end(); _iter_e++) { b& name = _iter_e->second;
@@ -51,9 +290,505 @@
         return e->second;
     }
 #else
+    #include <cstring>
+
+    namespace SCML
+    {
+
+    /*! \brief String that stores short contents inline.  Longer contents are allocated through SCML::allocate().
+     */
+    class String
+    {
+    public:
+        String();
+        String(const char* str);
+        String(const String& str);
+        ~String();
+
+        String& operator=(const char* str);
+        String& operator=(const String& str);
+        String& operator+=(const char* str);
+        String& operator+=(const String& str);
+        String& operator+=(char c);
+
+        char& operator[](unsigned int i)
+        {
+            return data()[i];
+        }
+        const char& operator[](unsigned int i) const
+        {
+            return c_str()[i];
+        }
+
+        const char* c_str() const
+        {
+            return (capacity > 0? heap : local);
+        }
+        unsigned int size() const
+        {
+            return length;
+        }
+        bool empty() const
+        {
+            return (length == 0);
+        }
+        void clear();
+
+    private:
+        enum {LOCAL_SIZE = 24};
+
+        unsigned int length;
+        // 0 while the contents fit in local
+        unsigned int capacity;
+        union
+        {
+            char local[LOCAL_SIZE];
+            char* heap;
+        };
+
+        char* data()
+        {
+            return (capacity > 0? heap : local);
+        }
+        void assign(const char* str, unsigned int size);
+        void append(const char* str, unsigned int size);
+        void reserve(unsigned int size);
+    };
+
+    String operator+(const String& a, const String& b);
+    String operator+(const String& a, const char* b);
+    String operator+(const char* a, const String& b);
+
+    inline bool operator==(const String& a, const String& b)
+    {
+        return (a.size() == b.size() && memcmp(a.c_str(), b.c_str(), a.size()) == 0);
+    }
+    inline bool operator==(const String& a, const char* b)
+    {
+        return (strcmp(a.c_str(), b) == 0);
+    }
+    inline bool operator==(const char* a, const String& b)
+    {
+        return (strcmp(a, b.c_str()) == 0);
+    }
+    inline bool operator!=(const String& a, const String& b)
+    {
+        return !(a == b);
+    }
+    inline bool operator!=(const String& a, const char* b)
+    {
+        return !(a == b);
+    }
+    inline bool operator!=(const char* a, const String& b)
+    {
+        return !(a == b);
+    }
+    inline bool operator<(const String& a, const String& b)
+    {
+        return (strcmp(a.c_str(), b.c_str()) < 0);
+    }
+
+
+    template<typename A, typename B>
+    class Pair
+    {
+    public:
+        A first;
+        B second;
+
+        Pair()
+            : first(), second()
+        {}
+        Pair(const A& a, const B& b)
+            : first(a), second(b)
+        {}
+        /*! Converts the members, as std::pair does */
+        template<typename C, typename D>
+        Pair(const Pair<C, D>& p)
+            : first(p.first), second(p.second)
+        {}
+    };
+
+    template<typename A, typename B>
+    inline bool operator<(const Pair<A, B>& a, const Pair<A, B>& b)
+    {
+        return (a.first < b.first || (!(b.first < a.first) && a.second < b.second));
+    }
+    template<typename A, typename B>
+    inline bool operator==(const Pair<A, B>& a, const Pair<A, B>& b)
+    {
+        return (a.first == b.first && a.second == b.second);
+    }
+    template<typename A, typename B>
+    inline bool operator!=(const Pair<A, B>& a, const Pair<A, B>& b)
+    {
+        return !(a == b);
+    }
+
+
+    /*! \brief Array that keeps its first N elements inline.  More elements are allocated through SCML::allocate().
+     *
+     * Like std::vector, clear() and shrinking resize() keep the capacity.
+     */
+    template<typename T, unsigned int N = 16>
+    class Vector
+    {
+    public:
+        typedef T* iterator;
+        typedef const T* const_iterator;
+
+        Vector()
+            : heap(NULL), length(0), capacity(N)
+        {}
+        Vector(const Vector& v)
+            : heap(NULL), length(0), capacity(N)
+        {
+            *this = v;
+        }
+        ~Vector()
+        {
+            clear();
+            if(heap != NULL)
+                SCML::deallocate(heap);
+        }
+
+        Vector& operator=(const Vector& v)
+        {
+            if(this == &v)
+                return *this;
+            clear();
+            reserve(v.length);
+            for(unsigned int i = 0; i < v.length; i++)
+                new (data() + i) T(v.data()[i]);
+            length = v.length;
+            return *this;
+        }
+
+        T& operator[](unsigned int i)
+        {
+            return data()[i];
+        }
+        const T& operator[](unsigned int i) const
+        {
+            return data()[i];
+        }
+
+        iterator begin()
+        {
+            return data();
+        }
+        iterator end()
+        {
+            return data() + length;
+        }
+        const_iterator begin() const
+        {
+            return data();
+        }
+        const_iterator end() const
+        {
+            return data() + length;
+        }
+
+        unsigned int size() const
+        {
+            return length;
+        }
+        bool empty() const
+        {
+            return (length == 0);
+        }
+
+        void resize(unsigned int size)
+        {
+            reserve(size);
+            while(length > size)
+                data()[--length].~T();
+            for(; length < size; length++)
+                new (data() + length) T();
+        }
+        void clear()
+        {
+            resize(0);
+        }
+        void push_back(const T& value)
+        {
+            if(length == capacity)
+            {
+                // value might be one of our own elements
+                T copy(value);
+                reserve(capacity*2);
+                new (data() + length) T(copy);
+            }
+            else
+                new (data() + length) T(value);
+            length++;
+        }
+
+    private:
+        T* heap;
+        unsigned int length;
+        unsigned int capacity;
+        union
+        {
+            char local[N*sizeof(T)];
+            double align_double;
+            void* align_pointer;
+        };
+
+        T* data()
+        {
+            return (heap != NULL? heap : reinterpret_cast<T*>(local));
+        }
+        const T* data() const
+        {
+            return (heap != NULL? heap : reinterpret_cast<const T*>(local));
+        }
+
+        void reserve(unsigned int size)
+        {
+            if(size <= capacity)
+                return;
+            if(size < capacity*2)
+                size = capacity*2;
+            T* new_data = static_cast<T*>(SCML::allocate(size*sizeof(T)));
+            if(new_data == NULL)
+                throw std::bad_alloc();
+            T* old_data = data();
+            for(unsigned int i = 0; i < length; i++)
+            {
+                new (new_data + i) T(old_data[i]);
+                old_data[i].~T();
+            }
+            if(heap != NULL)
+                SCML::deallocate(heap);
+            heap = new_data;
+            capacity = size;
+        }
+    };
+
+
+    /*! \brief Map stored as an array of pairs sorted by key.
+     *
+     * Lookups are a binary search over contiguous memory.  Inserting in key order (as the loader does) appends without moving anything.  Inserting elsewhere moves the later elements, so iterators are invalidated by insert().
+     */
+    template<typename K, typename V>
+    class Flat_Map
+    {
+    public:
+        typedef Pair<K, V> value_type;
+        typedef value_type* iterator;
+        typedef const value_type* const_iterator;
+
+        Flat_Map()
+            : elements(NULL), length(0), capacity(0)
+        {}
+        Flat_Map(const Flat_Map& m)
+            : elements(NULL), length(0), capacity(0)
+        {
+            *this = m;
+        }
+        ~Flat_Map()
+        {
+            clear();
+            if(elements != NULL)
+                SCML::deallocate(elements);
+        }
+
+        Flat_Map& operator=(const Flat_Map& m)
+        {
+            if(this == &m)
+                return *this;
+            clear();
+            reserve(m.length);
+            for(unsigned int i = 0; i < m.length; i++)
+                new (elements + i) value_type(m.elements[i]);
+            length = m.length;
+            return *this;
+        }
+
+        iterator begin()
+        {
+            return elements;
+        }
+        iterator end()
+        {
+            return elements + length;
+        }
+        const_iterator begin() const
+        {
+            return elements;
+        }
+        const_iterator end() const
+        {
+            return elements + length;
+        }
+
+        unsigned int size() const
+        {
+            return length;
+        }
+        bool empty() const
+        {
+            return (length == 0);
+        }
+
+        iterator find(const K& key)
+        {
+            unsigned int i = lower_bound(key);
+            if(i < length && !(key < elements[i].first))
+                return elements + i;
+            return end();
+        }
+        const_iterator find(const K& key) const
+        {
+            unsigned int i = lower_bound(key);
+            if(i < length && !(key < elements[i].first))
+                return elements + i;
+            return end();
+        }
+
+        /*! \return false (and leaves the map unchanged) if the key is already present */
+        bool insert(const K& key, const V& value)
+        {
+            unsigned int i = length;
+            if(length > 0 && !(elements[length-1].first < key))
+            {
+                i = lower_bound(key);
+                if(!(key < elements[i].first))
+                    return false;
+            }
+
+            value_type element(key, value);
+            reserve(length + 1);
+            if(i == length)
+                new (elements + length) value_type(element);
+            else
+            {
+                new (elements + length) value_type(elements[length-1]);
+                for(unsigned int j = length-1; j > i; j--)
+                    elements[j] = elements[j-1];
+                elements[i] = element;
+            }
+            length++;
+            return true;
+        }
+
+        void clear()
+        {
+            for(unsigned int i = 0; i < length; i++)
+                elements[i].~value_type();
+            length = 0;
+        }
+
+        /*! \return false if the key is not present */
+        bool erase(const K& key)
+        {
+            unsigned int i = lower_bound(key);
+            if(i >= length || key < elements[i].first)
+                return false;
+            for(unsigned int j = i; j + 1 < length; j++)
+                elements[j] = elements[j+1];
+            length--;
+            elements[length].~value_type();
+            return true;
+        }
+
+        /*! \brief Forgets the elements and storage without destroying or freeing them.  For when an arena that provided all of it is about to be released. */
+        void abandon()
+        {
+            elements = NULL;
+            length = 0;
+            capacity = 0;
+        }
+
+    private:
+        value_type* elements;
+        unsigned int length;
+        unsigned int capacity;
+
+        unsigned int lower_bound(const K& key) const
+        {
+            unsigned int low = 0;
+            unsigned int high = length;
+            while(low < high)
+            {
+                unsigned int mid = low + (high - low)/2;
+                if(elements[mid].first < key)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            return low;
+        }
+
+        void reserve(unsigned int size)
+        {
+            if(size <= capacity)
+                return;
+            if(size < capacity*2)
+                size = capacity*2;
+            if(size < 4)
+                size = 4;
+            value_type* new_elements = static_cast<value_type*>(SCML::allocate(size*sizeof(value_type)));
+            if(new_elements == NULL)
+                throw std::bad_alloc();
+            for(unsigned int i = 0; i < length; i++)
+            {
+                new (new_elements + i) value_type(elements[i]);
+                elements[i].~value_type();
+            }
+            if(elements != NULL)
+                SCML::deallocate(elements);
+            elements = new_elements;
+            capacity = size;
+        }
+    };
+
+    }
+
+    #define SCML_STRING SCML::String
+    #define SCML_MAP(a,b) SCML::Flat_Map< a, b >
+    #define SCML_VECTOR(a) SCML::Vector< a >
+    #define SCML_PAIR(a,b) SCML::Pair< a, b >
+
+    #define SCML_VECTOR_SIZE(v) (v).size()
+    #define SCML_VECTOR_RESIZE(v,size) (v).resize(size)
+    #define SCML_VECTOR_CLEAR(v) (v).clear()
+
+    #define SCML_PAIR_FIRST(p) (p).first
+    #define SCML_PAIR_SECOND(p) (p).second
+
+    template<typename A, typename B>
+    inline SCML_PAIR(A, B) SCML_MAKE_PAIR(A const& a, B const& b)
+    {
+        return SCML::Pair<A, B>(a, b);
+    }
 
-    // TODO: Provide an alternative to the STL for string, map, and vector.
+    #define SCML_MAP_SIZE(m) (m).size()
+    #define SCML_MAP_INSERT(m,a,b) (m).insert((a),(b))
+    #define SCML_MAP_INSERT_ONLY(m,a,b) (m).insert((a),(b))
+    #define SCML_MAP_ERASE(m,a) (m).erase(a)
 
+    // Be careful with these...  Macros don't nest well.  Use a typedef as necessary for the map parameters.
+    #define SCML_BEGIN_MAP_FOREACH(m,a,b,name) for(SCML_MAP(a , b)::iterator _iter_e = m.begin(); _iter_e != m.end(); _iter_e++) { b& name = _iter_e->second;
+    #define SCML_END_MAP_FOREACH }
+    #define SCML_BEGIN_MAP_FOREACH_CONST(m,a,b,name) for(SCML_MAP(a , b)::const_iterator _iter_e = m.begin(); _iter_e != m.end(); _iter_e++) { b const& name = _iter_e->second;
+    #define SCML_END_MAP_FOREACH_CONST }
+
+    #define SCML_TO_CSTRING(s) (s).c_str()
+    #define SCML_STRING_SIZE(s) (s).size()
+    #define SCML_SET_STRING(s,value) s = value
+    #define SCML_STRING_APPEND(s,value) s += value
+
+    template<typename A, typename B>
+    inline B SCML_MAP_FIND(SCML_MAP(A, B) const& m, A const& key)
+    {
+        typename SCML_MAP(A,B)::const_iterator e = m.find(key);
+        if(e == m.end())
+            return B();
+        return e->second;
+    }
 #endif
 
 #include "tinyxml.h"
@@ -63,11 +798,107 @@
 namespace SCML
 {
 
+/*! \brief Level-of-detail thresholds for an entity prototype.
+ *
+ * Set this on an SCML::Data::Entity to configure every SCML::Entity created from it, or on a single SCML::Entity.
+ * Scales are the projected scale of the entity on screen (e.g. camera zoom * draw scale).
+ */
+class LOD_Policy
+{
+public:
+
+    /*! Below this projected scale, the pose is only evaluated every reduced_rate_interval frames and held in between. */
+    float reduced_rate_scale;
+    /*! Number of updates per pose evaluation at reduced rate. */
+    int reduced_rate_interval;
+    /*! Below this projected scale, tweening is skipped and the pose snaps to the current mainline key. */
+    float snap_scale;
+    /*! Objects whose projected size (in pixels) is below this are not drawn.  0 disables culling. */
+    float min_pixel_size;
+
+    LOD_Policy();
+    LOD_Policy(float reduced_rate_scale, int reduced_rate_interval, float snap_scale, float min_pixel_size);
+
+    /*! \brief Picks the LOD level (see SCML::Entity::LOD_Level) for the given projected scale. */
+    int getLevel(float projected_scale) const;
+};
+
+/*! \brief Hash table from names to integer ids, filled in when a document or entity is loaded.
+ *
+ * Uses open addressing with linear probing, so a lookup is one hash and usually one string comparison.
+ * Names are not copied.  Each entry points at its owner's name, so the owners must outlive the table and keep their names unchanged.
+ */
+class Name_Table
+{
+public:
+    Name_Table();
+    ~Name_Table();
+
+    /*! \return false (and keeps the first id) if the name is already in the table */
+    bool insert(const char* name, int id);
+    /*! \return The id for name, or -1 if there is none */
+    int find(const char* name) const;
+    int size() const;
+    void clear();
+
+    static unsigned int hash(const char* name);
+
+private:
+    class Slot
+    {
+    public:
+        unsigned int hash;
+        int id;
+        // NULL for an empty slot
+        const char* name;
+    };
+
+    Slot* slots;
+    // Always a power of two, or 0
+    unsigned int num_slots;
+    int num_names;
+
+    void rehash(unsigned int new_num_slots);
+
+    Name_Table(const Name_Table&);
+    Name_Table& operator=(const Name_Table&);
+};
+
+/*! \brief A set of tags as bits, indexed by the tag handles of an SCML::Data (see SCML::Data::tag_names).
+ *
+ * A document can have up to MAX_TAGS different tags.  Testing a set against another is a few word operations, with no strings.
+ */
+class Tag_Set
+{
+public:
+    enum {MAX_TAGS = 64};
+
+    Tag_Set();
+
+    /*! Adds a tag.  Handles outside of [0, MAX_TAGS) are ignored. */
+    void add(int handle);
+    bool has(int handle) const;
+    /*! \return true if every tag of tags is in this set */
+    bool hasAll(const Tag_Set& tags) const;
+    /*! \return true if any tag of tags is in this set */
+    bool hasAny(const Tag_Set& tags) const;
+    bool empty() const;
+    void clear();
+
+    Tag_Set& operator|=(const Tag_Set& tags);
+    bool operator==(const Tag_Set& tags) const;
+
+private:
+    unsigned int bits[MAX_TAGS/32];
+};
+
+class Pose_Cache;
+
 /*! \brief Representation and storage of an SCML file in memory.
  *
  *
  */
-class Data
+class Data : public Allocated
 {
 public:
 
@@ -77,14 +908,37 @@ public:
     SCML_STRING generator_version;
     bool pixel_art_mode;
 
+    /*! When true, Entities created from this data store their timeline keys quantized (see SCML::Entity::Animation::Timeline::Packed_Keys).  Not loaded from the file. */
+    bool quantize_keys;
+
+    /*! When true, load() and fromTextData() parse only the headers of animations (id, name, length, and looping), and
+     * leave their keys in the text until loadAnimation() or preloadAnimations() needs them.  Entities load the animations
+     * they start, so the Data has to outlive them and, when it was loaded from a file, the file has to stay in place.
+     * Not loaded from the file. */
+    bool defer_animations;
+
+    /*! Where each deferred animation is in the text: its offset and its length.  The text is the file, or deferred_text if that isn't empty. */
+    SCML_VECTOR(int) deferred_spans;
+    /*! The deferred animations of a document given to fromTextData(), since that text isn't kept */
+    SCML_VECTOR(char) deferred_text;
+
+    /*! Holds everything that load() creates, so that clear() frees it in a few large blocks.  Declared before the containers so it outlives them. */
+    Arena_Allocator arena;
+
     class Folder;
     SCML_MAP(int, Folder*) folders;
     class Atlas;
     SCML_MAP(int, Atlas*) atlases;
     class Entity;
     SCML_MAP(int, Entity*) entities;
+    /*! Entity ids by name */
+    Name_Table entity_names;
     class Character_Map;
+    /*! Character maps at the document level.  Newer files keep them in each Entity. */
     SCML_MAP(int, Character_Map*) character_maps;
+    Name_Table character_map_names;
+    /*! Handles of the tags in the document's mainline and timeline keys, by name, for Tag_Set.  Deferred animations add theirs when they load. */
+    Name_Table tag_names;
 
     Data();
     Data(const SCML_STRING& file);
@@ -100,9 +954,28 @@ public:
     void log(int recursive_depth = 0) const;
     void clear();
 
+    /*! \brief Loads the keys of an animation that was deferred (see defer_animations).
+     *
+     * \return True if the animation's keys are loaded, false if the animation is not found or its text can't be read
+     */
+    bool loadAnimation(int entity, int animation);
+
+    /*! \brief Loads the keys of the named animations in every entity, e.g. before a level starts.
+     *
+     * Entities created afterward copy the keys with the rest of the animations.
+     * \return The number of animations that are loaded with those names
+     */
+    int preloadAnimations(const char* const* animationNames, int numNames);
+
+    /*! The poses of this document's entities that other entities draw as sub-entity objects.  Created by getPoseCache().  Not loaded from the file. */
+    Pose_Cache* pose_cache;
+
+    /*! \return The pose cache, created the first time it is needed */
+    Pose_Cache* getPoseCache();
+
 
 
-    class Meta_Data
+    class Meta_Data : public Allocated
     {
     public:
 
@@ -118,7 +991,7 @@ public:
         void log(int recursive_depth = 0) const;
         void clear();
 
-        class Variable
+        class Variable : public Allocated
         {
         public:
 
@@ -137,7 +1010,7 @@ public:
             void clear();
         };
 
-        class Tag
+        class Tag : public Allocated
         {
         public:
 
@@ -153,7 +1026,7 @@ public:
     };
 
 
-    class Meta_Data_Tweenable
+    class Meta_Data_Tweenable : public Allocated
     {
     public:
 
@@ -169,7 +1042,7 @@ public:
         void log(int recursive_depth = 0) const;
         void clear();
 
-        class Variable
+        class Variable : public Allocated
         {
         public:
 
@@ -191,7 +1064,7 @@ public:
 
         };
 
-        class Tag
+        class Tag : public Allocated
         {
         public:
 
@@ -208,7 +1081,7 @@ public:
 
     Meta_Data* meta_data;
 
-    class Folder
+    class Folder : public Allocated
     {
     public:
 
@@ -227,7 +1100,7 @@ public:
         void log(int recursive_depth = 0) const;
         void clear();
 
-        class File
+        class File : public Allocated
         {
         public:
 
@@ -255,7 +1128,7 @@ public:
         };
     };
 
-    class Atlas
+    class Atlas : public Allocated
     {
     public:
         int id;
@@ -274,7 +1147,7 @@ public:
         void log(int recursive_depth = 0) const;
         void clear();
 
-        class Folder
+        class Folder : public Allocated
         {
         public:
 
@@ -292,7 +1165,7 @@ public:
             void clear();
 
 
-            class Image
+            class Image : public Allocated
             {
             public:
 
@@ -310,7 +1183,7 @@ public:
         };
     };
 
-    class Entity
+    class Entity : public Allocated
     {
     public:
 
@@ -320,6 +1193,15 @@ public:
         class Animation;
         SCML_MAP(int, Animation*) animations;
 
+        /*! Character maps (skins) that belong to this entity */
+        SCML_MAP(int, Character_Map*) character_maps;
+        Name_Table character_map_names;
+
+        /*! Handles of the variables in the keys of the entity's timelines, by name.  Handles count up from 0 in the order
+         * that the names are found, and they are the same for every SCML::Entity made from this entity.  Deferred
+         * animations add their names when they load. */
+        Name_Table variable_names;
+
         Entity();
         Entity(TiXmlElement* elem);
 
@@ -329,9 +1211,18 @@ public:
         void log(int recursive_depth = 0) const;
         void clear();
 
+        /*! \return The named character map of this entity, or NULL if there is none */
+        Character_Map* getCharacterMap(const char* characterMapName) const;
+
+        /*! Gives a handle in variable_names to each variable name in the animation's keys that doesn't have one yet */
+        void addVariableNames(const Animation* animation);
+
         Meta_Data* meta_data;
 
-        class Animation
+        /*! LOD thresholds copied into each SCML::Entity instantiated from this prototype. */
+        LOD_Policy lod_policy;
+
+        class Animation : public Allocated
         {
         public:
 
@@ -341,6 +1232,9 @@ public:
             SCML_STRING looping;
             int loop_to;
 
+            /*! Index of the animation's span in SCML::Data::deferred_spans while its keys are not loaded, or -1 */
+            int deferred;
+
             Meta_Data* meta_data;
 
             // More to follow...
@@ -360,13 +1254,15 @@ public:
                 class Key;
                 SCML_MAP(int, Key*) keys;
 
-                class Key
+                class Key : public Allocated
                 {
                 public:
 
                     int id;
                     int time;
                     Meta_Data* meta_data;
+                    /*! The key's own tags and those of the timeline keys it refers to, by SCML::Data::tag_names */
+                    Tag_Set tags;
 
                     Key();
                     Key(TiXmlElement* elem);
@@ -441,7 +1337,7 @@ public:
 
                     SCML_MAP(int, Bone_Container) bones;
 
-                    class Bone
+                    class Bone : public Allocated
                     {
                     public:
 
@@ -468,7 +1364,7 @@ public:
 
                     };
 
-                    class Bone_Ref
+                    class Bone_Ref : public Allocated
                     {
                     public:
 
@@ -485,7 +1381,7 @@ public:
                         void clear();
                     };
 
-                    class Object
+                    class Object : public Allocated
                     {
                     public:
 
@@ -540,7 +1436,7 @@ public:
 
                     };
 
-                    class Object_Ref
+                    class Object_Ref : public Allocated
                     {
                     public:
 
@@ -574,6 +1470,10 @@ public:
 
             class Timeline;
             SCML_MAP(int, Timeline*) timelines;
+            /*! Eventlines, loaded as timelines with the object_type "event".  Only their key times matter. */
+            SCML_MAP(int, Timeline*) eventlines;
+            /*! Soundlines, loaded as timelines with the object_type "sound".  The object of each key is the sound that it plays. */
+            SCML_MAP(int, Timeline*) soundlines;
 
             Animation();
             Animation(TiXmlElement* elem);
@@ -581,12 +1481,14 @@ public:
             ~Animation();
 
             bool load(TiXmlElement* elem);
+            /*! Loads what load() skips for a deferred animation: the meta data, the mainline, and the timelines, eventlines, and soundlines */
+            bool loadKeys(TiXmlElement* elem);
             void log(int recursive_depth = 0) const;
             void clear();
 
 
 
-            class Timeline
+            class Timeline : public Allocated
             {
             public:
 
@@ -609,7 +1511,7 @@ public:
                 class Key;
                 SCML_MAP(int, Key*) keys;
 
-                class Key
+                class Key : public Allocated
                 {
                 public:
 
@@ -622,6 +1524,9 @@ public:
 
                     bool has_object;
 
+                    /*! The tags of the key and its bone or object, by SCML::Data::tag_names */
+                    Tag_Set tags;
+
                     Key();
                     Key(TiXmlElement* elem);
 
@@ -692,6 +1597,8 @@ public:
                         float value_float;
                         float min_float;
                         float max_float;
+                        /*! The entity that a sub-entity object (object_type "entity") shows, or -1 */
+                        int entity;
                         int animation;
                         float t;
                         //int z_index; // Does this exist?  Object_Ref has it, so probably not.
@@ -714,7 +1621,7 @@ public:
         };
     };
 
-    class Character_Map
+    class Character_Map : public Allocated
     {
     public:
 
@@ -747,7 +1654,8 @@ public:
             void clear();
         };
 
-        Map map;
+        /*! Image replacements, applied in order */
+        SCML_VECTOR(Map) maps;
     };
 
     class Document_Info
@@ -773,14 +1681,116 @@ public:
     Document_Info document_info;
 
     int getNumAnimations(int entity) const;
+    /*! \return The id of the named entity, or -1 if there is none */
+    int getEntityID(const char* entityName) const;
+    /*! \return The named document-level character map, or NULL if there is none */
+    Character_Map* getCharacterMap(const char* characterMapName) const;
+};
+
+/*! \brief Counters kept by an Asset_Registry
+ */
+class Asset_Stats
+{
+public:
+    /*! Requests for an asset that was already loaded, under the same path or with the same contents */
+    unsigned long hits;
+    /*! Requests that had to load their asset */
+    unsigned long misses;
+    /*! What the hits didn't have to load again: the arena bytes of each shared Data and the decoded (RGBA) bytes of each shared image */
+    unsigned long bytes_saved;
+    /*! Assets held now */
+    int num_data;
+    int num_images;
+
+    Asset_Stats();
 };
 
+/*! \brief Shares Data and renderer images between everything that loads the same files.
+ *
+ * Assets are found by canonical path and, for a path not seen yet, by the hash and size of the file's contents, so
+ * a copy of a file under another name is shared too.  A Data is only shared by contents with files in the same
+ * directory, since its images are found next to it.  Each acquire is matched by a release, and an asset is freed
+ * when its last reference is released.  The registry is not thread-safe.
+ */
+class Asset_Registry
+{
+public:
+
+    /*! Frees an image that a renderer loaded */
+    typedef void (*Free_Image)(void* image);
+
+    Asset_Registry();
+    /*! Frees the assets that are still referenced */
+    ~Asset_Registry();
+
+    /*! \brief Loads a Data or shares the one already loaded from that file.
+     * \return The Data, or NULL if the file couldn't be loaded.  Don't delete it: pass it to releaseData().
+     */
+    Data* acquireData(const char* file);
+    void releaseData(Data* data);
+
+    /*! \brief Shares an image that is already loaded from that file.
+     *
+     * If the image has to be loaded, the renderer loads it and hands it over with addImage().
+     * \return The image, or NULL if it isn't loaded
+     */
+    void* acquireImage(const char* file, unsigned int* width = NULL, unsigned int* height = NULL);
+    /*! \brief Adds an image that the renderer loaded, with one reference.  free_image is called on it after the last release. */
+    void addImage(const char* file, void* image, unsigned int width, unsigned int height, Free_Image free_image);
+    void releaseImage(void* image);
+
+    const Asset_Stats& getStats() const;
+
+private:
+
+    class Asset : public Allocated
+    {
+    public:
+        /*! A Data or a renderer image */
+        void* object;
+        bool is_data;
+        Free_Image free_image;
+        unsigned int width, height;
+        unsigned long bytes;
+        int references;
+        /*! Hash and size of the contents */
+        SCML_PAIR(unsigned int, unsigned int) contents;
+        /*! Every canonical path that the asset was requested under */
+        SCML_VECTOR(SCML_STRING) paths;
+
+        Asset();
+    };
+
+    SCML_MAP(SCML_STRING, Asset*) m_paths;
+    SCML_MAP(SCML_PAIR(unsigned int, unsigned int), Asset*) m_contents;
+    SCML_MAP(void*, Asset*) m_objects;
+    Asset_Stats m_stats;
+
+    // The image that acquireImage() last missed, so addImage() needn't read it again
+    SCML_STRING m_missed_path;
+    SCML_PAIR(unsigned int, unsigned int) m_missed_contents;
+
+    Asset* find(const SCML_STRING& path, const SCML_PAIR(unsigned int, unsigned int)& contents);
+    void insert(Asset* asset, const SCML_STRING& path);
+    void release(void* object);
+
+    Asset_Registry(const Asset_Registry&);
+    Asset_Registry& operator=(const Asset_Registry&);
+};
+
+/*! \return The process-wide Asset_Registry */
+Asset_Registry& getAssetRegistry();
+
 /*! \brief A storage class for images in a renderer-specific format (to be inherited).
  */
-class FileSystem
+class FileSystem : public Allocated
 {
 public:
 
+    /*! Where images are shared with other FileSystems (e.g. &SCML::getAssetRegistry()), or NULL to load them privately.  Set it before loading. */
+    Asset_Registry* registry;
+
+    FileSystem();
     virtual ~FileSystem() {}
 
     /*! \brief Loads all images referenced by the given SCML data.
@@ -830,12 +1840,72 @@ class Transform
     void apply_parent_transform(const Transform& parent);
 };
 
+/*! \brief A 2D affine transform: (x, y) goes to (xx*x + xy*y + tx, yx*x + yy*y + ty).
+ */
+class Affine
+{
+    public:
+
+    float xx, xy, tx;
+    float yx, yy, ty;
+
+    Affine();
+    Affine(float xx, float xy, float tx, float yx, float yy, float ty);
+    /*! \brief The placement of an image by a Transform: scaled, then rotated, then moved.
+     *
+     * \param sin_angle The sine of transform.angle
+     * \param cos_angle The cosine of transform.angle
+     */
+    Affine(const Transform& transform, float sin_angle, float cos_angle);
+    explicit Affine(const Transform& transform);
+
+    /*! \brief Gets the corners of a w by h image centered on the origin, with +y up.
+     *
+     * \param corners Receives 4 x, y pairs: the bottom left, bottom right, top right, and top left corners, whose texture
+     *                coordinates are (0, 1), (1, 1), (1, 0), and (0, 0) for an image stored top row first.
+     */
+    void getCorners(float w, float h, float* corners) const;
+};
+
+/*! \brief A 16.16 fixed-point number: the value times 65536.
+ */
+typedef int Fixed;
+
+/*! \brief A Transform in 16.16 fixed point.  Its arithmetic is all integer and its trigonometry comes from a table, so it
+ *         gives the same results on every platform and needs no FPU.  Positions, angles, and scales must stay within +/-32767.
+ */
+class Fixed_Transform
+{
+    public:
+
+    Fixed x, y;
+    Fixed angle;
+    Fixed scale_x, scale_y;
+
+    Fixed_Transform();
+    /*! \brief Converts a Transform, rounding toward zero. */
+    explicit Fixed_Transform(const Transform& transform);
+
+    Transform toTransform() const;
+
+    void lerp(const Fixed_Transform& transform, Fixed t, int spin);
+    void apply_parent_transform(const Fixed_Transform& parent);
+
+    /*! \brief Converts a float to 16.16, rounding toward zero. */
+    static Fixed toFixed(float value);
+    static float toFloat(Fixed value);
+    static Fixed mul(Fixed a, Fixed b);
+    /*! \brief The sine of an angle in degrees, interpolated from a quarter-wave table. */
+    static Fixed sin(Fixed degrees);
+    static Fixed cos(Fixed degrees);
+};
+
 
 /*! \brief A class to directly interface with SCML character data and draw it (to be inherited).
  *
  * Derived classes provide the means for the Entity to draw itself with a specific renderer.
  */
-class Entity
+class Entity : public Allocated
 {
 public:
 
@@ -849,6 +1919,130 @@ public:
     /*! Time (in milliseconds) tracking the position of the animation from its beginning. */
     int time;
 
+    /*! \brief Level-of-detail levels.  Each level includes the savings of the ones before it.
+     */
+    enum LOD_Level
+    {
+        LOD_FULL = 0,  /*!< Full-rate, tweened evaluation */
+        LOD_REDUCED_RATE,  /*!< Evaluate every LOD_Policy::reduced_rate_interval updates, holding the pose in between */
+        LOD_SNAP_TO_KEY  /*!< No tweening: the pose snaps to the current mainline key */
+    };
+
+    /*! LOD thresholds for this instance (copied from the SCML::Data::Entity prototype on load) */
+    LOD_Policy lod_policy;
+    /*! Current LOD_Level */
+    int lod_level;
+
+    /*! When true, the bones, objects, and sprites are evaluated with Fixed_Transform instead of float math, so an animation
+     *  gives bit-identical poses on every platform (e.g. for lockstep games).  True by default when SCMLpp is compiled with
+     *  SCML_FIXED_POINT. */
+    bool fixed_point;
+
+    /*! When true, the entity goes to sleep once two draws in a row show the same pose: its animation has ended, it isn't
+     *  updated, or its animation doesn't move.  A sleeping entity evaluates its pose once, at the rotation and scale it is
+     *  drawn with, and draw() only moves those sprites, so sleeping never changes the picture.  Drawing it with another
+     *  rotation or scale evaluates the pose again.  getBoneTransform() and getObjectTransform() move their results to where
+     *  the last draw() put the pose.  Changing the pose through the Entity's functions wakes it (see wake()). */
+    bool auto_sleep;
+    /*! How many times the entity has gone to sleep and woken up */
+    int sleeps;
+    int wakes;
+
+    /*! When true, draw() moves the pose from the last refreshPose() instead of evaluating a new one, while update() still
+     *  advances the time.  The pose is evaluated at the rotation and scale of the last draw(), so holding it never changes
+     *  the picture.  The first draw evaluates one if there is none, and so does a draw with another rotation or scale, or
+     *  drawViews() after a rotated or scaled draw(), at the current time.  Set by SCML::Update_Scheduler for the entities it
+     *  manages.  auto_sleep has no effect while it is set.  getBoneTransform() and getObjectTransform() give the held pose,
+     *  moved to where the last draw() put it, so a query made before this frame's draw() uses last frame's place.  After
+     *  drawViews(), they give it at the origin. */
+    bool hold_pose;
+
+    /*! \brief The timeline keys that a blended animation (a crossfade's or a layer's) tweens between, by crossfade channel.
+     *  They are found again only when the animation moves on to another mainline key.
+     */
+    class Pose_Keys
+    {
+    public:
+        /*! \brief The keys on either side of the time on one channel */
+        class Tween
+        {
+        public:
+            Transform from;
+            Transform to;
+            int from_time;
+            int to_time;
+            /*! Spin of the first key */
+            int spin;
+            /*! False if the channel has no keys to tween in this mainline key */
+            bool valid;
+
+            Tween();
+        };
+
+        /*! The animation and mainline key that the keys were found for, or -1 to find them again */
+        int animation;
+        int key;
+        SCML_VECTOR(Tween) tweens;
+
+        Pose_Keys();
+    };
+
+    /*! \brief The animation being faded out by crossfadeAnimation(), which keeps its own time.
+     */
+    class Crossfade
+    {
+    public:
+        /*! Integer index of the animation being faded out, or -1 when there is no crossfade */
+        int animation;
+        int key;
+        int time;
+
+        /*! Length of the crossfade and how much of it has passed, in milliseconds */
+        int length;
+        int elapsed;
+
+        Crossfade();
+
+        /*! \return How much of the faded-out pose to blend in: 1 at the start of the crossfade, falling to 0 at its end */
+        float getWeight() const;
+        /*! \return The same weight in 16.16 fixed point */
+        Fixed getFixedWeight() const;
+    };
+
+    Crossfade crossfade;
+
+    /*! \brief An animation played over part of the entity (e.g. an attack on the upper body over a walk).  See addLayer().
+     */
+    class Layer : public Allocated
+    {
+    public:
+        /*! Integer index of the layer's animation, its current mainline keyframe, and its time in milliseconds */
+        int animation;
+        int key;
+        int time;
+
+        /*! How much the layer overrides the animations under it, from 0 to 1 */
+        float weight;
+
+        /*! Which crossfade channels (see Animation::timeline_channels) the layer poses: the masked bones and the objects attached to them */
+        SCML_VECTOR(char) mask;
+        /*! Channel of the bone that the mask starts at, or -1 for the whole entity */
+        int root;
+
+        /*! Local transforms of the layer's animation by channel from the last rebuild, and which channels it had */
+        SCML_VECTOR(Transform) transforms;
+        SCML_VECTOR(char) channels;
+        /*! The keys of the layer's animation that transforms was tweened from */
+        Pose_Keys keys;
+
+        Layer(int animation, float weight);
+    };
+
+    /*! Layers in the order they are applied.  Later layers override earlier ones where their masks overlap. */
+    SCML_VECTOR(Layer*) layers;
+
+    class Animation;
+
     class Bone_Transform_State
     {
         public:
@@ -860,24 +2054,80 @@ public:
         Transform base_transform;
         SCML_VECTOR(Transform) transforms;
 
+        /*! Whether the Entity's fixed_point was set for the rebuild, and then the bones in fixed point, which transforms has
+         *  converted to float */
+        bool fixed_point;
+        SCML_VECTOR(Fixed_Transform) fixed_transforms;
+
+        /*! Whether the rebuild evaluated only the bones of some channels and their parents.  The others are left at the
+         *  identity. */
+        bool partial;
+        /*! Scratch for a partial rebuild: which bones of the key it needs, and their parents */
+        SCML_VECTOR(char) needed_bones;
+        SCML_VECTOR(int) bone_parents;
+
+        /*! Local (parent space) transforms of the faded-out animation by crossfade channel, and which channels it has */
+        SCML_VECTOR(Transform) fade_transforms;
+        SCML_VECTOR(char) fade_channels;
+        /*! The keys of the faded-out animation that fade_transforms was tweened from */
+        Pose_Keys fade_keys;
+        /*! Weight of the faded-out pose in transforms, 0 when nothing was blended */
+        float fade_weight;
+
+        /*! \brief A tweened object of the current key, in world space but before its pivot is applied.
+         */
+        class Object_Transform
+        {
+        public:
+            Transform transform;
+            /*! How far between its timeline keys the object is */
+            float t;
+            float pivot_x;
+            float pivot_y;
+            /*! The image before the character maps */
+            int folder;
+            int file;
+            /*! False until the object is evaluated after a rebuild */
+            bool evaluated;
+            /*! False if the object has no keys to tween at this time */
+            bool valid;
+
+            Object_Transform();
+        };
+
+        /*! The key's tweened objects by timeline.  Whichever of draw() and the object queries gets to one first
+         *  evaluates it, and the other reuses it until the next rebuild. */
+        SCML_VECTOR(Object_Transform) objects;
+
         Bone_Transform_State();
 
         bool should_rebuild(int entity, int animation, int key, int time, const Transform& base_transform);
-        void rebuild(int entity, int animation, int key, int time, Entity* entity_ptr, const Transform& base_transform);
+        /*! \param channels Evaluates only the bones on these crossfade channels and the bones above them, or every bone if NULL */
+        void rebuild(int entity, int animation, int key, int time, Entity* entity_ptr, const Transform& base_transform, const SCML_VECTOR(char)* channels = NULL);
+
+        /*! \brief Blends a local transform from the current animation's timeline toward the matching one in the faded-out pose,
+         *         then toward the entity's layers that mask it.
+         */
+        void blend(Transform& local, const Entity* entity_ptr, const Animation* animation_ptr, int timeline) const;
+        void blend(Fixed_Transform& local, const Entity* entity_ptr, const Animation* animation_ptr, int timeline) const;
+
+        /*! \brief Gets the transform of a bone in fixed point, or the base transform when parent is -1. */
+        Fixed_Transform getFixedParent(int parent) const;
     };
 
     Bone_Transform_State bone_transform_state;
 
     SCML_STRING name;
 
-    class Animation;
     SCML_MAP(int, Animation*) animations;
+    /*! Animation ids by name */
+    Name_Table animation_names;
 
     //Meta_Data* meta_data;
 
     /*! \brief Stores all of the data that the Entity needs to update and draw itself, independent of the definition in SCML::Data.
      */
-    class Animation
+    class Animation : public Allocated
     {
     public:
 
@@ -887,28 +2137,37 @@ public:
         SCML_STRING looping;
         int loop_to;
 
+        /*! False while the animation's keys are deferred in the SCML::Data (see SCML::Data::defer_animations).  Entity::loadAnimation() loads them. */
+        bool loaded;
+        /*! True when the pose is the same at every time: there is one mainline key and no timeline has more than one key */
+        bool is_static;
+
         //Meta_Data* meta_data;
 
         class Mainline
         {
         public:
 
+            Mainline();
             Mainline(SCML::Data::Entity::Animation::Mainline* mainline);
 
             ~Mainline();
 
+            void load(SCML::Data::Entity::Animation::Mainline* mainline);
             void clear();
 
             class Key;
             SCML_MAP(int, Key*) keys;
 
-            class Key
+            class Key : public Allocated
             {
             public:
 
                 int id;
                 int time;
                 //Meta_Data* meta_data;
+                /*! The tags that are active from this key until the next one (see SCML::Data::Entity::Animation::Mainline::Key::tags) */
+                Tag_Set tags;
 
                 Key(SCML::Data::Entity::Animation::Mainline::Key* key);
 
@@ -980,7 +2239,7 @@ public:
                 SCML_MAP(int, Bone_Container) bones;
 
 
-                class Bone
+                class Bone : public Allocated
                 {
                 public:
 
@@ -1003,7 +2262,7 @@ public:
 
                 };
 
-                class Bone_Ref
+                class Bone_Ref : public Allocated
                 {
                 public:
 
@@ -1017,7 +2276,7 @@ public:
                     void clear();
                 };
 
-                class Object
+                class Object : public Allocated
                 {
                 public:
 
@@ -1069,7 +2328,7 @@ public:
 
                 };
 
-                class Object_Ref
+                class Object_Ref : public Allocated
                 {
                 public:
 
@@ -1087,20 +2346,98 @@ public:
 
         };
 
-        Mainline mainline;
-
-        class Timeline;
-        SCML_MAP(int, Timeline*) timelines;
+        Mainline mainline;
+
+        class Timeline;
+        SCML_MAP(int, Timeline*) timelines;
+        /*! Timeline ids by name.  A bone's name is the name of its timeline. */
+        Name_Table timeline_names;
+        /*! Crossfade channel of each timeline, by timeline id.  Timelines with the same name share a channel in every animation of the entity. */
+        SCML_VECTOR(int) timeline_channels;
+
+        /*! \brief An event or a sound that a key of the animation fires when the animation's time passes it.
+         */
+        class Trigger
+        {
+        public:
+            enum Type {EVENT, SOUND};
+
+            int time;
+            int type;
+            /*! Index of the name of the eventline, soundline, or sound timeline in trigger_names */
+            int name;
+            /*! The sound to play (-1 for events) */
+            int folder;
+            int file;
+            float volume;
+            float panning;
+
+            Trigger();
+        };
+
+        /*! Every event and sound key of the animation, sorted by time, so that the ones in a span of time are found by a binary search */
+        SCML_VECTOR(Trigger) triggers;
+        SCML_VECTOR(SCML_STRING) trigger_names;
+
+        /*! \return The index in triggers of the first trigger at or after time */
+        int findTrigger(int time) const;
+        const char* getTriggerName(const Trigger& trigger) const;
+
+        /*! \brief The values that one variable takes at the keys of one timeline, tweened by Entity::getVariable().
+         */
+        class Varline : public Allocated
+        {
+        public:
+            enum Type {STRING, INT, FLOAT};
+            enum Curve_Type {INSTANT, LINEAR, QUADRATIC, CUBIC};
+
+            class Key
+            {
+            public:
+                int time;
+                int curve_type;
+                float c1;
+                float c2;
+                int value_int;
+                float value_float;
+                SCML_STRING value_string;
+
+                Key();
+            };
+
+            SCML_STRING name;
+            int timeline;
+            int type;
+            /*! Sorted by time */
+            SCML_VECTOR(Key) keys;
+            /*! The key that the last evaluation started from, so that playing forward finds the next one in O(1) */
+            mutable int cursor;
+
+            Varline();
+
+            /*! \return The index of the last key at or before time, or -1 if time is before the first key */
+            int findKey(int time) const;
+        };
+
+        /*! The variables of the timeline keys, one varline per variable per timeline.  Kept when the keys are quantized. */
+        SCML_VECTOR(Varline*) varlines;
+        /*! Index in varlines of each variable handle (see SCML::Data::Entity::variable_names), or -1.  A variable on more than one timeline uses the first. */
+        SCML_VECTOR(int) variable_varlines;
 
-        Animation(SCML::Data::Entity::Animation* animation);
+        Animation(SCML::Data::Entity::Animation* animation, bool quantize_keys = false);
 
         ~Animation();
 
+        /*! Replaces the keys with those of the animation in the SCML::Data.  The name is kept, since the Entity's name table points at it. */
+        void load(SCML::Data::Entity::Animation* animation, bool quantize_keys = false);
         void clear();
 
+        /*! \return The id of the named timeline, or -1 if there is none */
+        int getTimelineID(const char* timelineName) const;
 
 
-        class Timeline
+
+        class Timeline : public Allocated
         {
         public:
 
@@ -1110,17 +2447,94 @@ public:
             SCML_STRING variable_type;
             SCML_STRING usage;
             //Meta_Data* meta_data;
+            /*! True for the timelines of sub-entity objects (object_type "entity"), which are drawn through SCML::Pose_Cache.  Their keys are never packed. */
+            bool sub_entity;
 
-            Timeline(SCML::Data::Entity::Animation::Timeline* timeline);
+            Timeline(SCML::Data::Entity::Animation::Timeline* timeline, bool quantize = false);
 
             ~Timeline();
 
             void clear();
 
             class Key;
+            /*! Keys stored in full.  Empty when the keys are packed. */
             SCML_MAP(int, Key*) keys;
 
-            class Key
+            /*! \brief The fields of a key that tweening uses, decoded from whichever storage the timeline has.
+             */
+            class Sample
+            {
+            public:
+                int time;
+                int spin;
+                bool has_object;
+                int folder;
+                int file;
+                Transform transform;
+                float pivot_x;
+                float pivot_y;
+            };
+
+            /*! \brief Decodes a key.  Past the last key, looping timelines wrap around to the first one.
+             * \return false if there is no such key
+             */
+            bool getSample(int key, bool looping, Sample& sample) const;
+
+            int getNumKeys() const;
+
+            /*! \brief Compact key storage for large character libraries.
+             *
+             * Each tweened value of the keys (position, angle, scale, pivot, image, and spin) is a channel.  A channel that
+             * never changes is stored once.  The others are quantized to 16 bits over the timeline's range of that value, so
+             * the error is at most half of (max - min) / 65535.  Integer channels with a range under 65536 are exact, as are
+             * the key times.  Other key data (colors, variables, sounds, curve types) is not kept.
+             */
+            class Packed_Keys : public Allocated
+            {
+            public:
+
+                enum Channel_Index {X, Y, ANGLE, SCALE_X, SCALE_Y, PIVOT_X, PIVOT_Y, FOLDER, FILE, SPIN, NUM_CHANNELS};
+
+                class Channel
+                {
+                public:
+                    /*! The smallest value.  (Not "min", which <windows.h> defines as a macro.) */
+                    float lowest;
+                    /*! Size of one quantization step, or 0 if the channel is constant */
+                    float step;
+                    /*! Start of the channel's values in Packed_Keys::values */
+                    int offset;
+
+                    Channel();
+                };
+
+                int num_keys;
+                bool has_object;
+                SCML_VECTOR(int) times;
+                Channel channels[NUM_CHANNELS];
+                SCML_VECTOR(unsigned short) values;
+
+                Packed_Keys();
+
+                /*! \brief Packs the keys of a timeline, whose ids must run from 0.
+                 * \return false if the keys can't be packed (so they should be stored in full)
+                 */
+                bool pack(SCML::Data::Entity::Animation::Timeline* timeline);
+
+                float get(int channel, int key) const
+                {
+                    const Channel& c = channels[channel];
+                    return (c.step == 0.0f? c.lowest : c.lowest + c.step*values[c.offset + key]);
+                }
+
+                /*! \return The largest quantization error of a channel */
+                float getMaxError(int channel) const;
+            };
+
+            /*! Packed keys, or NULL when the keys are stored in full */
+            Packed_Keys* packed;
+
+            class Key : public Allocated
             {
             public:
 
@@ -1197,6 +2611,7 @@ public:
                     float value_float;
                     float min_float;
                     float max_float;
+                    int entity;
                     int animation;
                     float t;
                     //int z_index; // Does this exist?  Object_Ref has it, so probably not.
@@ -1260,6 +2675,51 @@ public:
      */
     virtual void draw(float x, float y, float angle = 0.0f, float scale_x = 1.0f, float scale_y = 1.0f);
 
+    /*! \return Whether auto_sleep has put the entity to sleep */
+    bool isSleeping() const;
+
+    /*! \brief Evaluates the pose at the current time, at the rotation and scale of the last draw(), for draw() to move while the
+     *  entity sleeps or holds its pose.
+     *  The bone and object queries then use it too (see hold_pose).
+     */
+    void refreshPose();
+
+    /*! \brief Wakes the entity and drops the pose that it replays.  Call it after changing something that the pose depends on
+     *         behind the Entity's back, such as the keys of an animation.  It sleeps again after two draws of the same pose.
+     */
+    void wake();
+
+    /*! \brief An image placed by a pose, in the SCML coordinate system.
+     */
+    class Sprite
+    {
+    public:
+        int folder;
+        int file;
+        Transform transform;
+        /*! Size of the image, for culling.  Zero in a Pose_Cache pose, whose images the drawing entity's character maps can
+         *  still replace. */
+        unsigned int width;
+        unsigned int height;
+    };
+
+    /*! \brief Draws the entity into several views (split-screen, a minimap, a reflection) from one evaluation of its pose.
+     *
+     * The pose is evaluated and placed once, at the origin, and each view only applies its own transform to the sprites before
+     * calling draw_internal().  A view with a uniform scale draws exactly what draw() would.  A mirroring view (scale_x or
+     * scale_y negative) mirrors the whole pose, where draw() mirrors each bone in its own space.  LOD culling uses each view's scale.
+     *
+     * \param views Base transforms in the renderer coordinate system, like the arguments of draw()
+     * \param num_views Number of views
+     */
+    virtual void drawViews(const Transform* views, int num_views);
+
+    /*! \brief Called by drawViews() before it draws into each view.  Override it to switch render targets.
+     *
+     * \param view Index of the view in drawViews()'s array
+     */
+    virtual void beginView(int view);
+
     virtual void draw_simple_object(Animation::Mainline::Key::Object* obj);
     virtual void draw_tweened_object(Animation::Mainline::Key::Object_Ref* ref);
 
@@ -1275,6 +2735,22 @@ public:
      */
     virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y) = 0;
 
+    /*! When true, sprites are drawn with draw_internal_affine() instead of draw_internal().  Set by renderers that submit vertices or matrices. */
+    bool affine_output;
+
+    /*! Set by renderers whose sprites stay on screen until they are drawn again (scene graphs, cached vertex buffers).  A
+     *  sleeping entity that is drawn where it was drawn last then draws nothing. */
+    bool retained_output;
+
+    /*! \brief Draws an image placed by an affine transform, so the renderer needs no trigonometry of its own.  Called instead of
+     *         draw_internal() when affine_output is true.  The default decomposes the transform and calls draw_internal().
+     *
+     * \param folderID Integer folder ID of the image
+     * \param fileID Integer file ID of the image
+     * \param transform Takes a point of the image, in pixels from its center with +y up, to the SCML coordinate system
+     */
+    virtual void draw_internal_affine(int folderID, int fileID, const Affine& transform);
+
     /*! \brief Chooses and resets the current animation.
      *
      * \param animation Integer animation ID
@@ -1282,15 +2758,157 @@ public:
     virtual void startAnimation(int animation);
     virtual void startAnimation(const char* animationName);
 
+    /*! \brief Called by update() for each event and sound key of the current animation that its time passed, in order.
+     *
+     * Each update() fires the keys from the time it starts at up to, but not including, the time it ends at, so each key fires once per loop.
+     * The default stores the trigger in the buffer given to setTriggerBuffer().  An override that still wants the buffer calls this one.
+     * At LOD_REDUCED_RATE, the triggers fire when the banked time is spent.
+     */
+    virtual void onTrigger(const Animation::Trigger& trigger);
+
+    /*! \brief Gives update() a place to store the triggers it fires (see onTrigger()), so none are allocated.
+     *
+     * \param buffer Room for capacity triggers, or NULL for none
+     */
+    void setTriggerBuffer(const Animation::Trigger** buffer, int capacity);
+
+    /*! \return The number of triggers that the last update() fired.  If it is more than the capacity of the trigger buffer, the rest were not stored. */
+    int getNumTriggers() const;
+
+    /*! \brief The value of a variable at the current time, tweened between its keys.
+     */
+    class Variable_Value
+    {
+    public:
+        /*! An Animation::Varline::Type, or -1 if the current animation doesn't have the variable */
+        int type;
+        /*! Ints are tweened in double precision and then truncated.  value_float holds the tweened value of both. */
+        int value_int;
+        float value_float;
+        /*! Strings are not tweened.  Points into the Entity's animation, or is "" */
+        const char* value_string;
+
+        Variable_Value();
+    };
+
+    /*! \brief Looks up the handle of a variable name once, so that getVariable() doesn't compare strings.
+     * \return The handle, or -1 if no loaded animation of the entity has the variable
+     */
+    int getVariableHandle(const char* variableName) const;
+
+    /*! \brief Evaluates a variable of the current animation at the current time, with the curve type of the key before it.
+     *
+     * Each varline remembers where the last evaluation was, so an entity that plays forward costs O(1) per call.
+     * \return false if the current animation doesn't have the variable
+     */
+    bool getVariable(int handle, Variable_Value& value) const;
+
+    /*! \brief Looks up the handle of a tag name in the SCML::Data once, to build Tag_Sets with.
+     * \return The handle, or -1 if no loaded key of the document has the tag
+     */
+    int getTagHandle(const char* tagName) const;
+
+    /*! \return The tags active at the current key of the current animation: those of the mainline key and the timeline keys it refers to */
+    Tag_Set getTags() const;
+
+    /*! \brief Finds the entities that have all of the given tags active.  The entities must share one SCML::Data, since that is what assigns the handles.
+     * \param matches Receives the index in entities of each match, so it needs room for num_entities
+     * \return The number of matches
+     */
+    static int findTagged(const Entity* const* entities, int num_entities, const Tag_Set& tags, int* matches);
+
+    /*! \brief Evaluates the same variable for many entities at once.  The entities must be made from the same SCML::Data::Entity, since that is what assigns the handles.
+     * \return The number of entities that have the variable
+     */
+    static int getVariables(const Entity* const* entities, int num_entities, int handle, Variable_Value* values);
+
+    /*! \brief Starts an animation, blending over from the current pose instead of cutting to it.
+     *
+     * Bones and objects are matched between the two animations by timeline name.  Those without a match are not blended.
+     * While the crossfade lasts, each rebuild evaluates the old animation's local pose once more, and it is blended in before the parent transforms are applied.
+     * Starting another crossfade fades out of the current animation only; startAnimation() cancels the crossfade.
+     * \param animation Integer animation ID
+     * \param fade_ms Length of the crossfade in milliseconds.  0 cuts like startAnimation().
+     */
+    virtual void crossfadeAnimation(int animation, int fade_ms);
+    virtual void crossfadeAnimation(const char* animationName, int fade_ms);
+
+    /*! \brief Loads the keys of an animation that the SCML::Data deferred (see SCML::Data::defer_animations).
+     *
+     * Starting, crossfading to, or layering an animation loads it, so this is only needed to load it ahead of time.
+     * \param animation Integer animation ID
+     * \return True if the animation's keys are loaded
+     */
+    bool loadAnimation(int animation);
+
+    /*! \brief Plays an animation on part of the entity, on top of the current animation and any other layers.
+     *
+     * The layer is composited into the same bone pose and draw list as the current animation: the bones and objects under
+     * the masked bone take the layer's local transforms (blended by weight), while the hierarchy above them, the draw order
+     * and the images come from the current animation.  Bones and objects are matched by timeline name.
+     * Each rebuild evaluates the layer's animation once for the masked channels.
+     * \param animation Integer animation ID
+     * \param boneName Name of the bone at the top of the layer's subtree.  NULL masks the whole entity.
+     * \param weight How much the layer overrides the animations under it, from 0 to 1
+     * \return The index of the new layer in layers, or -1 if the animation or bone is not found
+     */
+    int addLayer(int animation, const char* boneName, float weight = 1.0f);
+
+    /*! \brief Chooses and resets the animation of a layer.
+     */
+    void startLayerAnimation(int layer, int animation);
+
+    /*! \brief Removes all layers.
+     */
+    void clearLayers();
+
+    /*! \return The number of crossfade channels (distinct timeline names) in the entity's animations */
+    int getNumChannels() const;
+    /*! \return The crossfade channel of the bones or objects with this timeline name, or -1 */
+    int getChannel(const char* timelineName) const;
+
+    /*! \brief Replaces this instance's LOD thresholds.
+     */
+    void setLODPolicy(const LOD_Policy& policy);
+
+    /*! \brief Forces a LOD level.
+     *
+     * \param level A LOD_Level
+     */
+    void setLODLevel(int level);
+
+    /*! \brief Picks the LOD level from the entity's projected scale on screen, using lod_policy.
+     *
+     * \param projected_scale Size of the entity on screen relative to its authored size (e.g. camera zoom * draw scale)
+     * \return The new LOD level
+     */
+    int setLODScale(float projected_scale);
+
+    /*! \brief Draws this instance with a character map (skin) on top of the ones already applied.  Where maps overlap, the last one applied wins.
+     *
+     * Costs O(number of maps in character_map).  The character map is not copied, so it must stay loaded until clearCharacterMaps() or this entity is destroyed.
+     * \param character_map From SCML::Data::Entity::getCharacterMap() or SCML::Data::getCharacterMap()
+     */
+    void applyCharacterMap(const SCML::Data::Character_Map* character_map);
+
+    /*! \brief Goes back to drawing the original images.  Costs O(number of maps applied).
+     */
+    void clearCharacterMaps();
+
 
     int getNumAnimations() const;
     Animation* getAnimation(int animation) const;
     Animation* getAnimation(const char* animationName) const;
+    /*! \brief Looks up an animation by name.  Cache the id and use the integer overloads where names are switched often.
+     * \return The animation id, or -1 if there is none
+     */
+    int getAnimationID(const char* animationName) const;
     Animation::Mainline::Key* getKey(int animation, int key) const;
     Animation::Mainline::Key::Bone_Ref* getBoneRef(int animation, int key, int bone_ref) const;
     Animation::Mainline::Key::Object_Ref* getObjectRef(int animation, int key, int object_ref) const;
 
     int getNextKeyID(int animation, int lastKey) const;
+    /*! The timeline key getters return NULL when the keys are packed (see SCML::Data::quantize_keys).  Use Animation::Timeline::getSample() instead. */
     Animation::Timeline::Key* getTimelineKey(int animation, int timeline, int key);
     Animation::Timeline::Key::Object* getTimelineObject(int animation, int timeline, int key);
     Animation::Timeline::Key::Bone* getTimelineBone(int animation, int timeline, int key);
@@ -1310,9 +2928,419 @@ protected:
     typedef SCML_PAIR(float, float) Pivot_t;
     Pivot_t getImagePivots(int folderID, int fileID) const;
 
+    bool isCulled(const SCML_PAIR(unsigned int, unsigned int)& img_dims, const Transform& obj_transform) const;
+
+    /*! \brief Replaces folderID and fileID with the image that the applied character maps draw in their place.
+     * \return false if the character maps hide the image
+     */
+    bool getMappedImage(int& folderID, int& fileID) const;
+
+    /*! \brief Draws a sub-entity object: the shared pose of its entity and animation at its t, placed by obj_transform.
+     *
+     * \param key The timeline key before the current time, which t tweens from toward the next one
+     */
+    void drawSubEntity(const Animation* animation_ptr, const Animation::Timeline* timeline_ptr, int key, float t, const Transform& obj_transform);
+
+    /*! \brief Tweens an object_ref at the given time.  When that is the time of bone_transform_state, the result is cached there.
+     * \return false if the object has no keys to tween
+     */
+    bool evaluateObject(const Animation* animation_ptr, const Animation::Mainline::Key::Object_Ref* ref, int time, Bone_Transform_State::Object_Transform& result);
+
+    /*! \brief Passes a sprite to draw_internal() or draw_internal_affine(), or keeps it while evaluateSprites() evaluates the pose.
+     *
+     * \param img_dims The image's size, which evaluateSprites() keeps for culling the sprite when it is drawn
+     * \param sin_angle The sine of angle, for affine_output
+     * \param cos_angle The cosine of angle, for affine_output
+     */
+    void drawSprite(int folderID, int fileID, const SCML_PAIR(unsigned int, unsigned int)& img_dims, float x, float y, float angle, float scale_x, float scale_y, float sin_angle, float cos_angle);
+
+    /*! \brief Evaluates the pose and collects its sprites instead of drawing them.  Nothing is culled.
+     *
+     * \param base_transform Where to place the pose, in the SCML coordinate system
+     * \param num_sprites Receives the number of sprites
+     * \return The first sprite, valid until the next evaluation
+     */
+    const Sprite* evaluateSprites(const Transform& base_transform, int& num_sprites);
+
+    /*! \brief Puts the entity to sleep if its pose hasn't changed since the last draw, or wakes it if it has (see auto_sleep).
+     *         An entity that holds its pose (see hold_pose) gives the pose from the last refreshPose().
+     *
+     * \param base_transform Where the pose is about to be drawn, in the SCML coordinate system, or NULL for several views
+     * \param sprites Receives the sleeping pose, evaluated at base_transform's rotation and scale, or at the origin for views
+     * \param num_sprites Receives the number of sprites to draw: 0 when a retained_output renderer already shows them at base_transform
+     * \return Whether the entity is asleep or holds its pose.  If not, sprites and num_sprites are not set.
+     */
+    bool getSleepingPose(const Transform* base_transform, const Sprite*& sprites, int& num_sprites);
+
+    /*! \brief Rebuilds the bones if the time, the key, the base transform, or the blends changed since they were last built.
+     *
+     * \param channels Evaluates only the bones on these crossfade channels and the bones above them, or every bone if NULL
+     * \return The current mainline key, or NULL if there is none
+     */
+    Animation::Mainline::Key* evaluateBones(const Transform& base_transform, const SCML_VECTOR(char)* channels = NULL);
+
 private:
 
     SCML_MAP(FolderFile_t, Pivot_t) m_pivots;
+
+    // Every image of the document laid out densely: m_image_offsets[folder] + file indexes m_image_map, which holds
+    // the image drawn in its place ((-1, -1) hides it).  m_image_offsets has an extra entry for the end of the last folder.
+    SCML_VECTOR(int) m_image_offsets;
+    SCML_VECTOR(FolderFile_t) m_image_map;
+    SCML_VECTOR(const SCML::Data::Character_Map*) m_character_maps;
+
+    int getImageIndex(int folderID, int fileID) const;
+
+    // Crossfade channels by timeline name (see Animation::timeline_channels)
+    Name_Table m_channel_names;
+    int m_num_channels;
+
+    // Gives the timelines of an animation their crossfade channels
+    void assignChannels(Animation* animation_ptr);
+    // Fills in the animation's variable_varlines from the handles of SCML::Data::Entity::variable_names
+    void assignVariables(Animation* animation_ptr);
+    // Adds what is attached to the layer's masked bones in any key of the animation to the mask
+    void maskLayer(Layer* layer, const Animation* animation_ptr);
+
+    // Where deferred animations are loaded from
+    SCML::Data* m_data;
+
+    // See setTriggerBuffer()
+    const Animation::Trigger** m_trigger_buffer;
+    int m_trigger_capacity;
+    int m_num_triggers;
+
+    // Fires the triggers that advance() passes from time over dt_ms
+    void fireTriggers(const Animation* animation_ptr, int time, int dt_ms);
+
+    void advance(Animation* animation_ptr, int& key, int& time, int dt_ms) const;
+
+    // Reduced-rate LOD bookkeeping: the frame counter and the time banked since the last evaluation
+    int m_lod_frame;
+    int m_lod_pending_ms;
+
+    // Evaluates the bones if they need it and draws the objects, from a base transform in SCML coordinates
+    void drawPose(const Transform& base_transform);
+
+    // The pose that evaluateSprites() evaluated, and whether drawSprite() is collecting it
+    SCML_VECTOR(Sprite) m_view_sprites;
+    bool m_recording_views;
+
+    // Culls and draws the sprites of a pose that was evaluated at the origin, placed by a view in the SCML coordinate system.
+    // draw() only moves a sleeping pose with it.
+    void drawPlaced(const Sprite* sprites, int num_sprites, const Transform& view);
+    // Compares the pose with the last draw's to put the entity to sleep or wake it
+    bool checkSleep();
+
+    // Whether the entity is asleep, whether m_view_sprites holds its pose, whether a retained_output renderer shows it, and
+    // what draw() last placed it with: the pose is evaluated at its rotation and scale and moved to its x and y
+    bool m_asleep;
+    bool m_sleep_cached;
+    bool m_sleep_drawn;
+    Transform m_sleep_transform;
+    // What the last draw showed, to tell when the pose stops changing
+    int m_sleep_animation;
+    int m_sleep_key;
+    int m_sleep_time;
+    int m_sleep_lod_level;
+    bool m_sleep_fixed_point;
+
+    // Whether bone_transform_state holds the pose refreshPose() evaluated, which m_sleep_transform moves
+    bool m_pose_kept;
+    // Moves the result of a query from the SCML coordinate system of the bones to where draw() placed them
+    void placeQueryResult(Transform& result) const;
+};
+
+
+/*! \brief Evaluated poses of the entities that are drawn as sub-entity objects of other entities.
+ *
+ * A sub-entity's pose depends only on its entity, its animation, and its time, so all of the objects that show the same
+ * one share a single evaluation: 500 identical capes at the same t are evaluated once.  A pose is kept as the sprites it
+ * draws, in the sub-entity's own space, and each object applies its transform to them as it draws.  Times are rounded
+ * to the millisecond.  Float and fixed-point poses (see Entity::fixed_point) are kept apart.  The image sizes come from
+ * whichever entity evaluates a pose first, so every entity that draws a Data's sub-entities must report the same sizes.
+ * Each SCML::Data has one (see SCML::Data::getPoseCache()).  Not thread-safe.
+ */
+class Pose_Cache : public Allocated
+{
+public:
+
+    typedef Entity::Sprite Sprite;
+
+    /*! When adding a pose would take the cache past this many sprites, it is emptied first */
+    int max_sprites;
+    /*! Poses found and poses evaluated */
+    int hits;
+    int misses;
+
+    Pose_Cache(SCML::Data* data);
+    ~Pose_Cache();
+
+    /*! \brief Finds a pose, evaluating it if it isn't cached.
+     *
+     * \param t How far into the animation, from 0 to 1
+     * \param source Gives the image dimensions for an evaluation, and whether it is in fixed point
+     * \param num_sprites Receives the number of sprites in the pose
+     * \return The pose's first sprite, or NULL if there is no such entity or animation.  Valid until the next getPose() or clear().
+     */
+    const Sprite* getPose(int entity, int animation, float t, const Entity* source, int& num_sprites);
+
+    /*! Drops the poses, but keeps the entities that evaluate them */
+    void clear();
+
+private:
+
+    SCML::Data* m_data;
+
+    typedef SCML_PAIR(SCML_PAIR(int, int), SCML_PAIR(int, bool)) Pose_Key;
+    // The first sprite and the number of sprites of each (entity, animation) and (time, fixed_point)
+    SCML_MAP(Pose_Key, SCML_PAIR(int, int)) m_poses;
+    SCML_VECTOR(Sprite) m_sprites;
+    // An entity for each sub-entity, which draws its poses into a list of sprites
+    SCML_MAP(int, Entity*) m_recorders;
+
+    Pose_Cache(const Pose_Cache&);
+    Pose_Cache& operator=(const Pose_Cache&);
+};
+
+
+/*! \brief An Entity that evaluates poses without drawing them, for servers and tools.
+ *
+ * It needs no FileSystem: image sizes come from the width and height of each file in the SCML::Data, like the pivots.
+ * evaluate() rebuilds the bones only, and the objects are tweened when they are queried.  It can be limited to the bones
+ * that are asked for.  draw() works but draws nothing.
+ */
+class Headless_Entity : public Entity
+{
+public:
+
+    Headless_Entity();
+    Headless_Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
+
+    virtual void load(SCML::Data* data);
+    virtual void clear();
+
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+
+    /*! \brief Looks up the handle of a bone once, so that getBone() doesn't compare strings.
+     * \return The handle, or -1 if no loaded animation of the entity has a bone or object with that timeline name
+     */
+    int getBoneHandle(const char* boneName) const;
+
+    /*! \brief Limits evaluate() to some bones and the bones above them.  Objects whose bones are left out are not placed.
+     *
+     * \param handles Bone handles, or NULL to evaluate every bone again
+     */
+    void setBones(const int* handles, int num_handles);
+
+    /*! \brief Evaluates the bones at the current time.
+     *
+     * \param base_transform Where to place the entity, in the SCML coordinate system
+     */
+    void evaluate(const Transform& base_transform = Transform());
+
+    /*! \brief Gets a bone that the last evaluate() placed, in the SCML coordinate system.
+     * \return false if the current key doesn't have the bone or it wasn't evaluated
+     */
+    bool getBone(int handle, Transform& result) const;
+
+private:
+
+    SCML_MAP(FolderFile_t, SCML_PAIR(unsigned int, unsigned int)) m_image_sizes;
+
+    // The channels of the bones that setBones() asked for, or empty for all of them
+    SCML_VECTOR(char) m_bone_channels;
+    // The bone id of each channel in a key of an animation, or -1
+    SCML_VECTOR(int) m_channel_bones;
+    int m_channel_bones_animation;
+    int m_channel_bones_key;
+
+    void loadImageSizes(SCML::Data* data);
+};
+
+/*! \brief What an Update_Scheduler did in its last update()
+ */
+class Schedule_Stats
+{
+public:
+
+    enum {NUM_STALENESS_BUCKETS = 8};
+
+    /*! The budget and the time that update() took, in microseconds.  The time includes advancing every entity. */
+    float budget_us;
+    float used_us;
+    /*! Entities whose poses were evaluated, and entities that held their last pose */
+    int num_evaluated;
+    int num_held;
+    /*! How many entities show a pose evaluated 0, 1, 2, ... frames ago.  The last bucket counts the older ones too. */
+    int staleness[NUM_STALENESS_BUCKETS];
+    int max_staleness;
+    float mean_staleness;
+
+    Schedule_Stats();
+};
+
+/*! \brief Spreads the pose evaluation of many entities over several frames, within a time budget.
+ *
+ * update() advances the time of every entity, so triggers and variables stay on time.  Then the entities with a priority of
+ * at least every_frame_priority are evaluated, and the rest are evaluated in turn, from where the last frame stopped,
+ * until the budget is spent.  An entity that hasn't been evaluated for max_staleness frames is evaluated even over budget,
+ * and so is one that was just added.  The entities hold their poses (see Entity::hold_pose), so draw() moves the pose from
+ * their last evaluation, which has the rotation and scale they were last drawn with, and the bone and object queries return
+ * that pose where draw() last put it.  A priority could be
+ * how much the entity matters to the game, or its size on screen.  Not thread-safe.
+ */
+class Update_Scheduler
+{
+public:
+
+    /*! Microseconds per frame for update() */
+    float budget_us;
+    /*! Entities with at least this priority are evaluated every frame */
+    float every_frame_priority;
+    /*! The most frames that an entity holds its pose, or 0 for no limit */
+    int max_staleness;
+
+    Update_Scheduler(float budget_us = 2000.0f);
+
+    /*! \brief Adds an entity, which the scheduler doesn't own, and sets its hold_pose.
+     * \return The entity's index, which it keeps until an entity before it is removed
+     */
+    int add(Entity* entity, float priority = 0.0f);
+    /*! Removes an entity and clears its hold_pose.  Remove an entity before deleting it. */
+    void remove(Entity* entity);
+    /*! Removes every entity */
+    void clear();
+
+    int getNumEntities() const;
+    Entity* getEntity(int index) const;
+    /*! \brief Changes the priority of the entity at index, e.g. to its size on screen each frame */
+    void setPriority(int index, float priority);
+
+    /*! \brief Advances every entity by dt_ms and evaluates the poses that are due.
+     *
+     * \param dt_ms Change in time since the last update, in milliseconds
+     */
+    void update(int dt_ms);
+
+    /*! \return What the last update() did */
+    const Schedule_Stats& getStats() const;
+
+private:
+
+    class Entry
+    {
+    public:
+        Entity* entity;
+        float priority;
+        // Frames since the entity was evaluated, or -1 before its first evaluation
+        int staleness;
+    };
+
+    SCML_VECTOR(Entry) m_entries;
+    // Where the round-robin evaluation starts next frame
+    int m_next;
+    Schedule_Stats m_stats;
+
+    Update_Scheduler(const Update_Scheduler&);
+    Update_Scheduler& operator=(const Update_Scheduler&);
+};
+
+/*! \brief Places the sprites of a pose that was evaluated at the origin into a view (see Entity::drawViews()).
+ */
+class View_Transform
+{
+public:
+
+    /*! The view, in the SCML coordinate system */
+    Transform view;
+    /*! Whether the view mirrors the pose */
+    bool flipped;
+    float sin_angle;
+    float cos_angle;
+
+    View_Transform(const Transform& view);
+
+    /*! \return The sprite in the view.  This is Transform::apply_parent_transform(), except that a mirror turns the sprite the other way. */
+    Transform apply(const Transform& sprite) const
+    {
+        float x = sprite.x * view.scale_x;
+        float y = sprite.y * view.scale_y;
+        return Transform(x*cos_angle - y*sin_angle + view.x, x*sin_angle + y*cos_angle + view.y,
+                         (flipped? view.angle - sprite.angle : view.angle + sprite.angle),
+                         sprite.scale_x * view.scale_x, sprite.scale_y * view.scale_y);
+    }
+};
+
+/*! \brief Handedness policy for Renderer_Entity: the renderer uses SCML's coordinate system (+x to the right, +y up, +angle counter-clockwise).
+ */
+class Right_Handed_Coords
+{
+public:
+    static void toSCML(float& x, float& y, float& angle)
+    {}
+    static void fromSCML(float& x, float& y, float& angle)
+    {}
+};
+
+/*! \brief Handedness policy for Renderer_Entity: the common left-handed CG coordinate system (+x to the right, +y down, +angle clockwise).
+ */
+class Left_Handed_Coords
+{
+public:
+    static void toSCML(float& x, float& y, float& angle)
+    {
+        y = -y;
+        angle = 360 - angle;
+    }
+    static void fromSCML(float& x, float& y, float& angle)
+    {
+        y = -y;
+        angle = 360 - angle;
+    }
+};
+
+/*! \brief An Entity whose renderer and coordinate system are chosen at compile time.
+ *
+ * Renderer is the class that derives from this one (CRTP).  Instead of overriding the virtual functions, it provides:
+ * SCML_PAIR(unsigned int, unsigned int) getImageSize(int folderID, int fileID) const;
+ * void drawImage(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);  // In renderer coordinates
+ *
+ * Handedness is a policy like Left_Handed_Coords, with static toSCML() and fromSCML() conversions.
+ *
+ * The virtual functions are implemented in terms of the policies, so drawing costs the same as with a plain Entity: the
+ * pose is evaluated through Entity, and each sprite still reaches drawImage() through draw_internal().  The handedness
+ * conversion can't be folded into the base transform, since mirroring the coordinate system mirrors every bone's own
+ * transform too, so each sprite is converted back on its way out, as a plain Entity's draw_internal() does.
+ */
+template<class Renderer, class Handedness>
+class Renderer_Entity : public Entity
+{
+public:
+
+    Renderer_Entity()
+        : Entity()
+    {}
+    Renderer_Entity(SCML::Data* data, int entity, int animation = 0, int key = 0)
+        : Entity(data, entity, animation, key)
+    {}
+
+    virtual void convert_to_SCML_coords(float& x, float& y, float& angle)
+    {
+        Handedness::toSCML(x, y, angle);
+    }
+
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const
+    {
+        return static_cast<const Renderer*>(this)->getImageSize(folderID, fileID);
+    }
+
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+    {
+        Handedness::fromSCML(x, y, angle);
+        static_cast<Renderer*>(this)->drawImage(folderID, fileID, x, y, angle, scale_x, scale_y);
+    }
 };
 
 
@@ -0,0 +1,2345 @@
+// scml_bench: Headless timing of SCMLpp using the null renderer.
+//
+// Usage: scml_bench [-n entities] [-f frames] [-o results.json] [-t trace.json] [--lod] [--alloc] [--load] [--names] [--crossfade] [--quantize] [--lazy] [--registry] [--triggers] [--variables] [--tags] [--subentities] [--queries] [--views] [--policies] [--affine] [--fixed] [--headless] [--sleep] [--schedule] [file.scml ...]
+//
+// Each SCML file is loaded, N entities are instantiated from it, and every frame times
+// update(), Bone_Transform_State::rebuild(), and draw() separately.  Results are reported
+// as nanoseconds per entity per frame (mean, p50, p99) and optionally written as JSON.
+//
+// --alloc counts the allocations of loading, entity creation, and each frame.  It fails
+// (exit code 4) if steady-state update() and draw() allocate anything.
+//
+// --load times loading and clearing each document.
+//
+// --names times looking up animations by name and by id, in each file and in a copy with 100 animations.
+//
+// --crossfade times frames that crossfade between animations against frames that cut between them.
+//
+// --quantize compares entities with their keys stored in full and packed (SCML::Data::quantize_keys): memory per
+// entity, the largest quantization errors, and update+draw time.
+//
+// --lazy compares loading every animation up front with deferring them until they start (SCML::Data::defer_animations):
+// the time to load the document and create the entities, the memory held afterward, and the time to start the others.
+//
+// --registry loads a document for a series of levels that overlap, privately and through an SCML::Asset_Registry.
+//
+// --triggers times update() with event keys added to every animation, finding the ones that fire with the trigger
+// index and with a scan of every key.
+//
+// --variables adds a float variable to every timeline key and times reading it for each entity, by handle and by
+// name through the SCML::Data.
+//
+// --tags adds a tag to every timeline key and times finding the entities that have one of them, with tag
+// sets and by name through the SCML::Data.
+//
+// --subentities adds an entity that carries the first entity as a sub-entity object and compares drawing it with
+// drawing the first entity itself.  The carriers are spread over 8 phases, so they share 8 poses per frame.
+//
+// --queries times getObjectTransform() for every object after draw(), which reuses the objects that draw() evaluated,
+// and after a rebuild of the bones, which evaluates them again.
+//
+// --views times drawing each entity into 4 views (a camera, a minimap, a reflection, and a shadow) with a draw() per
+// view and with one drawViews().
+//
+// --policies compares draw() for entities in a left-handed coordinate system that override the virtual functions with
+// the same entities as an SCML::Renderer_Entity, which should draw the same sprites in the same time.
+//
+// --affine times draw() for a renderer that submits quad corners, once working them out from draw_internal()'s angle
+// and scale and once from the matrix given to draw_internal_affine().
+//
+// --fixed times draw() with the pose evaluated in float and in 16.16 fixed point (Entity::fixed_point), and reports how
+// far apart the sprites end up.
+//
+// --headless times a server tick (update() and the pose) for an entity that is drawn, for an SCML::Headless_Entity that
+// evaluates every bone, and for one that evaluates only the last two bones of the first animation and their parents.
+//
+// --sleep plays every animation once, without looping, and times update() and draw() once they have ended: for entities that
+// stay awake, for auto_sleep entities that are scrolled (replaying their pose), and for auto_sleep entities that stand still
+// in a retained_output renderer (drawing nothing).
+//
+// --schedule compares updating and drawing every entity with an SCML::Update_Scheduler given a quarter of that time, where
+// one entity in ten is evaluated every frame and the rest hold their poses between turns.  It reports the time the scheduler
+// used and how many frames old the poses were.
+//
+// -t writes the profiling zones as a Chrome trace.  This needs SCMLpp built with SCML_PROFILE.
+
+#include "SCML_null.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <new>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+using namespace std;
+using namespace SCML_null;
+
+
+#define FRAME_MS 16
+
+
+#if __cplusplus >= 201103L
+    #define THROWS_BAD_ALLOC
+    #define THROWS_NOTHING noexcept
+#else
+    #define THROWS_BAD_ALLOC throw(std::bad_alloc)
+    #define THROWS_NOTHING throw()
+#endif
+
+// Counts the heap allocations that don't go through SCML::allocate() (e.g. std::string).
+static unsigned long heap_allocations = 0;
+static unsigned long heap_bytes = 0;
+
+void* operator new(size_t size) THROWS_BAD_ALLOC
+{
+    heap_allocations++;
+    heap_bytes += size;
+    void* ptr = malloc(size > 0? size : 1);
+    if(ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size) THROWS_BAD_ALLOC
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) THROWS_NOTHING
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) THROWS_NOTHING
+{
+    free(ptr);
+}
+
+
+static double now_ns()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    if(freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER count;
+    QueryPerformanceCounter(&count);
+    return count.QuadPart * (1.0e9 / freq.QuadPart);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1.0e9 + ts.tv_nsec;
+#endif
+}
+
+
+class Stats
+{
+public:
+    double mean;
+    double p50;
+    double p99;
+
+    Stats()
+        : mean(0.0), p50(0.0), p99(0.0)
+    {}
+
+    // Note: Sorts the samples
+    Stats(vector<double>& samples)
+        : mean(0.0), p50(0.0), p99(0.0)
+    {
+        if(samples.size() == 0)
+            return;
+
+        sort(samples.begin(), samples.end());
+        for(size_t i = 0; i < samples.size(); i++)
+            mean += samples[i];
+        mean /= samples.size();
+        p50 = samples[(samples.size() - 1) * 50 / 100];
+        p99 = samples[(samples.size() - 1) * 99 / 100];
+    }
+};
+
+class Result
+{
+public:
+    string file;
+    string section;
+    int entities;
+    int frames;
+    // What the timings measure, e.g. "ns/entity/frame"
+    string unit;
+
+    // Names and timings of each measured phase
+    vector<string> phase_names;
+    vector<Stats> phases;
+
+    // Other measurements, like memory use
+    vector<string> value_names;
+    vector<double> values;
+
+    Result(const string& file, const string& section, int entities, int frames, const string& unit = "ns/entity/frame")
+        : file(file), section(section), entities(entities), frames(frames), unit(unit)
+    {}
+
+    void addPhase(const string& name, vector<double>& samples)
+    {
+        phase_names.push_back(name);
+        phases.push_back(Stats(samples));
+    }
+
+    void addValue(const string& name, double value)
+    {
+        value_names.push_back(name);
+        values.push_back(value);
+    }
+
+    void print() const
+    {
+        if(entities > 0)
+            printf("%s [%s] %d entities x %d frames\n", file.c_str(), section.c_str(), entities, frames);
+        else
+            printf("%s [%s] %d runs\n", file.c_str(), section.c_str(), frames);
+        for(size_t i = 0; i < phases.size(); i++)
+            printf("    %-24s %10.1f mean %10.1f p50 %10.1f p99  %s\n", phase_names[i].c_str(), phases[i].mean, phases[i].p50, phases[i].p99, unit.c_str());
+        for(size_t i = 0; i < values.size(); i++)
+            printf("    %-24s %10.1f\n", value_names[i].c_str(), values[i]);
+    }
+
+    void writeJSON(FILE* out) const
+    {
+        fprintf(out, "    {\"file\": \"%s\", \"section\": \"%s\", \"entities\": %d, \"frames\": %d, \"unit\": \"%s\", \"timings\": {", file.c_str(), section.c_str(), entities, frames, unit.c_str());
+        for(size_t i = 0; i < phases.size(); i++)
+            fprintf(out, "%s\"%s\": {\"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f}", (i > 0? ", " : ""), phase_names[i].c_str(), phases[i].mean, phases[i].p50, phases[i].p99);
+        fprintf(out, "}, \"values\": {");
+        for(size_t i = 0; i < values.size(); i++)
+            fprintf(out, "%s\"%s\": %.1f", (i > 0? ", " : ""), value_names[i].c_str(), values[i]);
+        fprintf(out, "}}");
+    }
+};
+
+
+static void destroy_entities(vector<Entity*>& entities)
+{
+    for(size_t i = 0; i < entities.size(); i++)
+        delete entities[i];
+    entities.clear();
+}
+
+// Instantiates num_entities entities, cycling through the data's entities and spreading out their start times.
+static void create_entities(vector<Entity*>& entities, SCML::Data& data, FileSystem& fs, int num_entities)
+{
+    destroy_entities(entities);
+    if(data.entities.size() == 0)
+        return;
+
+    SCML_MAP(int, SCML::Data::Entity*)::const_iterator e = data.entities.begin();
+    for(int i = 0; i < num_entities; i++)
+    {
+        Entity* entity = new Entity(&data, e->first);
+        entity->setFileSystem(&fs);
+        entity->update((i * 97) % 1000);
+        entities.push_back(entity);
+
+        e++;
+        if(e == data.entities.end())
+            e = data.entities.begin();
+    }
+}
+
+// Keeps finished non-looping animations moving by starting the next one.  Not timed.
+static void restart_finished(vector<Entity*>& entities)
+{
+    for(size_t i = 0; i < entities.size(); i++)
+    {
+        Entity* e = entities[i];
+        SCML::Entity::Animation* anim = e->getAnimation(e->animation);
+        if(anim != NULL && anim->looping != "true" && e->time >= anim->length)
+            e->startAnimation((e->animation + 1) % e->getNumAnimations());
+    }
+}
+
+static float entity_x(int i)
+{
+    return 50.0f * (i % 32);
+}
+
+static float entity_y(int i)
+{
+    return 50.0f * (i / 32);
+}
+
+// Times update, rebuild, and draw separately.
+static Result bench_frames(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    vector<Entity*> entities;
+    create_entities(entities, data, fs, num_entities);
+
+    vector<double> update_ns, rebuild_ns, draw_ns;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(entities);
+
+        double start = now_ns();
+        for(size_t i = 0; i < entities.size(); i++)
+            entities[i]->update(FRAME_MS);
+        double updated = now_ns();
+
+        // Rebuild explicitly, so draw() finds the bone state current and only does the object work.
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            Entity* e = entities[i];
+            e->bone_transform_state.rebuild(e->entity, e->animation, e->key, e->time, e, SCML::Transform(entity_x(i), entity_y(i), 0.0f, 1.0f, 1.0f));
+        }
+        double rebuilt = now_ns();
+
+        for(size_t i = 0; i < entities.size(); i++)
+            entities[i]->draw(entity_x(i), entity_y(i));
+        double drawn = now_ns();
+
+        update_ns.push_back((updated - start) / entities.size());
+        rebuild_ns.push_back((rebuilt - updated) / entities.size());
+        draw_ns.push_back((drawn - rebuilt) / entities.size());
+    }
+
+    destroy_entities(entities);
+
+    Result result(file, "frame", num_entities, num_frames);
+    result.addPhase("update", update_ns);
+    result.addPhase("rebuild", rebuild_ns);
+    result.addPhase("draw", draw_ns);
+    return result;
+}
+
+// Times update+draw of a small, distant crowd at each LOD level.
+static Result bench_lod(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    const char* level_names[] = {"full", "reduced_rate", "snap_to_key", "snap_to_key_culled"};
+    Result result(file, "lod", num_entities, num_frames);
+
+    vector<Entity*> entities;
+    for(int level = 0; level < 4; level++)
+    {
+        create_entities(entities, data, fs, num_entities);
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            entities[i]->setLODPolicy(SCML::LOD_Policy(1.0f, 4, 0.5f, (level == 3? 12.0f : 0.0f)));
+            entities[i]->setLODLevel(level < SCML::Entity::LOD_SNAP_TO_KEY? level : SCML::Entity::LOD_SNAP_TO_KEY);
+        }
+
+        vector<double> frame_ns;
+        for(int frame = 0; frame < num_frames; frame++)
+        {
+            restart_finished(entities);
+
+            double start = now_ns();
+            for(size_t i = 0; i < entities.size(); i++)
+            {
+                entities[i]->update(FRAME_MS);
+                entities[i]->draw(entity_x(i), entity_y(i), 0.0f, 0.2f, 0.2f);
+            }
+            frame_ns.push_back((now_ns() - start) / entities.size());
+        }
+        result.addPhase(level_names[level], frame_ns);
+    }
+
+    destroy_entities(entities);
+    return result;
+}
+
+
+// Times update+draw with every entity crossfading into its next animation, against cutting to it.
+static Result bench_crossfade(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    const int FADE_MS = 500;
+    const int FADE_FRAMES = FADE_MS / FRAME_MS;
+    Result result(file, "crossfade", num_entities, num_frames);
+
+    vector<Entity*> entities;
+    for(int pass = 0; pass < 2; pass++)
+    {
+        create_entities(entities, data, fs, num_entities);
+
+        vector<double> frame_ns;
+        for(int frame = 0; frame < num_frames; frame++)
+        {
+            restart_finished(entities);
+            // Both passes switch animations at the same times, so they play the same ones.  Each crossfade lasts until
+            // the next switch.  With only one animation, an entity crossfades into it from another time.
+            for(size_t i = 0; i < entities.size(); i++)
+            {
+                Entity* e = entities[i];
+                if((frame + i) % FADE_FRAMES != 0)
+                    continue;
+                int next = (e->animation + 1) % e->getNumAnimations();
+                if(pass == 0)
+                    e->startAnimation(next);
+                else
+                    e->crossfadeAnimation(next, FADE_MS);
+            }
+
+            double start = now_ns();
+            for(size_t i = 0; i < entities.size(); i++)
+            {
+                entities[i]->update(FRAME_MS);
+                entities[i]->draw(entity_x(i), entity_y(i));
+            }
+            frame_ns.push_back((now_ns() - start) / entities.size());
+        }
+        result.addPhase(pass == 0? "cut" : "crossfade", frame_ns);
+    }
+
+    destroy_entities(entities);
+
+    if(result.phases[0].p50 > 0.0)
+        result.addValue("crossfade/cut p50", result.phases[1].p50 / result.phases[0].p50);
+    return result;
+}
+
+
+// Times loading a document (from the file and from already-parsed XML) and clearing it.
+static Result bench_load(const string& file, int iterations)
+{
+    Result result(file, "load", 0, iterations, "ns/load");
+
+    TiXmlDocument doc;
+    if(!doc.LoadFile(file.c_str()))
+        return result;
+    TiXmlElement* root = doc.FirstChildElement("spriter_data");
+
+    vector<double> load_file_ns, load_xml_ns, clear_ns;
+    size_t arena_bytes = 0;
+    int arena_blocks = 0;
+    for(int i = 0; i < iterations; i++)
+    {
+        SCML::Data data;
+
+        double start = now_ns();
+        data.load(file.c_str());
+        double loaded = now_ns();
+        data.clear();
+        double cleared = now_ns();
+        data.load(root);
+        double loaded_xml = now_ns();
+
+        arena_bytes = data.arena.getBytesUsed();
+        arena_blocks = data.arena.getNumBlocks();
+
+        data.clear();
+        double cleared_xml = now_ns();
+
+        load_file_ns.push_back(loaded - start);
+        load_xml_ns.push_back(loaded_xml - cleared);
+        clear_ns.push_back(cleared - loaded);
+        clear_ns.push_back(cleared_xml - loaded_xml);
+    }
+
+    result.addPhase("load_file", load_file_ns);
+    result.addPhase("load_parsed_xml", load_xml_ns);
+    result.addPhase("clear", clear_ns);
+    result.addValue("arena_bytes", arena_bytes);
+    result.addValue("arena_blocks", arena_blocks);
+    return result;
+}
+
+
+// Keeps the lookups below from being optimized away
+static volatile size_t lookup_sink = 0;
+
+// The linear strcmp scan that Entity::getAnimation(const char*) did before the name tables, for comparison
+static SCML::Entity::Animation* find_animation_by_scan(const Entity* e, const char* name)
+{
+    SCML_BEGIN_MAP_FOREACH_CONST(e->animations, int, SCML::Entity::Animation*, anim)
+    {
+        if(strcmp(SCML_TO_CSTRING(anim->name), name) == 0)
+            return anim;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    return NULL;
+}
+
+// Loads a document with its first entity's first animation copied until the entity has num_animations, named the way a game
+// names them ("<name>_000", "<name>_001", ...), since the samples have too few animations to show what the name tables are for
+static bool load_with_animations(const string& file, int num_animations, SCML::Data& data)
+{
+    TiXmlDocument doc;
+    if(!doc.LoadFile(file.c_str()))
+        return false;
+    TiXmlElement* root = doc.FirstChildElement("spriter_data");
+    TiXmlElement* entity = (root != NULL? root->FirstChildElement("entity") : NULL);
+    TiXmlElement* animation = (entity != NULL? entity->FirstChildElement("animation") : NULL);
+    if(animation == NULL)
+        return false;
+
+    string name = (animation->Attribute("name") != NULL? animation->Attribute("name") : "animation");
+    TiXmlElement copy(*animation);
+    while(entity->FirstChildElement("animation") != NULL)
+        entity->RemoveChild(entity->FirstChildElement("animation"));
+    for(int i = 0; i < num_animations; i++)
+    {
+        char suffix[16];
+        sprintf(suffix, "_%03d", i);
+        copy.SetAttribute("id", i);
+        copy.SetAttribute("name", (name + suffix).c_str());
+        entity->InsertEndChild(copy);
+    }
+    return data.load(root);
+}
+
+// Times finding every animation of every entity by name (the old scan and the name table) and by a cached id.
+static Result bench_names(const string& file, const char* section, SCML::Data& data, FileSystem& fs, int iterations)
+{
+    const int lookups_per_run = 1000;
+    Result result(file, section, 0, iterations, "ns/lookup");
+
+    vector<Entity*> entities;
+    create_entities(entities, data, fs, data.entities.size());
+
+    // Copies of the names, as a caller would have them
+    vector<Entity*> owners;
+    vector<string> names;
+    vector<int> ids;
+    for(size_t i = 0; i < entities.size(); i++)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(entities[i]->animations, int, SCML::Entity::Animation*, anim)
+        {
+            owners.push_back(entities[i]);
+            names.push_back(SCML_TO_CSTRING(anim->name));
+            ids.push_back(anim->id);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    if(names.size() == 0)
+    {
+        destroy_entities(entities);
+        return result;
+    }
+
+    vector<double> scan_ns, table_ns, id_ns;
+    for(int i = 0; i < iterations; i++)
+    {
+        size_t found = 0;
+
+        double start = now_ns();
+        for(int j = 0; j < lookups_per_run; j++)
+        {
+            size_t k = j % names.size();
+            found += (find_animation_by_scan(owners[k], names[k].c_str()) != NULL);
+        }
+        double scanned = now_ns();
+        for(int j = 0; j < lookups_per_run; j++)
+        {
+            size_t k = j % names.size();
+            found += (owners[k]->getAnimation(names[k].c_str()) != NULL);
+        }
+        double hashed = now_ns();
+        for(int j = 0; j < lookups_per_run; j++)
+        {
+            size_t k = j % names.size();
+            found += (owners[k]->getAnimation(ids[k]) != NULL);
+        }
+        double by_id = now_ns();
+
+        lookup_sink += found;
+        scan_ns.push_back((scanned - start) / lookups_per_run);
+        table_ns.push_back((hashed - scanned) / lookups_per_run);
+        id_ns.push_back((by_id - hashed) / lookups_per_run);
+    }
+
+    destroy_entities(entities);
+
+    result.addPhase("strcmp_scan", scan_ns);
+    result.addPhase("name_table", table_ns);
+    result.addPhase("cached_id", id_ns);
+    result.addValue("animations", names.size());
+    return result;
+}
+
+
+// Allocations made through SCML::allocate() and those made elsewhere on the heap
+class Alloc_Count
+{
+public:
+    SCML::Allocation_Stats scml;
+    unsigned long heap_allocations;
+    unsigned long heap_bytes;
+
+    Alloc_Count()
+        : heap_allocations(0), heap_bytes(0)
+    {}
+
+    static Alloc_Count now()
+    {
+        Alloc_Count result;
+        result.scml = SCML::getAllocationStats();
+        result.heap_allocations = ::heap_allocations;
+        result.heap_bytes = ::heap_bytes;
+        return result;
+    }
+
+    Alloc_Count operator-(const Alloc_Count& other) const
+    {
+        Alloc_Count result;
+        result.scml = scml - other.scml;
+        result.heap_allocations = heap_allocations - other.heap_allocations;
+        result.heap_bytes = heap_bytes - other.heap_bytes;
+        return result;
+    }
+
+    void add(const Alloc_Count& other)
+    {
+        scml.allocations += other.scml.allocations;
+        scml.deallocations += other.scml.deallocations;
+        scml.bytes_allocated += other.scml.bytes_allocated;
+        scml.bytes_deallocated += other.scml.bytes_deallocated;
+        heap_allocations += other.heap_allocations;
+        heap_bytes += other.heap_bytes;
+    }
+
+    unsigned long getAllocations() const
+    {
+        return scml.allocations + heap_allocations;
+    }
+};
+
+class Alloc_Result
+{
+public:
+    string file;
+    int entities;
+    int frames;
+
+    vector<string> phase_names;
+    vector<Alloc_Count> phases;
+    // How many times each phase was run, for the per-run numbers
+    vector<int> phase_runs;
+
+    // Reserves space so that adding phases doesn't show up in the counts
+    Alloc_Result(const string& file, int entities, int frames)
+        : file(file), entities(entities), frames(frames)
+    {
+        phase_names.reserve(8);
+        phases.reserve(8);
+        phase_runs.reserve(8);
+    }
+
+    void addPhase(const string& name, const Alloc_Count& count, int runs = 1)
+    {
+        phase_names.push_back(name);
+        phases.push_back(count);
+        phase_runs.push_back(runs);
+    }
+
+    void print() const
+    {
+        // Every number is per run of its phase, and the SCML and other heap numbers add up to the first two
+        printf("%s [alloc] %d entities x %d frames, per entity for entity_create and per frame for frame\n", file.c_str(), entities, frames);
+        for(size_t i = 0; i < phases.size(); i++)
+        {
+            const Alloc_Count& c = phases[i];
+            double runs = phase_runs[i];
+            printf("    %-24s %10.1f allocs %12.1f bytes (SCML: %.1f allocs, %.1f bytes, %.1f frees; other heap: %.1f allocs, %.1f bytes)\n", phase_names[i].c_str(),
+                   c.getAllocations() / runs, (c.scml.bytes_allocated + c.heap_bytes) / runs,
+                   c.scml.allocations / runs, c.scml.bytes_allocated / runs, c.scml.deallocations / runs, c.heap_allocations / runs, c.heap_bytes / runs);
+        }
+    }
+
+    void writeJSON(FILE* out) const
+    {
+        fprintf(out, "    {\"file\": \"%s\", \"entities\": %d, \"frames\": %d, \"phases\": {", file.c_str(), entities, frames);
+        for(size_t i = 0; i < phases.size(); i++)
+        {
+            const Alloc_Count& c = phases[i];
+            fprintf(out, "%s\"%s\": {\"runs\": %d, \"scml_allocations\": %lu, \"scml_bytes\": %lu, \"scml_deallocations\": %lu, \"heap_allocations\": %lu, \"heap_bytes\": %lu}",
+                    (i > 0? ", " : ""), phase_names[i].c_str(), phase_runs[i], c.scml.allocations, c.scml.bytes_allocated, c.scml.deallocations, c.heap_allocations, c.heap_bytes);
+        }
+        fprintf(out, "}}");
+    }
+};
+
+// Counts allocations per load, per entity creation, and per frame.  steady_state_allocations gets the number of allocations made by update() and draw() after warming up.
+static Alloc_Result bench_alloc(const string& file, int num_entities, int num_frames, unsigned long& steady_state_allocations)
+{
+    Alloc_Result result(file, num_entities, num_frames);
+    vector<Entity*> entities;
+    entities.reserve(num_entities);
+
+    Alloc_Count start = Alloc_Count::now();
+    SCML::Data* data = new SCML::Data(file.c_str());
+    Alloc_Count loaded = Alloc_Count::now();
+    result.addPhase("data_load", loaded - start);
+
+    FileSystem* fs = new FileSystem;
+    fs->load(data);
+    Alloc_Count fs_loaded = Alloc_Count::now();
+    result.addPhase("filesystem_load", fs_loaded - loaded);
+
+    create_entities(entities, *data, *fs, num_entities);
+    Alloc_Count created = Alloc_Count::now();
+    result.addPhase("entity_create", created - fs_loaded, num_entities);
+
+    // Draw every animation once so that per-entity buffers reach their full size
+    for(size_t i = 0; i < entities.size(); i++)
+    {
+        Entity* e = entities[i];
+        int animation = e->animation;
+        int time = e->time;
+        for(int a = 0; a < e->getNumAnimations(); a++)
+        {
+            e->startAnimation(a);
+            e->draw(entity_x(i), entity_y(i));
+        }
+        e->startAnimation(animation);
+        e->update(time);
+    }
+    Alloc_Count warmed = Alloc_Count::now();
+    result.addPhase("warm_up", warmed - created);
+
+    Alloc_Count frame_total;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(entities);
+
+        Alloc_Count before = Alloc_Count::now();
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            entities[i]->update(FRAME_MS);
+            entities[i]->draw(entity_x(i), entity_y(i));
+        }
+        frame_total.add(Alloc_Count::now() - before);
+    }
+    result.addPhase("frame", frame_total, num_frames);
+    steady_state_allocations = frame_total.getAllocations();
+
+    Alloc_Count before_destroy = Alloc_Count::now();
+    destroy_entities(entities);
+    delete fs;
+    delete data;
+    result.addPhase("destroy", Alloc_Count::now() - before_destroy);
+
+    return result;
+}
+
+
+// Compares entities that store their keys in full with ones that pack them
+static Result bench_quantize(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "quantize", num_entities, num_frames);
+    bool quantize_keys = data.quantize_keys;
+
+    vector<Entity*> entities;
+    double bytes[2] = {0.0, 0.0};
+    for(int pass = 0; pass < 2; pass++)
+    {
+        destroy_entities(entities);
+        data.quantize_keys = (pass == 1);
+
+        Alloc_Count before = Alloc_Count::now();
+        create_entities(entities, data, fs, num_entities);
+        Alloc_Count created = Alloc_Count::now() - before;
+        if(entities.size() == 0)
+            break;
+        bytes[pass] = (double(created.scml.bytes_allocated) - double(created.scml.bytes_deallocated) + created.heap_bytes) / entities.size();
+
+        vector<double> frame_ns;
+        for(int frame = 0; frame < num_frames; frame++)
+        {
+            restart_finished(entities);
+
+            double start = now_ns();
+            for(size_t i = 0; i < entities.size(); i++)
+            {
+                entities[i]->update(FRAME_MS);
+                entities[i]->draw(entity_x(i), entity_y(i));
+            }
+            frame_ns.push_back((now_ns() - start) / entities.size());
+        }
+        result.addPhase(pass == 0? "full" : "quantized", frame_ns);
+    }
+
+    // The error bounds of the packed keys, over one entity of each kind
+    typedef SCML::Entity::Animation::Timeline::Packed_Keys Packed_Keys;
+    float position_error = 0.0f;
+    float angle_error = 0.0f;
+    float scale_error = 0.0f;
+    int packed = 0;
+    int timelines = 0;
+    for(size_t i = 0; i < entities.size() && i < data.entities.size(); i++)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(entities[i]->animations, int, SCML::Entity::Animation*, animation)
+        {
+            SCML_BEGIN_MAP_FOREACH_CONST(animation->timelines, int, SCML::Entity::Animation::Timeline*, timeline)
+            {
+                timelines++;
+                if(timeline->packed == NULL)
+                    continue;
+                packed++;
+                position_error = max(position_error, max(timeline->packed->getMaxError(Packed_Keys::X), timeline->packed->getMaxError(Packed_Keys::Y)));
+                angle_error = max(angle_error, timeline->packed->getMaxError(Packed_Keys::ANGLE));
+                scale_error = max(scale_error, max(timeline->packed->getMaxError(Packed_Keys::SCALE_X), timeline->packed->getMaxError(Packed_Keys::SCALE_Y)));
+            }
+            SCML_END_MAP_FOREACH_CONST;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+
+    destroy_entities(entities);
+    data.quantize_keys = quantize_keys;
+
+    result.addValue("full bytes/entity", bytes[0]);
+    result.addValue("quantized bytes/entity", bytes[1]);
+    if(bytes[0] > 0.0)
+        result.addValue("saved %", 100.0 * (1.0 - bytes[1] / bytes[0]));
+    result.addValue("packed timelines %", (timelines > 0? 100.0 * packed / timelines : 0.0));
+    // In thousandths, so they show at this precision
+    result.addValue("position error (1e-3 px)", 1000.0 * position_error);
+    result.addValue("angle error (1e-3 deg)", 1000.0 * angle_error);
+    result.addValue("scale error (1e-3)", 1000.0 * scale_error);
+    return result;
+}
+
+
+// Compares loading the document and creating entities with every animation loaded against deferring the animations
+static Result bench_lazy(const string& file, int num_entities, int iterations)
+{
+    Result result(file, "lazy", num_entities, iterations, "ns/startup");
+
+    double resident[2] = {0.0, 0.0};
+    int deferred = 0;
+    vector<double> first_start_ns;
+    for(int pass = 0; pass < 2; pass++)
+    {
+        vector<double> startup_ns;
+        for(int i = 0; i < iterations; i++)
+        {
+            vector<Entity*> entities;
+            entities.reserve(num_entities);
+
+            Alloc_Count before = Alloc_Count::now();
+            double start = now_ns();
+            SCML::Data* data = new SCML::Data;
+            data->defer_animations = (pass == 1);
+            if(!data->load(file.c_str()))
+            {
+                delete data;
+                return result;
+            }
+            FileSystem* fs = new FileSystem;
+            fs->load(data);
+            create_entities(entities, *data, *fs, num_entities);
+            startup_ns.push_back(now_ns() - start);
+
+            // Only what SCML::allocate() still holds: the parser's memory is gone by now
+            Alloc_Count created = Alloc_Count::now() - before;
+            resident[pass] = double(created.scml.bytes_allocated) - double(created.scml.bytes_deallocated);
+            deferred = SCML_VECTOR_SIZE(data->deferred_spans)/2;
+
+            if(pass == 1)
+            {
+                // Starting each of the other animations loads it once for the Data and once for each entity
+                start = now_ns();
+                for(size_t j = 0; j < entities.size(); j++)
+                {
+                    Entity* e = entities[j];
+                    for(int a = 1; a < e->getNumAnimations(); a++)
+                        e->startAnimation(a);
+                }
+                first_start_ns.push_back(now_ns() - start);
+            }
+
+            destroy_entities(entities);
+            delete fs;
+            delete data;
+        }
+        result.addPhase(pass == 0? "eager" : "lazy", startup_ns);
+    }
+    result.addPhase("lazy start the rest", first_start_ns);
+
+    result.addValue("eager resident KB", resident[0] / 1024.0);
+    result.addValue("lazy resident KB", resident[1] / 1024.0);
+    if(resident[0] > 0.0)
+        result.addValue("saved %", 100.0 * (1.0 - resident[1] / resident[0]));
+    result.addValue("deferred animations", deferred);
+    return result;
+}
+
+
+// Keeps the scan below from being optimized away
+static volatile int trigger_sink = 0;
+
+// Times update() without triggers, with num_triggers event keys per animation, and with a scan of those keys instead of the index
+static Result bench_triggers(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames, int num_triggers)
+{
+    Result result(file, "triggers", num_entities, num_frames);
+
+    vector<Entity*> entities;
+    create_entities(entities, data, fs, num_entities);
+    if(entities.size() == 0)
+        return result;
+
+    vector<const SCML::Entity::Animation::Trigger*> buffer(num_triggers);
+    for(size_t i = 0; i < entities.size(); i++)
+        entities[i]->setTriggerBuffer(&buffer[0], num_triggers);
+
+    unsigned long fired = 0;
+    for(int pass = 0; pass < 3; pass++)
+    {
+        // Spread the keys evenly over each animation
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            SCML_BEGIN_MAP_FOREACH_CONST(entities[i]->animations, int, SCML::Entity::Animation*, animation)
+            {
+                SCML_VECTOR_RESIZE(animation->triggers, (pass == 0? 0 : num_triggers));
+                for(int j = 0; j < (int)SCML_VECTOR_SIZE(animation->triggers); j++)
+                    animation->triggers[j].time = animation->length * j / num_triggers;
+                SCML_VECTOR_RESIZE(animation->trigger_names, 1);
+            }
+            SCML_END_MAP_FOREACH_CONST;
+        }
+
+        vector<double> update_ns;
+        for(int frame = 0; frame < num_frames; frame++)
+        {
+            restart_finished(entities);
+
+            double start = now_ns();
+            for(size_t i = 0; i < entities.size(); i++)
+            {
+                Entity* e = entities[i];
+                if(pass == 2)
+                {
+                    // What update() would do without the index: check every key against this frame's span
+                    SCML::Entity::Animation* animation = e->getAnimation(e->animation);
+                    int count = 0;
+                    for(int j = 0; j < num_triggers; j++)
+                    {
+                        int t = animation->triggers[j].time;
+                        if(t >= e->time && t < e->time + FRAME_MS)
+                            count++;
+                    }
+                    trigger_sink += count;
+                    SCML_VECTOR_CLEAR(animation->triggers);
+                    e->update(FRAME_MS);
+                    SCML_VECTOR_RESIZE(animation->triggers, num_triggers);
+                }
+                else
+                {
+                    e->update(FRAME_MS);
+                    fired += e->getNumTriggers();
+                }
+            }
+            update_ns.push_back((now_ns() - start) / entities.size());
+        }
+        result.addPhase(pass == 0? "update" : (pass == 1? "update+index" : "update+scan"), update_ns);
+    }
+
+    destroy_entities(entities);
+    result.addValue("triggers/animation", num_triggers);
+    result.addValue("fired/entity/frame", double(fired) / (double(num_frames) * num_entities));
+    return result;
+}
+
+
+// Keeps the lookups below from being optimized away
+static volatile float variable_sink = 0.0f;
+
+// Puts meta data in every timeline key of the document text.  The format gets a count of the keys so far, modulo modulus.
+static string add_bench_meta_data(const string& text, const char* format, int modulus)
+{
+    string result;
+    int value = 0;
+    bool in_timeline = false;
+    size_t pos = 0;
+    while(pos < text.size())
+    {
+        size_t tag = text.find('<', pos);
+        if(tag == string::npos)
+            break;
+        size_t end = text.find('>', tag);
+        if(end == string::npos)
+            break;
+        result.append(text, pos, end + 1 - pos);
+        pos = end + 1;
+
+        if(text.compare(tag, 9, "<timeline") == 0)
+            in_timeline = true;
+        else if(text.compare(tag, 11, "</timeline>") == 0)
+            in_timeline = false;
+        else if(in_timeline && text.compare(tag, 5, "<key ") == 0 && text[end - 1] != '/')
+        {
+            char meta[128];
+            sprintf(meta, format, value++ % modulus);
+            result += meta;
+        }
+    }
+    result.append(text, pos, string::npos);
+    return result;
+}
+
+// What reading a variable takes without handles: finding the key at the entity's time in the SCML::Data and the variable in it by name, untweened
+static bool find_variable_by_name(SCML::Data& data, const Entity* e, const char* name, float& value)
+{
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(data.entities, e->entity);
+    SCML::Data::Entity::Animation* animation_ptr = (entity_ptr != NULL? SCML_MAP_FIND(entity_ptr->animations, e->animation) : NULL);
+    if(animation_ptr == NULL)
+        return false;
+
+    typedef SCML::Data::Entity::Animation::Timeline Timeline;
+    SCML_BEGIN_MAP_FOREACH_CONST(animation_ptr->timelines, int, Timeline*, timeline)
+    {
+        const Timeline::Key* found = NULL;
+        SCML_BEGIN_MAP_FOREACH_CONST(timeline->keys, int, Timeline::Key*, key)
+        {
+            if(key->time > e->time)
+                break;
+            found = key;
+        }
+        SCML_END_MAP_FOREACH_CONST;
+
+        const SCML::Data::Meta_Data_Tweenable* meta_data = NULL;
+        if(found != NULL)
+            meta_data = (found->has_object? found->object.meta_data : found->bone.meta_data);
+        if(meta_data != NULL)
+        {
+            SCML::Data::Meta_Data_Tweenable::Variable* variable = SCML_MAP_FIND(meta_data->variables, SCML_STRING(name));
+            if(variable != NULL)
+            {
+                value = variable->value_float;
+                return true;
+            }
+        }
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    return false;
+}
+
+static bool read_text(const string& file, string& text)
+{
+    FILE* f = fopen(file.c_str(), "rb");
+    if(f == NULL)
+        return false;
+    char buffer[4096];
+    size_t n;
+    while((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        text.append(buffer, n);
+    fclose(f);
+    return true;
+}
+
+// Times reading a variable of every entity each frame, with Entity::getVariables() and by name
+static Result bench_variables(const string& file, int num_entities, int num_frames)
+{
+    Result result(file, "variables", num_entities, num_frames);
+
+    string text;
+    if(!read_text(file, text))
+        return result;
+
+    SCML::Data data;
+    if(!data.fromTextData(add_bench_meta_data(text, "<meta_data><variable name=\"bench_value\" type=\"float\" value=\"%d\"/></meta_data>", 100).c_str()))
+        return result;
+    FileSystem fs;
+    fs.load(&data);
+
+    vector<Entity*> entities;
+    create_entities(entities, data, fs, num_entities);
+    if(entities.size() == 0)
+        return result;
+
+    int handle = entities[0]->getVariableHandle("bench_value");
+    vector<SCML::Entity::Variable_Value> values(entities.size());
+    vector<const SCML::Entity*> entity_list(entities.begin(), entities.end());
+
+    vector<double> name_ns, handle_ns;
+    unsigned long found = 0;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(entities);
+        for(size_t i = 0; i < entities.size(); i++)
+            entities[i]->update(FRAME_MS);
+
+        float sum = 0.0f;
+        double start = now_ns();
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            float value = 0.0f;
+            if(find_variable_by_name(data, entities[i], "bench_value", value))
+                sum += value;
+        }
+        double named = now_ns();
+        found += SCML::Entity::getVariables(&entity_list[0], entity_list.size(), handle, &values[0]);
+        double handled = now_ns();
+        for(size_t i = 0; i < values.size(); i++)
+            sum += values[i].value_float;
+
+        variable_sink += sum;
+        name_ns.push_back((named - start) / entities.size());
+        handle_ns.push_back((handled - named) / entities.size());
+    }
+
+    destroy_entities(entities);
+    result.addPhase("by name", name_ns);
+    result.addPhase("by handle", handle_ns);
+    result.addValue("found %", 100.0 * double(found) / (double(num_frames) * num_entities));
+    return result;
+}
+
+
+static bool timeline_key_has_tag(const SCML::Data::Entity::Animation* animation_ptr, int timeline, int key, const char* name)
+{
+    SCML::Data::Entity::Animation::Timeline* timeline_ptr = SCML_MAP_FIND(animation_ptr->timelines, timeline);
+    SCML::Data::Entity::Animation::Timeline::Key* key_ptr = (timeline_ptr != NULL? SCML_MAP_FIND(timeline_ptr->keys, key) : NULL);
+    return (key_ptr != NULL && key_ptr->meta_data != NULL && SCML_MAP_FIND(key_ptr->meta_data->tags, SCML_STRING(name)) != NULL);
+}
+
+// What testing for a tag takes without tag sets: looking it up by name in the current mainline key and the timeline keys it refers to
+static bool has_tag_by_name(SCML::Data& data, const Entity* e, const char* name)
+{
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(data.entities, e->entity);
+    SCML::Data::Entity::Animation* animation_ptr = (entity_ptr != NULL? SCML_MAP_FIND(entity_ptr->animations, e->animation) : NULL);
+    if(animation_ptr == NULL)
+        return false;
+    SCML::Data::Entity::Animation::Mainline::Key* key = SCML_MAP_FIND(animation_ptr->mainline.keys, e->key);
+    if(key == NULL)
+        return false;
+    if(key->meta_data != NULL && SCML_MAP_FIND(key->meta_data->tags, SCML_STRING(name)) != NULL)
+        return true;
+
+    typedef SCML::Data::Entity::Animation::Mainline::Key::Bone_Container Bone_Container;
+    SCML_BEGIN_MAP_FOREACH_CONST(key->bones, int, Bone_Container, item)
+    {
+        if(item.hasBone_Ref() && timeline_key_has_tag(animation_ptr, item.bone_ref->timeline, item.bone_ref->key, name))
+            return true;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    typedef SCML::Data::Entity::Animation::Mainline::Key::Object_Container Object_Container;
+    SCML_BEGIN_MAP_FOREACH_CONST(key->objects, int, Object_Container, item)
+    {
+        if(item.hasObject_Ref() && timeline_key_has_tag(animation_ptr, item.object_ref->timeline, item.object_ref->key, name))
+            return true;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    return false;
+}
+
+// Times finding the entities with a tag each frame, with Entity::findTagged() and by name
+static Result bench_tags(const string& file, int num_entities, int num_frames)
+{
+    Result result(file, "tags", num_entities, num_frames);
+
+    string text;
+    if(!read_text(file, text))
+        return result;
+
+    // One of 8 tags in each timeline key
+    SCML::Data data;
+    if(!data.fromTextData(add_bench_meta_data(text, "<meta_data><tag name=\"bench_tag_%d\"/></meta_data>", 8).c_str()))
+        return result;
+    FileSystem fs;
+    fs.load(&data);
+
+    vector<Entity*> entities;
+    create_entities(entities, data, fs, num_entities);
+    if(entities.size() == 0)
+        return result;
+
+    SCML::Tag_Set query;
+    query.add(entities[0]->getTagHandle("bench_tag_3"));
+    vector<const SCML::Entity*> entity_list(entities.begin(), entities.end());
+    vector<int> matches(entities.size());
+
+    vector<double> name_ns, set_ns;
+    unsigned long found[2] = {0, 0};
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(entities);
+        for(size_t i = 0; i < entities.size(); i++)
+            entities[i]->update(FRAME_MS);
+
+        double start = now_ns();
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            if(has_tag_by_name(data, entities[i], "bench_tag_3"))
+                matches[found[0]++ % matches.size()] = i;
+        }
+        double named = now_ns();
+        found[1] += SCML::Entity::findTagged(&entity_list[0], entity_list.size(), query, &matches[0]);
+        double by_set = now_ns();
+
+        name_ns.push_back((named - start) / entities.size());
+        set_ns.push_back((by_set - named) / entities.size());
+    }
+
+    destroy_entities(entities);
+    result.addPhase("by name", name_ns);
+    result.addPhase("tag set", set_ns);
+    result.addValue("tags", data.tag_names.size());
+    result.addValue("matched %", 100.0 * double(found[1]) / (double(num_frames) * num_entities));
+    if(found[0] != found[1])
+        printf("    Mismatch: %lu by name, %lu by tag set\n", found[0], found[1]);
+    return result;
+}
+
+
+static volatile float query_sink = 0.0f;
+
+// Times querying every object's transform after draw() and after the bones are rebuilt without drawing.
+static Result bench_queries(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "queries", num_entities, num_frames);
+
+    vector<Entity*> entities;
+    create_entities(entities, data, fs, num_entities);
+    if(entities.size() == 0)
+        return result;
+
+    vector<double> drawn_ns, rebuilt_ns;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(entities);
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            entities[i]->update(FRAME_MS);
+            entities[i]->draw(entity_x(i), entity_y(i));
+        }
+
+        float sum = 0.0f;
+        double start = now_ns();
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            int num_objects = entities[i]->getNumObjects();
+            for(int j = 0; j < num_objects; j++)
+            {
+                SCML::Transform transform;
+                if(entities[i]->getObjectTransform(transform, j))
+                    sum += transform.x;
+            }
+        }
+        double queried = now_ns();
+
+        // A rebuild drops the evaluated objects, like an update() without a draw()
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            Entity* e = entities[i];
+            e->bone_transform_state.rebuild(e->entity, e->animation, e->key, e->time, e, SCML::Transform(entity_x(i), entity_y(i), 0.0f, 1.0f, 1.0f));
+        }
+
+        double rebuilt = now_ns();
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            int num_objects = entities[i]->getNumObjects();
+            for(int j = 0; j < num_objects; j++)
+            {
+                SCML::Transform transform;
+                if(entities[i]->getObjectTransform(transform, j))
+                    sum -= transform.x;
+            }
+        }
+        double requeried = now_ns();
+
+        query_sink += sum;
+        drawn_ns.push_back((queried - start) / entities.size());
+        rebuilt_ns.push_back((requeried - rebuilt) / entities.size());
+    }
+
+    destroy_entities(entities);
+    result.addPhase("after draw", drawn_ns);
+    result.addPhase("evaluating", rebuilt_ns);
+    return result;
+}
+
+// Times drawing every entity into 4 views with draw() for each and with drawViews()
+static Result bench_views(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "views", num_entities, num_frames);
+
+    vector<Entity*> entities;
+    create_entities(entities, data, fs, num_entities);
+    if(entities.size() == 0)
+        return result;
+
+    const int num_views = 4;
+    vector<double> draw_ns, views_ns;
+    unsigned long sprites[2] = {0, 0};
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(entities);
+        for(size_t i = 0; i < entities.size(); i++)
+            entities[i]->update(FRAME_MS);
+
+        double start = now_ns();
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            Entity* e = entities[i];
+            unsigned long before = e->sprites_drawn;
+            e->draw(entity_x(i), entity_y(i));
+            e->draw(entity_x(i) * 0.1f, entity_y(i) * 0.1f, 0.0f, 0.1f, 0.1f);
+            e->draw(entity_x(i), -entity_y(i), 0.0f, 1.0f, -1.0f);
+            e->draw(entity_x(i) + 10.0f, entity_y(i), 0.0f, 1.0f, 0.5f);
+            sprites[0] += e->sprites_drawn - before;
+        }
+        double drawn = now_ns();
+        for(size_t i = 0; i < entities.size(); i++)
+        {
+            Entity* e = entities[i];
+            unsigned long before = e->sprites_drawn;
+            SCML::Transform views[num_views] = {SCML::Transform(entity_x(i), entity_y(i), 0.0f, 1.0f, 1.0f),
+                                                SCML::Transform(entity_x(i) * 0.1f, entity_y(i) * 0.1f, 0.0f, 0.1f, 0.1f),
+                                                SCML::Transform(entity_x(i), -entity_y(i), 0.0f, 1.0f, -1.0f),
+                                                SCML::Transform(entity_x(i) + 10.0f, entity_y(i), 0.0f, 1.0f, 0.5f)};
+            e->drawViews(views, num_views);
+            sprites[1] += e->sprites_drawn - before;
+        }
+        double viewed = now_ns();
+
+        draw_ns.push_back((drawn - start) / entities.size());
+        views_ns.push_back((viewed - drawn) / entities.size());
+    }
+
+    destroy_entities(entities);
+    result.addPhase("draw() x4", draw_ns);
+    result.addPhase("drawViews()", views_ns);
+    if(sprites[0] != sprites[1])
+        printf("    Mismatch: %lu sprites drawn by draw(), %lu by drawViews()\n", sprites[0], sprites[1]);
+    return result;
+}
+
+// A null renderer entity in a y-down coordinate system, through the virtual interface
+class Virtual_Entity : public Entity
+{
+public:
+
+    Virtual_Entity(SCML::Data* data, int entity)
+        : Entity(data, entity)
+    {}
+
+    virtual void convert_to_SCML_coords(float& x, float& y, float& angle)
+    {
+        y = -y;
+        angle = 360 - angle;
+    }
+
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+    {
+        y = -y;
+        angle = 360 - angle;
+        Entity::draw_internal(folderID, fileID, x, y, angle, scale_x, scale_y);
+    }
+};
+
+// The same, with the renderer and coordinate system chosen at compile time
+class Policy_Entity : public SCML::Renderer_Entity<Policy_Entity, SCML::Left_Handed_Coords>
+{
+public:
+
+    FileSystem* file_system;
+    unsigned long sprites_drawn;
+    float checksum;
+
+    Policy_Entity(SCML::Data* data, int entity)
+        : SCML::Renderer_Entity<Policy_Entity, SCML::Left_Handed_Coords>(data, entity), file_system(NULL), sprites_drawn(0), checksum(0.0f)
+    {}
+
+    SCML_PAIR(unsigned int, unsigned int) getImageSize(int folderID, int fileID) const
+    {
+        return file_system->getImageDimensions(folderID, fileID);
+    }
+
+    void drawImage(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+    {
+        sprites_drawn++;
+        checksum += x + y;
+    }
+};
+
+// Times draw() through the virtual renderer interface and through SCML::Renderer_Entity
+static Result bench_policies(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "policies", num_entities, num_frames);
+    if(data.entities.size() == 0)
+        return result;
+
+    vector<Entity*> virtual_entities;
+    vector<Policy_Entity*> policy_entities;
+    for(int i = 0; i < num_entities; i++)
+    {
+        int entity = data.entities.begin()->first;
+        virtual_entities.push_back(new Virtual_Entity(&data, entity));
+        policy_entities.push_back(new Policy_Entity(&data, entity));
+        virtual_entities.back()->setFileSystem(&fs);
+        policy_entities.back()->file_system = &fs;
+        virtual_entities.back()->update((i * 97) % 1000);
+        policy_entities.back()->update((i * 97) % 1000);
+    }
+
+    vector<double> virtual_ns, policy_ns;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(virtual_entities);
+        for(size_t i = 0; i < policy_entities.size(); i++)
+        {
+            Policy_Entity* e = policy_entities[i];
+            SCML::Entity::Animation* anim = e->getAnimation(e->animation);
+            if(anim != NULL && anim->looping != "true" && e->time >= anim->length)
+                e->startAnimation((e->animation + 1) % e->getNumAnimations());
+        }
+        for(int i = 0; i < num_entities; i++)
+        {
+            virtual_entities[i]->update(FRAME_MS);
+            policy_entities[i]->update(FRAME_MS);
+        }
+
+        // Alternate which goes first, so neither always finds the caches warmed by the other
+        for(int pass = 0; pass < 2; pass++)
+        {
+            double start = now_ns();
+            if((pass + frame) % 2 == 0)
+            {
+                for(int i = 0; i < num_entities; i++)
+                    virtual_entities[i]->draw(entity_x(i), entity_y(i), 10.0f, 1.5f, 1.5f);
+                virtual_ns.push_back((now_ns() - start) / num_entities);
+            }
+            else
+            {
+                for(int i = 0; i < num_entities; i++)
+                    policy_entities[i]->draw(entity_x(i), entity_y(i), 10.0f, 1.5f, 1.5f);
+                policy_ns.push_back((now_ns() - start) / num_entities);
+            }
+        }
+    }
+
+    float checksums[2] = {0.0f, 0.0f};
+    for(int i = 0; i < num_entities; i++)
+    {
+        checksums[0] += virtual_entities[i]->checksum;
+        checksums[1] += policy_entities[i]->checksum;
+        delete policy_entities[i];
+    }
+    destroy_entities(virtual_entities);
+
+    result.addPhase("virtual", virtual_ns);
+    result.addPhase("policies", policy_ns);
+    if(fabs(checksums[0] - checksums[1]) > 1e-3f * fabs(checksums[0]))
+        printf("    Mismatch: checksum %f through the virtual functions, %f through the policies\n", checksums[0], checksums[1]);
+    return result;
+}
+
+// A null renderer that submits the corners of each image, as a vertex-submitting backend would
+class Decomposed_Entity : public Entity
+{
+public:
+
+    Decomposed_Entity(SCML::Data* data, int entity)
+        : Entity(data, entity)
+    {}
+
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+    {
+        SCML_PAIR(unsigned int, unsigned int) dims = getImageDimensions(folderID, fileID);
+        float s = sinf(angle*M_PI/180);
+        float c = cosf(angle*M_PI/180);
+        float hw = SCML_PAIR_FIRST(dims)*scale_x/2;
+        float hh = SCML_PAIR_SECOND(dims)*scale_y/2;
+        float u[4] = {-hw, hw, hw, -hw};
+        float v[4] = {-hh, -hh, hh, hh};
+        for(int i = 0; i < 4; i++)
+            checksum += (x + u[i]*c - v[i]*s) + (y + u[i]*s + v[i]*c);
+        sprites_drawn++;
+    }
+};
+
+// The same, with the corners from the matrix
+class Affine_Entity : public Entity
+{
+public:
+
+    Affine_Entity(SCML::Data* data, int entity)
+        : Entity(data, entity)
+    {
+        affine_output = true;
+    }
+
+    virtual void draw_internal_affine(int folderID, int fileID, const SCML::Affine& transform)
+    {
+        SCML_PAIR(unsigned int, unsigned int) dims = getImageDimensions(folderID, fileID);
+        float corners[8];
+        transform.getCorners(SCML_PAIR_FIRST(dims), SCML_PAIR_SECOND(dims), corners);
+        for(int i = 0; i < 8; i++)
+            checksum += corners[i];
+        sprites_drawn++;
+    }
+};
+
+// Times draw() for a quad-submitting renderer through draw_internal() and through draw_internal_affine()
+static Result bench_affine(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "affine", num_entities, num_frames);
+    if(data.entities.size() == 0)
+        return result;
+
+    vector<Entity*> entities[2];
+    for(int i = 0; i < num_entities; i++)
+    {
+        int entity = data.entities.begin()->first;
+        entities[0].push_back(new Decomposed_Entity(&data, entity));
+        entities[1].push_back(new Affine_Entity(&data, entity));
+        for(int path = 0; path < 2; path++)
+        {
+            entities[path].back()->setFileSystem(&fs);
+            entities[path].back()->update((i * 97) % 1000);
+        }
+    }
+
+    vector<double> ns[2];
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        for(int path = 0; path < 2; path++)
+        {
+            restart_finished(entities[path]);
+            for(int i = 0; i < num_entities; i++)
+                entities[path][i]->update(FRAME_MS);
+        }
+
+        // Alternate which goes first, so neither always finds the caches warmed by the other
+        for(int pass = 0; pass < 2; pass++)
+        {
+            int path = (pass + frame) % 2;
+            double start = now_ns();
+            for(int i = 0; i < num_entities; i++)
+                entities[path][i]->draw(entity_x(i), entity_y(i), 10.0f, 1.5f, 1.5f);
+            ns[path].push_back((now_ns() - start) / num_entities);
+        }
+    }
+
+    float checksums[2] = {0.0f, 0.0f};
+    unsigned long sprites[2] = {0, 0};
+    for(int path = 0; path < 2; path++)
+    {
+        for(int i = 0; i < num_entities; i++)
+        {
+            checksums[path] += entities[path][i]->checksum;
+            sprites[path] += entities[path][i]->sprites_drawn;
+        }
+        destroy_entities(entities[path]);
+    }
+
+    double total_ns[2] = {0.0, 0.0};
+    for(int path = 0; path < 2; path++)
+    {
+        for(size_t frame = 0; frame < ns[path].size(); frame++)
+            total_ns[path] += ns[path][frame] * num_entities;
+    }
+
+    result.addPhase("draw_internal()", ns[0]);
+    result.addPhase("draw_internal_affine()", ns[1]);
+    if(sprites[0] > 0)
+        result.addValue("ns saved/sprite", (total_ns[0] - total_ns[1]) / sprites[0]);
+    if(sprites[0] != sprites[1] || fabs(checksums[0] - checksums[1]) > 1e-3f * fabs(checksums[0]))
+        printf("    Mismatch: %lu sprites with checksum %f through draw_internal(), %lu with %f through draw_internal_affine()\n", sprites[0], checksums[0], sprites[1], checksums[1]);
+    return result;
+}
+
+// Times draw(), bones included, with float and fixed-point evaluation
+static Result bench_fixed(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "fixed", num_entities, num_frames);
+
+    vector<Entity*> entities[2];
+    create_entities(entities[0], data, fs, num_entities);
+    create_entities(entities[1], data, fs, num_entities);
+    for(size_t i = 0; i < entities[1].size(); i++)
+        entities[1][i]->fixed_point = true;
+
+    vector<double> ns[2];
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        for(int path = 0; path < 2; path++)
+        {
+            restart_finished(entities[path]);
+            for(size_t i = 0; i < entities[path].size(); i++)
+                entities[path][i]->update(FRAME_MS);
+        }
+
+        // Alternate which goes first, so neither always finds the caches warmed by the other
+        for(int pass = 0; pass < 2; pass++)
+        {
+            int path = (pass + frame) % 2;
+            double start = now_ns();
+            for(size_t i = 0; i < entities[path].size(); i++)
+                entities[path][i]->draw(entity_x(i), entity_y(i), 10.0f, 1.5f, 1.5f);
+            ns[path].push_back((now_ns() - start) / entities[path].size());
+        }
+    }
+
+    // The null renderer sums x + y of every sprite
+    double error = 0.0;
+    unsigned long sprites[2] = {0, 0};
+    for(size_t i = 0; i < entities[0].size(); i++)
+    {
+        error += fabs(entities[1][i]->checksum - entities[0][i]->checksum);
+        sprites[0] += entities[0][i]->sprites_drawn;
+        sprites[1] += entities[1][i]->sprites_drawn;
+    }
+    destroy_entities(entities[0]);
+    destroy_entities(entities[1]);
+
+    result.addPhase("float", ns[0]);
+    result.addPhase("fixed", ns[1]);
+    if(sprites[1] > 0)
+        result.addValue("x+y error/sprite (1e-3 px)", 1000.0 * error / sprites[1]);
+    if(sprites[0] != sprites[1])
+        printf("    Mismatch: %lu sprites drawn in float, %lu in fixed point\n", sprites[0], sprites[1]);
+    return result;
+}
+
+// Times update() and draw() for finished animations with and without auto_sleep
+static Result bench_sleep(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "sleep", num_entities, num_frames);
+
+    vector<Entity*> entities[3];
+    for(int path = 0; path < 3; path++)
+    {
+        create_entities(entities[path], data, fs, num_entities);
+        for(size_t i = 0; i < entities[path].size(); i++)
+        {
+            // Play the animation to its end and stay there
+            Entity* e = entities[path][i];
+            SCML::Entity::Animation* anim = e->getAnimation(e->animation);
+            if(anim != NULL)
+            {
+                anim->looping = "false";
+                e->update(anim->length);
+            }
+            e->auto_sleep = (path > 0);
+            e->retained_output = (path == 2);
+        }
+    }
+
+    vector<double> ns[3];
+    double error = 0.0;
+    unsigned long sprites[2] = {0, 0};
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        // Alternate which goes first, so none always finds the caches warmed by the others
+        for(int pass = 0; pass < 3; pass++)
+        {
+            int path = (pass + frame) % 3;
+            float scroll = (path < 2? float(frame % 64) : 0.0f);
+            double start = now_ns();
+            for(size_t i = 0; i < entities[path].size(); i++)
+            {
+                entities[path][i]->update(FRAME_MS);
+                entities[path][i]->draw(entity_x(i) + scroll, entity_y(i), 10.0f, 1.5f, 1.5f);
+            }
+            ns[path].push_back((now_ns() - start) / entities[path].size());
+        }
+
+        // The null renderer sums x + y of every sprite, which a replayed pose should match
+        for(size_t i = 0; i < entities[0].size(); i++)
+        {
+            error += fabs(entities[1][i]->checksum - entities[0][i]->checksum);
+            for(int path = 0; path < 3; path++)
+                entities[path][i]->checksum = 0.0f;
+        }
+    }
+
+    int sleeps = 0;
+    int wakes = 0;
+    for(size_t i = 0; i < entities[0].size(); i++)
+    {
+        sprites[0] += entities[0][i]->sprites_drawn;
+        sprites[1] += entities[1][i]->sprites_drawn;
+        sleeps += entities[1][i]->sleeps;
+        wakes += entities[1][i]->wakes;
+    }
+    for(int path = 0; path < 3; path++)
+        destroy_entities(entities[path]);
+
+    result.addPhase("awake", ns[0]);
+    result.addPhase("asleep, moving", ns[1]);
+    result.addPhase("asleep, retained", ns[2]);
+    result.addValue("sleeps/entity", double(sleeps) / num_entities);
+    result.addValue("wakes/entity", double(wakes) / num_entities);
+    if(sprites[1] > 0)
+        result.addValue("x+y error/sprite (1e-3 px)", 1000.0 * error / sprites[1]);
+    if(sprites[0] != sprites[1])
+        printf("    Mismatch: %lu sprites drawn awake, %lu asleep\n", sprites[0], sprites[1]);
+    return result;
+}
+
+// Times update() and draw() for every entity against an Update_Scheduler with a quarter of the time
+static Result bench_schedule(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "schedule", num_entities, num_frames);
+
+    vector<Entity*> entities[2];
+    create_entities(entities[0], data, fs, num_entities);
+    create_entities(entities[1], data, fs, num_entities);
+    if(entities[0].empty())
+        return result;
+
+    // Measure a frame without the scheduler to set its budget
+    double full_ns = 0.0;
+    for(int frame = 0; frame < 10; frame++)
+    {
+        restart_finished(entities[0]);
+        double start = now_ns();
+        for(size_t i = 0; i < entities[0].size(); i++)
+        {
+            entities[0][i]->update(FRAME_MS);
+            entities[0][i]->draw(entity_x(i), entity_y(i));
+        }
+        full_ns += now_ns() - start;
+    }
+
+    SCML::Update_Scheduler scheduler(float(full_ns / 10 / 4 / 1000));
+    for(size_t i = 0; i < entities[1].size(); i++)
+        scheduler.add(entities[1][i], (i % 10 == 0? 1.0f : 0.0f));
+
+    vector<double> ns[2];
+    double used_us = 0.0, evaluated = 0.0, staleness = 0.0;
+    int max_staleness = 0;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        // Alternate which goes first, so neither always finds the caches warmed by the other
+        for(int pass = 0; pass < 2; pass++)
+        {
+            int path = (pass + frame) % 2;
+            restart_finished(entities[path]);
+            double start = now_ns();
+            if(path == 0)
+            {
+                for(size_t i = 0; i < entities[0].size(); i++)
+                    entities[0][i]->update(FRAME_MS);
+            }
+            else
+                scheduler.update(FRAME_MS);
+            for(size_t i = 0; i < entities[path].size(); i++)
+                entities[path][i]->draw(entity_x(i), entity_y(i));
+            ns[path].push_back((now_ns() - start) / entities[path].size());
+        }
+
+        const SCML::Schedule_Stats& stats = scheduler.getStats();
+        used_us += stats.used_us;
+        evaluated += stats.num_evaluated;
+        staleness += stats.mean_staleness;
+        if(stats.max_staleness > max_staleness)
+            max_staleness = stats.max_staleness;
+    }
+
+    scheduler.clear();
+    destroy_entities(entities[0]);
+    destroy_entities(entities[1]);
+
+    result.addPhase("every frame", ns[0]);
+    result.addPhase("scheduled", ns[1]);
+    result.addValue("budget (us/frame)", scheduler.budget_us);
+    result.addValue("used (us/frame)", used_us / num_frames);
+    result.addValue("evaluated/frame %", 100.0 * evaluated / num_frames / num_entities);
+    result.addValue("mean staleness (frames)", staleness / num_frames);
+    result.addValue("max staleness (frames)", max_staleness);
+    return result;
+}
+
+// The timeline names of the bones in the first key of an entity's first animation
+static vector<string> get_bone_names(SCML::Data& data, int entity)
+{
+    vector<string> names;
+    SCML::Data::Entity* entity_ptr = SCML_MAP_FIND(data.entities, entity);
+    if(entity_ptr == NULL || entity_ptr->animations.size() == 0)
+        return names;
+
+    SCML::Data::Entity::Animation* animation = entity_ptr->animations.begin()->second;
+    if(animation->mainline.keys.size() == 0)
+        return names;
+
+    typedef SCML::Data::Entity::Animation::Mainline::Key Key;
+    Key* key = animation->mainline.keys.begin()->second;
+    SCML_BEGIN_MAP_FOREACH_CONST(key->bones, int, Key::Bone_Container, container)
+    {
+        if(!container.hasBone_Ref())
+            continue;
+        SCML::Data::Entity::Animation::Timeline* timeline = SCML_MAP_FIND(animation->timelines, container.bone_ref->timeline);
+        if(timeline != NULL)
+            names.push_back(SCML_TO_CSTRING(timeline->name));
+    }
+    SCML_END_MAP_FOREACH_CONST;
+    return names;
+}
+
+// Times update() with draw(), with a headless evaluate() of every bone, and with one of two bones
+static Result bench_headless(const string& file, SCML::Data& data, FileSystem& fs, int num_entities, int num_frames)
+{
+    Result result(file, "headless", num_entities, num_frames);
+    if(data.entities.size() == 0)
+        return result;
+
+    int entity = data.entities.begin()->first;
+    vector<string> bone_names = get_bone_names(data, entity);
+    vector<Entity*> drawn;
+    vector<SCML::Headless_Entity*> headless[2];
+    for(int i = 0; i < num_entities; i++)
+    {
+        drawn.push_back(new Entity(&data, entity));
+        drawn.back()->setFileSystem(&fs);
+        drawn.back()->update((i * 97) % 1000);
+        for(int path = 0; path < 2; path++)
+        {
+            headless[path].push_back(new SCML::Headless_Entity(&data, entity));
+            headless[path].back()->update((i * 97) % 1000);
+        }
+    }
+
+    int handles[2] = {-1, -1};
+    int num_handles = 0;
+    for(size_t i = (bone_names.size() > 2? bone_names.size() - 2 : 0); i < bone_names.size(); i++)
+        handles[num_handles++] = headless[1][0]->getBoneHandle(bone_names[i].c_str());
+    for(int i = 0; i < num_entities; i++)
+        headless[1][i]->setBones(handles, num_handles);
+
+    vector<double> ns[3];
+    unsigned long mismatches = 0;
+    double evaluated = 0.0, bones = 0.0;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        // Alternate which goes first, so none always finds the caches warmed by the others
+        for(int pass = 0; pass < 3; pass++)
+        {
+            int path = (pass + frame) % 3;
+            double start = now_ns();
+            if(path == 0)
+            {
+                restart_finished(drawn);
+                for(int i = 0; i < num_entities; i++)
+                {
+                    drawn[i]->update(FRAME_MS);
+                    drawn[i]->draw(entity_x(i), entity_y(i));
+                }
+            }
+            else
+            {
+                vector<SCML::Headless_Entity*>& entities = headless[path - 1];
+                for(int i = 0; i < num_entities; i++)
+                {
+                    SCML::Headless_Entity* e = entities[i];
+                    SCML::Entity::Animation* anim = e->getAnimation(e->animation);
+                    if(anim != NULL && anim->looping != "true" && e->time >= anim->length)
+                        e->startAnimation((e->animation + 1) % e->getNumAnimations());
+                    e->update(FRAME_MS);
+                    e->evaluate(SCML::Transform(entity_x(i), entity_y(i), 0.0f, 1.0f, 1.0f));
+                }
+            }
+            ns[path].push_back((now_ns() - start) / num_entities);
+        }
+
+        // The bones asked for come out the same either way
+        for(int i = 0; i < num_entities; i++)
+        {
+            for(int h = 0; h < num_handles; h++)
+            {
+                SCML::Transform all, some;
+                bool found = headless[0][i]->getBone(handles[h], all);
+                if(found != headless[1][i]->getBone(handles[h], some) || (found && all != some))
+                    mismatches++;
+            }
+            const SCML::Entity::Bone_Transform_State& state = headless[1][i]->bone_transform_state;
+            for(size_t b = 0; b < state.needed_bones.size(); b++)
+                evaluated += state.needed_bones[b];
+            bones += state.transforms.size();
+        }
+    }
+
+    destroy_entities(drawn);
+    for(int path = 0; path < 2; path++)
+    {
+        for(int i = 0; i < num_entities; i++)
+            delete headless[path][i];
+    }
+
+    result.addPhase("update+draw", ns[0]);
+    result.addPhase("update+all bones", ns[1]);
+    char name[64];
+    sprintf(name, "update+%d bones", num_handles);
+    result.addPhase(name, ns[2]);
+    if(bones > 0.0)
+        result.addValue("bones evaluated %", 100.0 * evaluated / bones);
+    if(mismatches > 0)
+        printf("    Mismatch: %lu bones differ between evaluating all bones and some\n", mismatches);
+    return result;
+}
+
+// Appends an entity whose one object shows the first animation of the first entity, as a sub-entity, from t = 0 to 1
+static string add_bench_holder(const string& text, int holder_id, int entity, int length)
+{
+    size_t end = text.rfind("</spriter_data>");
+    if(end == string::npos)
+        return text;
+
+    char holder[1024];
+    sprintf(holder, "<entity id=\"%d\" name=\"bench_holder\"><animation id=\"0\" name=\"carry\" length=\"%d\" looping=\"false\">"
+            "<mainline><key id=\"0\"><object_ref id=\"0\" timeline=\"0\" key=\"0\" z_index=\"0\"/></key></mainline>"
+            "<timeline id=\"0\" name=\"carried\" object_type=\"entity\">"
+            "<key id=\"0\" spin=\"0\"><object entity=\"%d\" animation=\"0\" t=\"0\"/></key>"
+            "<key id=\"1\" time=\"%d\" spin=\"0\"><object entity=\"%d\" animation=\"0\" t=\"1\"/></key>"
+            "</timeline></animation></entity>\n", holder_id, length, entity, length, entity);
+    return text.substr(0, end) + holder + text.substr(end);
+}
+
+// Times update+draw of entities carried as sub-entity objects, which share their poses, against the entities themselves
+static Result bench_subentities(const string& file, int num_entities, int num_frames)
+{
+    Result result(file, "subentities", num_entities, num_frames);
+
+    string text;
+    if(!read_text(file, text))
+        return result;
+
+    SCML::Data original;
+    if(!original.fromTextData(text.c_str()) || original.entities.size() == 0)
+        return result;
+    int entity = original.entities.begin()->first;
+    SCML::Data::Entity::Animation* animation_ptr = SCML_MAP_FIND(original.entities.begin()->second->animations, 0);
+    if(animation_ptr == NULL || animation_ptr->length <= 0)
+        return result;
+    int holder_id = 0;
+    SCML_BEGIN_MAP_FOREACH_CONST(original.entities, int, SCML::Data::Entity*, e)
+    {
+        holder_id = max(holder_id, e->id + 1);
+    }
+    SCML_END_MAP_FOREACH_CONST;
+
+    SCML::Data data;
+    if(!data.fromTextData(add_bench_holder(text, holder_id, entity, animation_ptr->length).c_str()))
+        return result;
+    FileSystem fs;
+    fs.load(&data);
+
+    // The same phases for both, so they draw the same poses
+    vector<Entity*> separate, carried;
+    for(int i = 0; i < num_entities; i++)
+    {
+        separate.push_back(new Entity(&data, entity));
+        carried.push_back(new Entity(&data, holder_id));
+        separate.back()->setFileSystem(&fs);
+        carried.back()->setFileSystem(&fs);
+        separate.back()->update((i % 8) * 97);
+        carried.back()->update((i % 8) * 97);
+    }
+
+    SCML::Pose_Cache* cache = data.getPoseCache();
+    vector<double> separate_ns, carried_ns;
+    for(int frame = 0; frame < num_frames; frame++)
+    {
+        restart_finished(separate);
+        restart_finished(carried);
+
+        double start = now_ns();
+        for(size_t i = 0; i < separate.size(); i++)
+        {
+            separate[i]->update(FRAME_MS);
+            separate[i]->draw(entity_x(i), entity_y(i));
+        }
+        double drew_separate = now_ns();
+        for(size_t i = 0; i < carried.size(); i++)
+        {
+            carried[i]->update(FRAME_MS);
+            carried[i]->draw(entity_x(i), entity_y(i));
+        }
+        double drew_carried = now_ns();
+
+        separate_ns.push_back((drew_separate - start) / num_entities);
+        carried_ns.push_back((drew_carried - drew_separate) / num_entities);
+
+        // Poses are only reused within a frame here, since every frame is at new times
+        cache->clear();
+    }
+
+    unsigned long sprites[2] = {0, 0};
+    for(int i = 0; i < num_entities; i++)
+    {
+        sprites[0] += separate[i]->sprites_drawn;
+        sprites[1] += carried[i]->sprites_drawn;
+    }
+    destroy_entities(separate);
+    destroy_entities(carried);
+
+    result.addPhase("separate", separate_ns);
+    result.addPhase("sub-entity", carried_ns);
+    result.addValue("pose hits %", 100.0 * cache->hits / double(cache->hits + cache->misses));
+    if(sprites[0] != sprites[1])
+        printf("    Mismatch: %lu sprites drawn separately, %lu as sub-entities\n", sprites[0], sprites[1]);
+    return result;
+}
+
+
+// Frees the placeholder image handles of bench_registry()
+static void free_placeholder(void* image)
+{
+    delete static_cast<SCML_PAIR(unsigned int, unsigned int)*>(image);
+}
+
+// Acquires a document's images.  The null renderer decodes nothing, so a placeholder holding the size stands in for each image.
+static void acquire_images(SCML::Asset_Registry& registry, SCML::Data* data, vector<void*>& images)
+{
+    string basedir = data->name.c_str();
+    size_t slash = basedir.find_last_of('/');
+    basedir = (slash == string::npos? "" : basedir.substr(0, slash + 1));
+
+    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, folder)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(folder->files, int, SCML::Data::Folder::File*, file)
+        {
+            string path = basedir + file->name.c_str();
+            void* image = registry.acquireImage(path.c_str());
+            if(image == NULL)
+            {
+                image = new SCML_PAIR(unsigned int, unsigned int)(file->width, file->height);
+                registry.addImage(path.c_str(), image, file->width, file->height, free_placeholder);
+            }
+            images.push_back(image);
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+// Loads a document for each of a series of levels, each of which is released after the next one has loaded,
+// once into a private Data and once through an Asset_Registry, which shares it from the second level on.
+static Result bench_registry(const string& file, int num_levels)
+{
+    Result result(file, "registry", 0, num_levels, "ns/level");
+
+    vector<double> private_ns;
+    SCML::Data* previous = NULL;
+    for(int i = 0; i < num_levels; i++)
+    {
+        double start = now_ns();
+        SCML::Data* data = new SCML::Data(file.c_str());
+        delete previous;
+        private_ns.push_back(now_ns() - start);
+        previous = data;
+    }
+    delete previous;
+    result.addPhase("private", private_ns);
+
+    SCML::Asset_Registry registry;
+    vector<double> shared_ns;
+    SCML::Data* previous_data = NULL;
+    vector<void*> previous_images;
+    for(int i = 0; i < num_levels; i++)
+    {
+        double start = now_ns();
+        SCML::Data* data = registry.acquireData(file.c_str());
+        if(data == NULL)
+            return result;
+        vector<void*> images;
+        acquire_images(registry, data, images);
+        if(previous_data != NULL)
+            registry.releaseData(previous_data);
+        for(size_t j = 0; j < previous_images.size(); j++)
+            registry.releaseImage(previous_images[j]);
+        shared_ns.push_back(now_ns() - start);
+        previous_data = data;
+        previous_images.swap(images);
+    }
+    result.addPhase("shared", shared_ns);
+
+    const SCML::Asset_Stats& stats = registry.getStats();
+    result.addValue("hits", stats.hits);
+    result.addValue("misses", stats.misses);
+    result.addValue("saved KB", stats.bytes_saved / 1024.0);
+    result.addValue("data held", stats.num_data);
+    result.addValue("images held", stats.num_images);
+
+    registry.releaseData(previous_data);
+    for(size_t j = 0; j < previous_images.size(); j++)
+        registry.releaseImage(previous_images[j]);
+    return result;
+}
+
+
+int main(int argc, char* argv[])
+{
+    int num_entities = 100;
+    int num_frames = 500;
+    const char* json_file = NULL;
+    const char* trace_file = NULL;
+    bool run_lod = false;
+    bool run_alloc = false;
+    bool run_load = false;
+    bool run_names = false;
+    bool run_crossfade = false;
+    bool run_quantize = false;
+    bool run_lazy = false;
+    bool run_registry = false;
+    bool run_triggers = false;
+    bool run_variables = false;
+    bool run_tags = false;
+    bool run_subentities = false;
+    bool run_queries = false;
+    bool run_views = false;
+    bool run_policies = false;
+    bool run_affine = false;
+    bool run_fixed = false;
+    bool run_headless = false;
+    bool run_sleep = false;
+    bool run_schedule = false;
+    vector<string> data_files;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-n") == 0 && i+1 < argc)
+            num_entities = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-f") == 0 && i+1 < argc)
+            num_frames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-o") == 0 && i+1 < argc)
+            json_file = argv[++i];
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc)
+            trace_file = argv[++i];
+        else if(strcmp(argv[i], "--lod") == 0)
+            run_lod = true;
+        else if(strcmp(argv[i], "--alloc") == 0)
+            run_alloc = true;
+        else if(strcmp(argv[i], "--load") == 0)
+            run_load = true;
+        else if(strcmp(argv[i], "--names") == 0)
+            run_names = true;
+        else if(strcmp(argv[i], "--crossfade") == 0)
+            run_crossfade = true;
+        else if(strcmp(argv[i], "--quantize") == 0)
+            run_quantize = true;
+        else if(strcmp(argv[i], "--lazy") == 0)
+            run_lazy = true;
+        else if(strcmp(argv[i], "--registry") == 0)
+            run_registry = true;
+        else if(strcmp(argv[i], "--triggers") == 0)
+            run_triggers = true;
+        else if(strcmp(argv[i], "--variables") == 0)
+            run_variables = true;
+        else if(strcmp(argv[i], "--tags") == 0)
+            run_tags = true;
+        else if(strcmp(argv[i], "--subentities") == 0)
+            run_subentities = true;
+        else if(strcmp(argv[i], "--queries") == 0)
+            run_queries = true;
+        else if(strcmp(argv[i], "--views") == 0)
+            run_views = true;
+        else if(strcmp(argv[i], "--policies") == 0)
+            run_policies = true;
+        else if(strcmp(argv[i], "--affine") == 0)
+            run_affine = true;
+        else if(strcmp(argv[i], "--fixed") == 0)
+            run_fixed = true;
+        else if(strcmp(argv[i], "--headless") == 0)
+            run_headless = true;
+        else if(strcmp(argv[i], "--sleep") == 0)
+            run_sleep = true;
+        else if(strcmp(argv[i], "--schedule") == 0)
+            run_schedule = true;
+        else if(argv[i][0] == '-')
+        {
+            printf("Usage: %s [-n entities] [-f frames] [-o results.json] [-t trace.json] [--lod] [--alloc] [--load] [--names] [--crossfade] [--quantize] [--lazy] [--registry] [--triggers] [--variables] [--tags] [--subentities] [--queries] [--views] [--policies] [--affine] [--fixed] [--headless] [--sleep] [--schedule] [file.scml ...]\n", argv[0]);
+            return 1;
+        }
+        else
+            data_files.push_back(argv[i]);
+    }
+
+    if(data_files.size() == 0)
+    {
+        data_files.push_back("samples/monster/Example.SCML");
+        data_files.push_back("samples/knight/knight.scml");
+        data_files.push_back("samples/hero/Hero.SCML");
+    }
+
+    vector<Result> results;
+    vector<Alloc_Result> alloc_results;
+    bool allocation_failure = false;
+    for(size_t i = 0; i < data_files.size(); i++)
+    {
+        SCML::Data data;
+        if(!data.load(data_files[i].c_str()))
+            return 2;
+
+        FileSystem fs;
+        fs.load(&data);
+
+        results.push_back(bench_frames(data_files[i], data, fs, num_entities, num_frames));
+        results.back().print();
+
+        if(run_lod)
+        {
+            results.push_back(bench_lod(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_load)
+        {
+            results.push_back(bench_load(data_files[i], 50));
+            results.back().print();
+        }
+
+        if(run_names)
+        {
+            results.push_back(bench_names(data_files[i], "names", data, fs, 200));
+            results.back().print();
+
+            SCML::Data many_data;
+            if(load_with_animations(data_files[i], 100, many_data))
+            {
+                FileSystem many_fs;
+                many_fs.load(&many_data);
+                results.push_back(bench_names(data_files[i], "names_100", many_data, many_fs, 200));
+                results.back().print();
+            }
+        }
+
+        if(run_crossfade)
+        {
+            results.push_back(bench_crossfade(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_quantize)
+        {
+            results.push_back(bench_quantize(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_lazy)
+        {
+            results.push_back(bench_lazy(data_files[i], num_entities, 20));
+            results.back().print();
+        }
+
+        if(run_registry)
+        {
+            results.push_back(bench_registry(data_files[i], 50));
+            results.back().print();
+        }
+
+        if(run_triggers)
+        {
+            results.push_back(bench_triggers(data_files[i], data, fs, num_entities, num_frames, 256));
+            results.back().print();
+        }
+
+        if(run_variables)
+        {
+            results.push_back(bench_variables(data_files[i], num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_tags)
+        {
+            results.push_back(bench_tags(data_files[i], num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_subentities)
+        {
+            results.push_back(bench_subentities(data_files[i], num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_queries)
+        {
+            results.push_back(bench_queries(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_views)
+        {
+            results.push_back(bench_views(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_policies)
+        {
+            results.push_back(bench_policies(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_affine)
+        {
+            results.push_back(bench_affine(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_fixed)
+        {
+            results.push_back(bench_fixed(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_headless)
+        {
+            results.push_back(bench_headless(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_sleep)
+        {
+            results.push_back(bench_sleep(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_schedule)
+        {
+            results.push_back(bench_schedule(data_files[i], data, fs, num_entities, num_frames));
+            results.back().print();
+        }
+
+        if(run_alloc)
+        {
+            unsigned long steady_state_allocations = 0;
+            alloc_results.push_back(bench_alloc(data_files[i], num_entities, num_frames, steady_state_allocations));
+            alloc_results.back().print();
+            if(steady_state_allocations > 0)
+            {
+                printf("FAILED: Steady-state update() and draw() made %lu allocations for %s\n", steady_state_allocations, data_files[i].c_str());
+                allocation_failure = true;
+            }
+        }
+    }
+
+    if(json_file != NULL)
+    {
+        FILE* out = fopen(json_file, "w");
+        if(out == NULL)
+        {
+            printf("Couldn't open %s for writing.\n", json_file);
+            return 3;
+        }
+        fprintf(out, "{\"results\": [\n");
+        for(size_t i = 0; i < results.size(); i++)
+        {
+            results[i].writeJSON(out);
+            fprintf(out, "%s\n", (i+1 < results.size()? "," : ""));
+        }
+        fprintf(out, "], \"allocations\": [\n");
+        for(size_t i = 0; i < alloc_results.size(); i++)
+        {
+            alloc_results[i].writeJSON(out);
+            fprintf(out, "%s\n", (i+1 < alloc_results.size()? "," : ""));
+        }
+        fprintf(out, "]}\n");
+        fclose(out);
+    }
+
+    if(trace_file != NULL && !SCML::writeProfileTrace(trace_file))
+        return 3;
+
+    if(allocation_failure)
+        return 4;
+    return 0;
+}
@@ -7,22 +7,46 @@ namespace SCML_SDL_gpu
 {
 
 
+// Frees an image once the Asset_Registry stops sharing it
+static void free_image(void* image)
+{
+    GPU_FreeImage(static_cast<GPU_Image*>(image));
+}
+
+// Gives an image back to the registry that shares it, or frees it
+static void release_image(SCML::Asset_Registry* registry, GPU_Image* img)
+{
+    if(registry != NULL)
+        registry->releaseImage(img);
+    else
+        GPU_FreeImage(img);
+}
+
 FileSystem::~FileSystem()
 {
     // Delete everything
     clear();
 }
 
-bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& filename)
+bool FileSystem::loadImageFile(int folderID, int fileID, const SCML_STRING& filename)
 {
     // Load an image and store it somewhere accessible by its folder/file ID combo.
-    GPU_Image* img = GPU_LoadImage(SCML_TO_CSTRING(filename));
+    // With a registry, an image that was already loaded from the same file is shared instead.
+    GPU_Image* img = NULL;
+    if(registry != NULL)
+        img = static_cast<GPU_Image*>(registry->acquireImage(SCML_TO_CSTRING(filename)));
     if(img == NULL)
-        return false;
+    {
+        img = GPU_LoadImage(SCML_TO_CSTRING(filename));
+        if(img == NULL)
+            return false;
+        if(registry != NULL)
+            registry->addImage(SCML_TO_CSTRING(filename), img, img->w, img->h, free_image);
+    }
     if(!SCML_MAP_INSERT(images, SCML_MAKE_PAIR(folderID, fileID), img))
     {
         printf("SCML_SDL_gpu::FileSystem failed to load image: Loading %s duplicates a folder/file id (%d/%d)\n", SCML_TO_CSTRING(filename), folderID, fileID);
-        GPU_FreeImage(img);
+        release_image(registry, img);
         return false;
     }
     return true;
@@ -34,7 +58,7 @@ void FileSystem::clear()
     typedef SCML_PAIR(int,int) pair_type;
     SCML_BEGIN_MAP_FOREACH_CONST(images, pair_type, GPU_Image*, item)
     {
-        GPU_FreeImage(item);
+        release_image(registry, item);
     }
     SCML_END_MAP_FOREACH_CONST;
     images.clear();
@@ -60,13 +84,13 @@ GPU_Image* FileSystem::getImage(int folderID, int fileID) const
 
 
 
-// Pass the initialization on to the base class, SCML::Entity.
+// Pass the initialization on to the base class, SCML::Renderer_Entity.
 Entity::Entity()
-    : SCML::Entity()
+    : SCML::Renderer_Entity<Entity, SCML::Left_Handed_Coords>()
 {}
 
 Entity::Entity(SCML::Data* data, int entity, int animation, int key)
-    : SCML::Entity(data, entity, animation, key)
+    : SCML::Renderer_Entity<Entity, SCML::Left_Handed_Coords>(data, entity, animation, key)
 {}
 
 // Set the renderer-specific FileSystem
@@ -88,29 +112,19 @@ GPU_Target* Entity::setScreen(GPU_Target* scr)
 
 
 
-// Convert from the renderer's coordinate system to SCML's coordinate system (+x to the right, +y up, +angle counter-clockwise)
-void Entity::convert_to_SCML_coords(float& x, float& y, float& angle)
-{
-    // SDL_gpu uses a common left-handed CG coordinate system (+x to the right, +y down, +angle clockwise)
-    y = -y;
-    angle = 360 - angle;
-}
+// SDL_gpu uses a common left-handed CG coordinate system (+x to the right, +y down, +angle clockwise).
+// SCML::Left_Handed_Coords converts between it and SCML's coordinate system (+x to the right, +y up, +angle counter-clockwise).
 
-SCML_PAIR(unsigned int, unsigned int) Entity::getImageDimensions(int folderID, int fileID) const
+SCML_PAIR(unsigned int, unsigned int) Entity::getImageSize(int folderID, int fileID) const
 {
     // Let the FileSystem do the work
     return file_system->getImageDimensions(folderID, fileID);
 }
 
 // The actual rendering call.
-// (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise)
-void Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+// (x, y) specifies the center point of the image.  x, y, and angle are in SDL_gpu's coordinate system.
+void Entity::drawImage(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
 {
-    // Convert from SCML's coordinate system to the renderer's coordinate system.
-    // This is the inverse of convert_to_SCML_coords() and is usually identical.
-    y = -y;
-    angle = 360 - angle;
-    
     // Get the image
     GPU_Image* img = file_system->getImage(folderID, fileID);
     
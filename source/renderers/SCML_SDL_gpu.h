@@ -27,7 +27,7 @@ class FileSystem : public SCML::FileSystem
     
     /*! Load images and store them so they can be accessed again by the folder/file ID combo.
     */
-    virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool loadImageFile(int folderID, int fileID, const SCML_STRING& filename);
     
     /*! Delete all stored images
     */
@@ -44,8 +44,11 @@ class FileSystem : public SCML::FileSystem
 };
 
 /*! \brief A class to draw SCML character data.
+ *
+ * The renderer and SDL_gpu's coordinate system are given to SCML::Renderer_Entity at compile time, which turns them into
+ * the virtual functions.
  */
-class Entity : public SCML::Entity
+class Entity : public SCML::Renderer_Entity<Entity, SCML::Left_Handed_Coords>
 {
     public:
     
@@ -63,19 +66,14 @@ class Entity : public SCML::Entity
     FileSystem* setFileSystem(FileSystem* fs);
     GPU_Target* setScreen(GPU_Target* scr);
     
-    /*! This converts x, y, and angle to the proper coordinate system, as necessary.
-     * Usually, this just means inverting y and angle.
-     */
-    virtual void convert_to_SCML_coords(float& x, float& y, float& angle);
-    
     /*! Get the width and height of an image.  I don't really like this (since FileSystem already does it), but it is currently necessary.
     */
-    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    SCML_PAIR(unsigned int, unsigned int) getImageSize(int folderID, int fileID) const;
     
     /*! The actual drawing call
-     * (x, y) specifies the center point of the image.  x, y, and angle are in SCML coordinate system (+x to the right, +y up, +angle counter-clockwise), so they must be converted,
+     * (x, y) specifies the center point of the image.  x, y, and angle are already converted to SDL_gpu's coordinate system by SCML::Left_Handed_Coords.
      */
-    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+    void drawImage(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
 };
 
 }
@@ -7,23 +7,44 @@
 namespace SCML_SFML
 {
 
+// Frees a texture once the Asset_Registry stops sharing it
+static void free_image(void* image)
+{
+    delete static_cast<sf::Texture*>(image);
+}
+
+// Gives a texture back to the registry that shares it, or frees it
+static void release_image(SCML::Asset_Registry* registry, sf::Texture* img)
+{
+    if(registry != NULL)
+        registry->releaseImage(img);
+    else
+        delete img;
+}
 
 FileSystem::~FileSystem()
 {
     clear();
 }
 
-bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& filename)
+bool FileSystem::loadImageFile(int folderID, int fileID, const SCML_STRING& filename)
 {
-    sf::Texture* img = new sf::Texture;
-    img->loadFromFile(filename);
+    // With a registry, a texture that was already loaded from the same file is shared instead
+    sf::Texture* img = NULL;
+    if(registry != NULL)
+        img = static_cast<sf::Texture*>(registry->acquireImage(SCML_TO_CSTRING(filename)));
     if(img == NULL)
-        return false;
+    {
+        img = new sf::Texture;
+        img->loadFromFile(SCML_TO_CSTRING(filename));
+        if(registry != NULL)
+            registry->addImage(SCML_TO_CSTRING(filename), img, img->getSize().x, img->getSize().y, free_image);
+    }
     
     if(!SCML_MAP_INSERT(images, SCML_MAKE_PAIR(folderID, fileID), img))
     {
         printf("SCML_SFML::FileSystem failed to load image: Loading %s duplicates a folder/file id (%d/%d)\n", SCML_TO_CSTRING(filename), folderID, fileID);
-        delete img;
+        release_image(registry, img);
         return false;
     }
     return true;
@@ -34,7 +55,7 @@ void FileSystem::clear()
     typedef SCML_PAIR(int,int) pair_type;
     SCML_BEGIN_MAP_FOREACH_CONST(images, pair_type, sf::Texture*, item)
     {
-        delete item;
+        release_image(registry, item);
     }
     SCML_END_MAP_FOREACH_CONST;
     images.clear();
@@ -61,11 +82,15 @@ sf::Texture* FileSystem::getImage(int folderID, int fileID) const
     
 Entity::Entity()
     : SCML::Entity()
-{}
+{
+    affine_output = true;
+}
 
 Entity::Entity(SCML::Data* data, int entity, int animation, int key)
     : SCML::Entity(data, entity, animation, key)
-{}
+{
+    affine_output = true;
+}
 
 FileSystem* Entity::setFileSystem(FileSystem* fs)
 {
@@ -116,6 +141,23 @@ void Entity::draw_internal(int folderID, int fileID, float x, float y, float ang
     screen->draw(sprite);
 }
 
+// The sprite keeps only its origin and SFML takes the matrix as it is, so no trigonometry happens here.
+void Entity::draw_internal_affine(int folderID, int fileID, const SCML::Affine& transform)
+{
+    sf::Texture* img = file_system->getImage(folderID, fileID);
+    if(img == NULL)
+        return;
+    
+    sf::Sprite sprite(*img);
+    sprite.setOrigin(img->getSize().x/2, img->getSize().y/2);
+    
+    // Flip y on both sides: image rows run down, and so does the screen
+    sf::RenderStates states(sf::Transform(transform.xx, -transform.xy, transform.tx,
+                                          -transform.yx, transform.yy, -transform.ty,
+                                          0.0f, 0.0f, 1.0f));
+    screen->draw(sprite, states);
+}
+
 
 
 
@@ -17,7 +17,7 @@ class FileSystem : public SCML::FileSystem
     SCML_MAP(SCML_PAIR(int, int), sf::Texture*) images;
     
     virtual ~FileSystem();
-    virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool loadImageFile(int folderID, int fileID, const SCML_STRING& filename);
     virtual void clear();
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
     
@@ -41,6 +41,7 @@ class Entity : public SCML::Entity
     virtual void convert_to_SCML_coords(float& x, float& y, float& angle);
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
     virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+    virtual void draw_internal_affine(int folderID, int fileID, const SCML::Affine& transform);
 };
 
 }
@@ -13,7 +13,7 @@ FileSystem::~FileSystem()
     clear();
 }
 
-bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& filename)
+bool FileSystem::loadImageFile(int folderID, int fileID, const SCML_STRING& filename)
 {
 	CCSprite* img = CCSprite::create(SCML_TO_CSTRING(filename));
 	
@@ -17,7 +17,7 @@ class FileSystem : public SCML::FileSystem
     SCML_MAP(SCML_PAIR(int, int), cocos2d::CCSprite*) images;
     
     virtual ~FileSystem();
-    virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool loadImageFile(int folderID, int fileID, const SCML_STRING& filename);
     virtual void clear();
     virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
     
@@ -6,26 +6,48 @@
 namespace SCML_MARMALADE
 {
 
+// Frees a texture once the Asset_Registry stops sharing it
+static void free_image(void* image)
+{
+    delete static_cast<CIwTexture*>(image);
+}
+
+// Gives a texture back to the registry that shares it, or frees it
+static void release_image(SCML::Asset_Registry* registry, CIwTexture* img)
+{
+    if(registry != NULL)
+        registry->releaseImage(img);
+    else
+        delete img;
+}
+
 FileSystem::~FileSystem()
 {
     // Delete everything
     clear();
 }
 
-bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& filename)
+bool FileSystem::loadImageFile(int folderID, int fileID, const SCML_STRING& filename)
 {
     // Load an image and store it somewhere accessible by its folder/file ID combo.
-    CIwTexture *img = new CIwTexture();
-    img->LoadFromFile(SCML_TO_CSTRING(filename));
-    img->SetMipMapping(false);
-    img->Upload();
-
+    // With a registry, a texture that was already uploaded from the same file is shared instead.
+    CIwTexture *img = NULL;
+    if(registry != NULL)
+        img = static_cast<CIwTexture*>(registry->acquireImage(SCML_TO_CSTRING(filename)));
     if(img == NULL)
-        return false;
+    {
+        img = new CIwTexture();
+        img->LoadFromFile(SCML_TO_CSTRING(filename));
+        img->SetMipMapping(false);
+        img->Upload();
+        if(registry != NULL)
+            registry->addImage(SCML_TO_CSTRING(filename), img, img->GetWidth(), img->GetHeight(), free_image);
+    }
+
     if(!SCML_MAP_INSERT(images, SCML_MAKE_PAIR(folderID, fileID), img))
     {
         printf("SCML_SDL_gpu::FileSystem failed to load image: Loading %s duplicates a folder/file id (%d/%d)\n", SCML_TO_CSTRING(filename), folderID, fileID);
-        delete img;
+        release_image(registry, img);
         return false;
     }
     return true;
@@ -37,7 +59,7 @@ void FileSystem::clear()
     typedef SCML_PAIR(int,int) pair_type;
     SCML_BEGIN_MAP_FOREACH_CONST(images, pair_type, CIwTexture*, item)
     {
-        delete item;
+        release_image(registry, item);
     }
     SCML_END_MAP_FOREACH_CONST;
     images.clear();
@@ -25,7 +25,7 @@ class FileSystem : public SCML::FileSystem
     
     /*! Load images and store them so they can be accessed again by the folder/file ID combo.
     */
-    virtual bool loadImageFile(int folderID, int fileID, const std::string& filename);
+    virtual bool loadImageFile(int folderID, int fileID, const SCML_STRING& filename);
     
     /*! Delete all stored images
     */
@@ -0,0 +1,86 @@
+#include "SCML_null.h"
+#include <cstdlib>
+
+
+namespace SCML_null
+{
+
+
+FileSystem::~FileSystem()
+{
+    clear();
+}
+
+void FileSystem::load(SCML::Data* data)
+{
+    SCML_PROFILE_ZONE("FileSystem::load", data);
+
+    if(data == NULL)
+        return;
+
+    SCML_BEGIN_MAP_FOREACH_CONST(data->folders, int, SCML::Data::Folder*, folder)
+    {
+        SCML_BEGIN_MAP_FOREACH_CONST(folder->files, int, SCML::Data::Folder::File*, file)
+        {
+            if(file->type == "image")
+                SCML_MAP_INSERT_ONLY(images, SCML_MAKE_PAIR(folder->id, file->id), SCML_MAKE_PAIR((unsigned int)file->width, (unsigned int)file->height));
+        }
+        SCML_END_MAP_FOREACH_CONST;
+    }
+    SCML_END_MAP_FOREACH_CONST;
+}
+
+bool FileSystem::loadImageFile(int folderID, int fileID, const SCML_STRING& filename)
+{
+    SCML_MAP_INSERT_ONLY(images, SCML_MAKE_PAIR(folderID, fileID), SCML_MAKE_PAIR(0u, 0u));
+    return true;
+}
+
+void FileSystem::clear()
+{
+    images.clear();
+}
+
+SCML_PAIR(unsigned int, unsigned int) FileSystem::getImageDimensions(int folderID, int fileID) const
+{
+    return SCML_MAP_FIND(images, SCML_MAKE_PAIR(folderID, fileID));
+}
+
+
+
+
+
+
+Entity::Entity()
+    : SCML::Entity(), file_system(NULL), sprites_drawn(0), checksum(0.0f)
+{}
+
+Entity::Entity(SCML::Data* data, int entity, int animation, int key)
+    : SCML::Entity(data, entity, animation, key), file_system(NULL), sprites_drawn(0), checksum(0.0f)
+{}
+
+FileSystem* Entity::setFileSystem(FileSystem* fs)
+{
+    FileSystem* old = file_system;
+    file_system = fs;
+    return old;
+}
+
+SCML_PAIR(unsigned int, unsigned int) Entity::getImageDimensions(int folderID, int fileID) const
+{
+    return file_system->getImageDimensions(folderID, fileID);
+}
+
+// The null renderer works in SCML coordinates, so there is no conversion here or in convert_to_SCML_coords().
+void Entity::draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y)
+{
+    sprites_drawn++;
+    checksum += x + y;
+}
+
+
+
+
+
+}
+
@@ -0,0 +1,65 @@
+#ifndef _NULL_RENDERER_H__
+#define _NULL_RENDERER_H__
+
+#include "SCMLpp.h"
+
+/*! \brief Namespace for the null renderer
+ *
+ * This renderer needs no window and loads no images.  It is used to measure the cost of SCMLpp itself (see bench/scml_bench.cpp).
+*/
+namespace SCML_null
+{
+
+/*! \brief Storage for image dimensions, indexed by folder and file IDs.
+ *
+ * The dimensions come from the width and height attributes in the SCML data instead of image files.
+*/
+class FileSystem : public SCML::FileSystem
+{
+    public:
+
+    /*! These ints are: Folder, File.  The stored pair is the width and height of the image.
+    */
+    SCML_MAP(SCML_PAIR(int, int), SCML_PAIR(unsigned int, unsigned int)) images;
+
+    virtual ~FileSystem();
+
+    /*! Record the dimensions of every file in the SCML data.  No image files are opened.
+    */
+    virtual void load(SCML::Data* data);
+
+    /*! Record an image without dimensions, unless it is already known.
+    */
+    virtual bool loadImageFile(int folderID, int fileID, const SCML_STRING& filename);
+    virtual void clear();
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+
+};
+
+/*! \brief An entity that does all of the SCML work, but draws nothing.
+ */
+class Entity : public SCML::Entity
+{
+    public:
+
+    FileSystem* file_system;
+
+    /*! Number of draw_internal() calls */
+    unsigned long sprites_drawn;
+    /*! Sum of the drawn positions, so the work can't be optimized away */
+    float checksum;
+
+    Entity();
+    Entity(SCML::Data* data, int entity, int animation = 0, int key = 0);
+
+    FileSystem* setFileSystem(FileSystem* fs);
+
+    virtual SCML_PAIR(unsigned int, unsigned int) getImageDimensions(int folderID, int fileID) const;
+    virtual void draw_internal(int folderID, int fileID, float x, float y, float angle, float scale_x, float scale_y);
+};
+
+}
+
+
+
+#endif
@@ -7,30 +7,53 @@
 namespace SCML_sprig
 {
 
+// Frees a surface once the Asset_Registry stops sharing it
+static void free_image(void* image)
+{
+    SDL_FreeSurface(static_cast<SDL_Surface*>(image));
+}
+
+// Gives a surface back to the registry that shares it, or frees it
+static void release_image(SCML::Asset_Registry* registry, SDL_Surface* img)
+{
+    if(registry != NULL)
+        registry->releaseImage(img);
+    else
+        SDL_FreeSurface(img);
+}
 
 FileSystem::~FileSystem()
 {
     clear();
 }
 
-bool FileSystem::loadImageFile(int folderID, int fileID, const std::string& filename)
+bool FileSystem::loadImageFile(int folderID, int fileID, const SCML_STRING& filename)
 {
-    SDL_Surface* img = IMG_Load(SCML_TO_CSTRING(filename));
-    if(img == NULL)
-        return false;
-    
-    // Convert to display format for optimized blitting
-    SDL_Surface* tmp = img;
-    img = SDL_DisplayFormatAlpha(img);
-    SDL_FreeSurface(tmp);
-    
+    // With a registry, a surface that was already loaded from the same file is shared instead
+    SDL_Surface* img = NULL;
+    if(registry != NULL)
+        img = static_cast<SDL_Surface*>(registry->acquireImage(SCML_TO_CSTRING(filename)));
     if(img == NULL)
-        return false;
+    {
+        img = IMG_Load(SCML_TO_CSTRING(filename));
+        if(img == NULL)
+            return false;
+        
+        // Convert to display format for optimized blitting
+        SDL_Surface* tmp = img;
+        img = SDL_DisplayFormatAlpha(img);
+        SDL_FreeSurface(tmp);
+        
+        if(img == NULL)
+            return false;
+        if(registry != NULL)
+            registry->addImage(SCML_TO_CSTRING(filename), img, img->w, img->h, free_image);
+    }
     
     if(!SCML_MAP_INSERT(images, SCML_MAKE_PAIR(folderID, fileID), img))
     {
         printf("SCML_sprig::FileSystem failed to load image: Loading %s duplicates a folder/file id (%d/%d)\n", SCML_TO_CSTRING(filename), folderID, fileID);
-        SDL_FreeSurface(img);
+        release_image(registry, img);
         return false;
     }
     return true;
@@ -41,7 +64,7 @@ void FileSystem::clear()
     typedef SCML_PAIR(int,int) pair_type;
     SCML_BEGIN_MAP_FOREACH_CONST(images, pair_type, SDL_Surface*, item)
     {
-        SDL_FreeSurface(item);
+        release_image(registry, item);
     }
     SCML_END_MAP_FOREACH_CONST;
     images.clear();
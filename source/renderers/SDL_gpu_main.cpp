@@ -1,6 +1,7 @@
 #include "SCML_SDL_gpu.h"
 #include <vector>
 #include <list>
+#include <string>
 #include <cmath>
 
 using namespace std;
@@ -9,11 +10,44 @@ using namespace SCML_SDL_gpu;
 GPU_Target* screen = NULL;
 Uint8* keystates = NULL;
 
+// Crowd benchmark: the first entity instantiated many times, drawn small, at a forced LOD level
+#define CROWD_SIZE 200
+#define NUM_CROWD_LODS 4
+
+static const char* crowd_lod_names[NUM_CROWD_LODS] = {"full", "reduced rate", "snap to key", "snap to key + culling"};
+
+void clear_crowd(list<Entity*>& crowd)
+{
+    for(list<Entity*>::iterator e = crowd.begin(); e != crowd.end(); e++)
+    {
+        delete (*e);
+    }
+    crowd.clear();
+}
+
+void build_crowd(list<Entity*>& crowd, SCML::Data& data, FileSystem& fs, int lod)
+{
+    clear_crowd(crowd);
+    
+    if(data.entities.size() == 0)
+        return;
+    
+    for(int i = 0; i < CROWD_SIZE; i++)
+    {
+        Entity* entity = new Entity(&data, data.entities.begin()->first);
+        entity->setFileSystem(&fs);
+        entity->setScreen(screen);
+        entity->setLODPolicy(SCML::LOD_Policy(1.0f, 4, 0.5f, (lod == 3? 12.0f : 0.0f)));
+        entity->setLODLevel(lod < SCML::Entity::LOD_SNAP_TO_KEY? lod : SCML::Entity::LOD_SNAP_TO_KEY);
+        entity->update(rand()%1000);
+        crowd.push_back(entity);
+    }
+}
 
 void main_loop(vector<string>& data_files)
 {
     size_t data_file_index = 0;
-    SCML::Data data(data_files[data_file_index]);
+    SCML::Data data(data_files[data_file_index].c_str());
     data.log();
     
     FileSystem fs;
@@ -21,7 +55,7 @@ void main_loop(vector<string>& data_files)
     printf("Loaded %zu images.\n", fs.images.size());
     
     list<Entity*> entities;
-    for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+    for(SCML_MAP(int, SCML::Data::Entity*)::iterator e = data.entities.begin(); e != data.entities.end(); e++)
     {
         Entity* entity = new Entity(&data, e->first);
         entity->setFileSystem(&fs);
@@ -40,6 +74,11 @@ void main_loop(vector<string>& data_files)
     
     bool paused = false;
     
+    list<Entity*> crowd;
+    int crowd_lod = 0;
+    Uint32 crowd_ms = 0;
+    int crowd_frames = 0;
+    
     bool done = false;
     SDL_Event event;
     int dt_ms = 0;
@@ -108,6 +147,23 @@ void main_loop(vector<string>& data_files)
                 {
                     drawBones = !drawBones;
                 }
+                else if(event.key.keysym.sym == SDLK_c)
+                {
+                    if(crowd.size() > 0)
+                        clear_crowd(crowd);
+                    else
+                        build_crowd(crowd, data, fs, crowd_lod);
+                    crowd_ms = 0;
+                    crowd_frames = 0;
+                }
+                else if(event.key.keysym.sym == SDLK_l && crowd.size() > 0)
+                {
+                    crowd_lod = (crowd_lod + 1) % NUM_CROWD_LODS;
+                    build_crowd(crowd, data, fs, crowd_lod);
+                    printf("Crowd LOD: %s\n", crowd_lod_names[crowd_lod]);
+                    crowd_ms = 0;
+                    crowd_frames = 0;
+                }
                 else if(event.key.keysym.sym == SDLK_RETURN)
                 {
                     // Destroy all of our data
@@ -116,6 +172,7 @@ void main_loop(vector<string>& data_files)
                         delete (*e);
                     }
                     entities.clear();
+                    clear_crowd(crowd);
                     
                     fs.clear();
                     data.clear();
@@ -126,13 +183,13 @@ void main_loop(vector<string>& data_files)
                         data_file_index = 0;
                     
                     // Load new data
-                    data.load(data_files[data_file_index]);
+                    data.load(data_files[data_file_index].c_str());
                     data.log();
                     
                     fs.load(&data);
                     printf("Loaded %zu images.\n", fs.images.size());
                     
-                    for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+                    for(SCML_MAP(int, SCML::Data::Entity*)::iterator e = data.entities.begin(); e != data.entities.end(); e++)
                     {
                         Entity* entity = new Entity(&data, e->first);
                         entity->setFileSystem(&fs);
@@ -177,6 +234,26 @@ void main_loop(vector<string>& data_files)
             (*e)->draw(x, y, angle, (flipped? -scale : scale), scale);
         }
         
+        if(crowd.size() > 0)
+        {
+            Uint32 crowdstart = SDL_GetTicks();
+            int i = 0;
+            for(list<Entity*>::iterator e = crowd.begin(); e != crowd.end(); e++, i++)
+            {
+                if(!paused)
+                    (*e)->update(dt_ms);
+                (*e)->draw(40 + 40*(i%20), 100 + 50*(i/20), 0.0f, 0.2f, 0.2f);
+            }
+            crowd_ms += SDL_GetTicks() - crowdstart;
+            crowd_frames++;
+            if(crowd_frames == 100)
+            {
+                printf("Crowd of %d at LOD '%s': %.2f ms/frame\n", CROWD_SIZE, crowd_lod_names[crowd_lod], crowd_ms/float(crowd_frames));
+                crowd_ms = 0;
+                crowd_frames = 0;
+            }
+        }
+        
         if(drawBones)
         {
             for(list<Entity*>::iterator e = entities.begin(); e != entities.end(); e++)
@@ -224,6 +301,7 @@ void main_loop(vector<string>& data_files)
         delete (*e);
     }
     entities.clear();
+    clear_crowd(crowd);
     
     data.clear();
 }
@@ -3,6 +3,7 @@
 #include "SFML/System.hpp"
 #include <vector>
 #include <list>
+#include <string>
 
 using namespace std;
 using namespace SCML_SFML;
@@ -13,7 +14,7 @@ sf::RenderWindow* screen = NULL;
 void main_loop(vector<string>& data_files)
 {
     size_t data_file_index = 0;
-    SCML::Data data(data_files[data_file_index]);
+    SCML::Data data(data_files[data_file_index].c_str());
     data.log();
     
     FileSystem fs;
@@ -21,7 +22,7 @@ void main_loop(vector<string>& data_files)
     printf("Loaded %zu images.\n", fs.images.size());
     
     list<Entity*> entities;
-    for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+    for(SCML_MAP(int, SCML::Data::Entity*)::iterator e = data.entities.begin(); e != data.entities.end(); e++)
     {
         Entity* entity = new Entity(&data, e->first);
         entity->setFileSystem(&fs);
@@ -78,13 +79,13 @@ void main_loop(vector<string>& data_files)
                         data_file_index = 0;
                     
                     // Load new data
-                    data.load(data_files[data_file_index]);
+                    data.load(data_files[data_file_index].c_str());
                     data.log();
                     
                     fs.load(&data);
                     printf("Loaded %zu images.\n", fs.images.size());
                     
-                    for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+                    for(SCML_MAP(int, SCML::Data::Entity*)::iterator e = data.entities.begin(); e != data.entities.end(); e++)
                     {
                         Entity* entity = new Entity(&data, e->first);
                         entity->setFileSystem(&fs);
@@ -87,7 +87,7 @@ bool Test::init()
         scheduleUpdate();
         
         int i = 0;
-        for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+        for(SCML_MAP(int, SCML::Data::Entity*)::iterator e = data.entities.begin(); e != data.entities.end(); e++)
         {
             Entity* entity = new Entity(&data, e->first);
             entity->setFileSystem(&fs);
@@ -177,7 +177,7 @@ bool Test::ccTouchBegan(CCTouch* touch, CCEvent* event)
         fs.load(&data);
         printf("Loaded %zu images.\n", fs.images.size());
         
-        for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+        for(SCML_MAP(int, SCML::Data::Entity*)::iterator e = data.entities.begin(); e != data.entities.end(); e++)
         {
             Entity* entity = new Entity(&data, e->first);
             entity->setFileSystem(&fs);
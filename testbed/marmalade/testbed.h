@@ -32,7 +32,7 @@ void testSCMLMarmalade()
     printf("Loaded %d images.\n", fs.images.size());
     
     list<Entity*> entities;
-    for(map<int, SCML::Data::Entity*>::iterator e = data.entities.begin(); e != data.entities.end(); e++)
+    for(SCML_MAP(int, SCML::Data::Entity*)::iterator e = data.entities.begin(); e != data.entities.end(); e++)
     {
         Entity* entity = new Entity(&data, e->first);
         entity->setFileSystem(&fs);